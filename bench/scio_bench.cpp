@@ -0,0 +1,896 @@
+//
+//  scio_bench: end-to-end throughput and latency of SCSocket against the stand-in
+//  server in test/sc_standin.hpp. The server runs in a child process (this binary
+//  with --serve) so CPU figures are the client's alone.
+//
+//  Usage: scio_bench [name=value ...] > results.json
+//
+//      mode        sweep               or scale, see runScale()
+//      scenarios   publish,rtt,emit_rate   reconnect is also available, see runReconnect()
+//      codecs      json,minbin
+//      deflate     off,on
+//      tls         off,on
+//      sizes       64,1024,16384       payload bytes
+//      messages    20000               per publish / emit_rate run, capped at 256MiB
+//      samples     2000                emit round trips per rtt run
+//      window      256                 emits in flight for emit_rate
+//      reconnects  200                 connects per reconnect run
+//      session_cache on,off            TlsSessionCache for reconnect runs with tls=on
+//      nodelay     on                  client TCP_NODELAY; off shows Nagle/delayed ACK stalls
+//      transport   tcp                 or memory: an in-process server over a MemoryTransport, no
+//                                      kernel or WebSocket framing; skips deflate and TLS configs.
+//                                      CPU figures then include the server's.
+//
+//  mode=scale takes the first of codecs, deflate and tls, plus:
+//
+//      sockets         1000,10000      socket counts to measure
+//      phase_seconds   5               length of the idle, ping and publish phases
+//      ping_interval   1000            ms between server pings in the ping phase
+//      publish_rate    1               publishes per second, each to every socket
+//      connect_window  256             connects in flight, via ConnectAdmission
+//
+//  Results go to stdout as JSON, progress to stderr.
+//
+
+//  STL
+#include <atomic>
+#include <future>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <thread>
+
+//  POSIX
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+//  scio_beast
+#include "../src/scio_beast.hpp"
+#include "../test/sc_standin.hpp"
+
+using json = nlohmann::json;
+
+namespace {
+
+typedef std::map<std::string, std::string> Args;
+
+struct BenchConfig {
+    std::string     codec;
+    bool            deflate;
+    bool            tls;
+    size_t          size;
+    bool            noDelay;
+    bool            memory;
+};
+
+std::vector<std::string> split(const std::string& s) {
+    std::vector<std::string> parts;
+    boost::split(parts, s, boost::is_any_of(","));
+    return parts;
+}
+
+std::string arg(const Args& args, const std::string& name, const std::string& def) {
+    const auto it = args.find(name);
+    return args.end() == it ? def : it->second;
+}
+
+uint64_t argNumber(const Args& args, const std::string& name, const uint64_t def) {
+    return std::stoull(arg(args, name, std::to_string(def)));
+}
+
+std::shared_ptr<scio_beast::ICodecEngine> makeCodec(const std::string& name) {
+    if("minbin" == name) {
+        return std::make_shared<scio_beast::CodecEngineMinBin>();
+    }
+    return nullptr;
+}
+
+//  printable but not trivially compressible, so deflate has real work to do
+json makePayload(const size_t size) {
+    static const char alphabet[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+
+    std::mt19937 rng(size);
+    std::string blob(size, ' ');
+    for(auto& c : blob) {
+        c = alphabet[rng() % (sizeof(alphabet) - 1)];
+    }
+
+    return { { "blob", blob } };
+}
+
+//  user + system CPU of this process, in microseconds
+uint64_t cpuTime() {
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    return
+        (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000ULL +
+        usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+class Stopwatch {
+public:
+    Stopwatch()
+        : m_start(std::chrono::steady_clock::now())
+        , m_cpuStart(cpuTime())
+    {
+    }
+
+    double seconds() const {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+    }
+
+    uint64_t cpuMicros() const { return cpuTime() - m_cpuStart; }
+
+private:
+    std::chrono::steady_clock::time_point   m_start;
+    uint64_t                                m_cpuStart;
+};
+
+uint64_t rssBytes() {
+    std::ifstream statm("/proc/self/statm");
+
+    uint64_t size       = 0;
+    uint64_t resident   = 0;
+    statm >> size >> resident;
+
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+uint64_t threadCount() {
+    std::ifstream status("/proc/self/status");
+
+    std::string line;
+    while(std::getline(status, line)) {
+        if(0 == line.compare(0, 8, "Threads:")) {
+            return std::stoull(line.substr(8));
+        }
+    }
+    return 0;
+}
+
+//  every socket is a descriptor on both ends; scale runs need far more than the usual 1024
+void raiseFileLimit() {
+    rlimit limit;
+    if(0 == getrlimit(RLIMIT_NOFILE, &limit)) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+json configJson(const BenchConfig& cfg) {
+    return {
+        { "codec",      cfg.codec },
+        { "deflate",    cfg.deflate },
+        { "tls",        cfg.tls },
+        { "size",       cfg.size },
+        { "transport",  cfg.memory ? "memory" : "tcp" }
+    };
+}
+
+json rateJson(const Stopwatch& sw, const uint64_t messages, const size_t size) {
+    const double seconds = sw.seconds();
+
+    return {
+        { "messages",       messages },
+        { "seconds",        seconds },
+        { "msgsPerSec",     messages / seconds },
+        { "mbPerSec",       messages * size / seconds / (1024 * 1024) },
+        { "cpuUsPerMsg",    static_cast<double>(sw.cpuMicros()) / messages }
+    };
+}
+
+json histogramJson(const scio_beast::LatencyHistogram& h) {
+    return {
+        { "count",  h.count() },
+        { "mean",   h.mean() },
+        { "min",    h.min() },
+        { "p50",    h.percentile(50) },
+        { "p90",    h.percentile(90) },
+        { "p99",    h.percentile(99) },
+        { "p999",   h.percentile(99.9) },
+        { "max",    h.max() }
+    };
+}
+
+//  a stand-in with the bench.* handlers; not started
+scio_beast::standin::ServerPtr makeServer(const BenchConfig& cfg) {
+    using namespace scio_beast::standin;
+
+    StandinOptions opts;
+    opts.codecEngine        = makeCodec(cfg.codec);
+    opts.perMessageDeflate  = cfg.deflate;
+
+    if(cfg.tls) {
+        opts.sslContext = selfSignedContext();
+    }
+
+    auto server = Server::create(opts);
+    Server* const s = server.get();
+
+    //  starts a server side publish stream: { channel, payload, rate, count }
+    server->on("bench.publish", [ s ](Call& call) {
+        s->startPublishStream(
+            call.data.value("channel", "bench"),
+            call.data.value("payload", json()),
+            call.data.value("rate", 0),
+            call.data.value("count", 0)
+        );
+        call.response = nullptr;
+    });
+
+    //  { interval } in ms; 0 stops pinging
+    server->on("bench.ping", [ s ](Call& call) {
+        s->setPingInterval(call.data.value("interval", 0));
+        call.response = nullptr;
+    });
+
+    //  minimal ack, so only the request carries the payload
+    server->on("bench.ack", [](Call& call) {
+        call.response = nullptr;
+    });
+
+    return server;
+}
+
+//
+//  --serve: run a stand-in until stdin closes, announcing its port on stdout
+//
+int serve(const Args& args) {
+    const BenchConfig cfg = {
+        arg(args, "codec", "json"), "on" == arg(args, "deflate", "off"), "on" == arg(args, "tls", "off"), 0, true, false
+    };
+
+    auto server = makeServer(cfg);
+
+    std::cout << server->start() << std::endl;
+
+    std::string line;
+    while(std::getline(std::cin, line)) {
+    }
+
+    server->stop();
+    return 0;
+}
+
+class ServerProcess
+    : private boost::noncopyable
+{
+public:
+    explicit ServerProcess(const BenchConfig& cfg)
+        : m_pid(-1)
+        , m_stdin(-1)
+    {
+        int in[2];
+        int out[2];
+        if(pipe(in) || pipe(out)) {
+            throw std::runtime_error("pipe failed");
+        }
+
+        const std::string codec     = "codec=" + cfg.codec;
+        const std::string deflate   = std::string("deflate=") + (cfg.deflate ? "on" : "off");
+        const std::string tls       = std::string("tls=") + (cfg.tls ? "on" : "off");
+
+        m_pid = fork();
+        if(0 == m_pid) {
+            dup2(in[0], STDIN_FILENO);
+            dup2(out[1], STDOUT_FILENO);
+            close(in[0]); close(in[1]); close(out[0]); close(out[1]);
+
+            execl("/proc/self/exe", "scio_bench", "--serve", codec.c_str(), deflate.c_str(), tls.c_str(), nullptr);
+            _exit(127);
+        }
+
+        close(in[0]);
+        close(out[1]);
+        m_stdin = in[1];
+
+        //  first line out is the port
+        char c;
+        while(read(out[0], &c, 1) == 1 && '\n' != c) {
+            m_port.push_back(c);
+        }
+        close(out[0]);
+
+        if(m_port.empty()) {
+            throw std::runtime_error("stand-in server failed to start");
+        }
+    }
+
+    ~ServerProcess() {
+        close(m_stdin);
+        waitpid(m_pid, nullptr, 0);
+    }
+
+    const std::string& getPort() const { return m_port; }
+
+private:
+    pid_t           m_pid;
+    int             m_stdin;
+    std::string     m_port;
+};
+
+//  a stuck run leaves handlers referencing the waiter's stack; bail out hard
+void waitOrDie(std::future<void>& f, const char* what) {
+    if(std::future_status::ready != f.wait_for(std::chrono::seconds(120))) {
+        std::cerr << "scio_bench: " << what << " timed out" << std::endl;
+        _exit(2);
+    }
+}
+
+//  |inProcess| is used with transport=memory
+scio_beast::SocketClusterClientOptions makeClientOptions(
+    const BenchConfig& cfg, const std::string& port, scio_beast::standin::ServerPtr inProcess = nullptr)
+{
+    scio_beast::SocketClusterClientOptions opts;
+
+    opts.connectOptions
+        .setHost("127.0.0.1")
+        .setPort(port)
+        .setAutoReconnect(false)
+        .setAckTimeout(120)
+        .setPerMessageDeflate(cfg.deflate)
+        .setCodecEngine(makeCodec(cfg.codec))
+        ;
+
+    scio_beast::TransportOptions transport;
+    transport.noDelay = cfg.noDelay;
+    opts.connectOptions.setTransportOptions(transport);
+
+    if(cfg.tls) {
+        opts.connectOptions.setSecure();
+        opts.connectOptions.secureOptions.context =
+            std::make_shared<boost::asio::ssl::context>(boost::asio::ssl::context::sslv23_client);
+    }
+
+    if(inProcess) {
+        opts.connectOptions.setTransport([ inProcess ]() { return inProcess->connectInMemory(); });
+    }
+
+    return opts;
+}
+
+class BenchClient
+    : private boost::noncopyable
+{
+public:
+    BenchClient(const BenchConfig& cfg, const std::string& port, scio_beast::standin::ServerPtr inProcess) {
+        const scio_beast::SocketClusterClientOptions opts = makeClientOptions(cfg, port, inProcess);
+
+        m_client = scio_beast::SocketClusterClient::create(opts);
+        m_socket = m_client->socket();
+
+        std::promise<void> connected;
+        auto conn = m_socket->on<scio_beast::SCSocket::ConnectEvent>([ &connected ](const json&) {
+            connected.set_value();
+        });
+
+        m_socket->connect();
+
+        std::future<void> f = connected.get_future();
+        waitOrDie(f, "connect");
+        conn.disconnect();
+    }
+
+    ~BenchClient() {
+        m_socket->disconnect();
+        m_client->shutdown();
+    }
+
+    scio_beast::SocketClusterClient::SCSocketPtr socket() { return m_socket; }
+
+private:
+    scio_beast::SocketClusterClient::SocketClusterClientPtr m_client;
+    scio_beast::SocketClusterClient::SCSocketPtr            m_socket;
+};
+
+//  server pushes |count| publishes as fast as it can; measures our receive rate
+json runPublish(BenchClient& bc, const BenchConfig& cfg, const uint64_t count) {
+    auto socket     = bc.socket();
+    auto channel    = socket->subscribe("bench");
+
+    while(scio_beast::ChannelState::SUBSCRIBED != channel->getState()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    std::atomic<uint64_t> received(0);
+    std::promise<void> done;
+
+    channel->watch([ &received, &done, count ](const json&) {
+        if(++received == count) {
+            done.set_value();
+        }
+    });
+
+    const json request = {
+        { "channel",    "bench" },
+        { "payload",    makePayload(cfg.size) },
+        { "rate",       0 },
+        { "count",      count }
+    };
+
+    Stopwatch sw;
+
+    socket->emit("bench.publish", request);
+
+    std::future<void> f = done.get_future();
+    waitOrDie(f, "publish");
+
+    const json result = rateJson(sw, received, cfg.size);
+
+    channel->unwatch();
+    channel->unsubscribe();
+
+    return result;
+}
+
+//  one emit in flight at a time; the first 10% warm up and are not recorded
+json runRtt(BenchClient& bc, const BenchConfig& cfg, const uint64_t samples) {
+    typedef std::chrono::steady_clock Clock;
+
+    auto socket             = bc.socket();
+    const json payload      = makePayload(cfg.size);
+    const uint64_t warmup   = samples / 10;
+
+    scio_beast::LatencyHistogram histogram;
+    uint64_t n = 0;
+    std::promise<void> done;
+
+    std::function<void()> next = [ & ]() {
+        const Clock::time_point sentAt = Clock::now();
+
+        socket->emit("bench.ack", payload, [ & , sentAt ](boost::system::error_code ec, const json&) {
+            if(!ec && n >= warmup) {
+                histogram.record(std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - sentAt).count());
+            }
+
+            if(++n == samples + warmup) {
+                done.set_value();
+            } else {
+                next();
+            }
+        });
+    };
+
+    next();
+
+    std::future<void> f = done.get_future();
+    waitOrDie(f, "rtt");
+
+    return { { "rttUs", histogramJson(histogram) } };
+}
+
+//  keeps |window| emits in flight until |count| are acked
+json runEmitRate(BenchClient& bc, const BenchConfig& cfg, const uint64_t count, const uint64_t window) {
+    auto socket         = bc.socket();
+    const json payload  = makePayload(cfg.size);
+
+    std::atomic<uint64_t> sent(0);
+    uint64_t acked  = 0;
+    uint64_t errors = 0;
+    std::promise<void> done;
+
+    std::function<void()> send = [ & ]() {
+        if(sent.fetch_add(1) >= count) {
+            return;
+        }
+
+        socket->emit("bench.ack", payload, [ & ](boost::system::error_code ec, const json&) {
+            if(ec) {
+                ++errors;
+            }
+
+            if(++acked == count) {
+                done.set_value();
+            } else {
+                send();
+            }
+        });
+    };
+
+    Stopwatch sw;
+
+    for(uint64_t i = 0; i < std::min(window, count); ++i) {
+        send();
+    }
+
+    std::future<void> f = done.get_future();
+    waitOrDie(f, "emit_rate");
+
+    json result = rateJson(sw, acked, cfg.size);
+    result["window"]    = window;
+    result["errors"]    = errors;
+    return result;
+}
+
+//  polls |pred| on this thread, which keeps the socket's own timings undisturbed
+template<typename Pred>
+void waitUntilOrDie(Pred pred, const char* what) {
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(120);
+    while(!pred()) {
+        if(std::chrono::steady_clock::now() > deadline) {
+            std::cerr << "scio_bench: " << what << " timed out" << std::endl;
+            _exit(2);
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+}
+
+//
+//  Connects and disconnects one socket |count| times, timing connect() to the
+//  ConnectEvent: TCP, TLS, WebSocket and SocketCluster handshakes. With TLS the
+//  socket gets its own TlsSessionCache, |sessionCache| deciding whether it resumes.
+//
+json runReconnect(const BenchConfig& cfg, const std::string& port, scio_beast::standin::ServerPtr inProcess,
+    const uint64_t count, const bool sessionCache)
+{
+    typedef std::chrono::steady_clock Clock;
+
+    scio_beast::SocketClusterClientOptions opts = makeClientOptions(cfg, port, inProcess);
+
+    std::shared_ptr<scio_beast::TlsSessionCache> cache;
+    if(cfg.tls) {
+        cache = std::make_shared<scio_beast::TlsSessionCache>();
+        cache->setEnabled(sessionCache);
+        opts.connectOptions.secureOptions.sessionCache = cache;
+    }
+
+    auto client = scio_beast::SocketClusterClient::create(opts);
+    auto socket = client->socket();
+
+    scio_beast::LatencyHistogram histogram;
+    Clock::time_point startedAt;
+    std::atomic<uint64_t> connects(0);
+    std::atomic<uint64_t> disconnects(0);
+
+    socket->on<scio_beast::SCSocket::ConnectEvent>([ & ](const json&) {
+        histogram.record(std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - startedAt).count());
+        ++connects;
+    });
+
+    socket->on<scio_beast::SCSocket::DisconnectEvent>([ & ](const boost::system::error_code&) {
+        ++disconnects;
+    });
+
+    Stopwatch sw;
+
+    for(uint64_t i = 0; i < count; ++i) {
+        startedAt = Clock::now();
+        socket->connect();
+
+        waitUntilOrDie([ & ]() { return connects > i; }, "reconnect");
+
+        socket->disconnect();
+        waitUntilOrDie([ & ]() { return disconnects > i; }, "disconnect");
+    }
+
+    const double seconds = sw.seconds();
+
+    json result = {
+        { "connects",       count },
+        { "seconds",        seconds },
+        { "cpuUsPerConnect", static_cast<double>(sw.cpuMicros()) / count },
+        { "handshakeUs",    histogramJson(histogram) }
+    };
+
+    if(cache) {
+        result["sessionCache"]  = sessionCache;
+        result["cacheHits"]     = cache->getHits();
+        result["cacheMisses"]   = cache->getMisses();
+    }
+
+    client->shutdown();
+
+    return result;
+}
+
+int report(const Args& args, const json& results);
+
+int bench(const Args& args) {
+    const std::vector<std::string> scenarios = split(arg(args, "scenarios", "publish,rtt,emit_rate"));
+    const uint64_t messages = argNumber(args, "messages", 20000);
+    const uint64_t samples  = argNumber(args, "samples", 2000);
+    const uint64_t window   = argNumber(args, "window", 256);
+    const uint64_t reconnects = argNumber(args, "reconnects", 200);
+    const std::vector<std::string> sessionCaches = split(arg(args, "session_cache", "on,off"));
+    const bool noDelay      = "on" == arg(args, "nodelay", "on");
+    const bool memory       = "memory" == arg(args, "transport", "tcp");
+
+    json results = json::array();
+
+    for(const auto& codec : split(arg(args, "codecs", "json,minbin"))) {
+    for(const auto& deflate : split(arg(args, "deflate", "off,on"))) {
+    for(const auto& tls : split(arg(args, "tls", "off,on"))) {
+    for(const auto& size : split(arg(args, "sizes", "64,1024,16384"))) {
+        const BenchConfig cfg = { codec, "on" == deflate, "on" == tls, std::stoul(size), noDelay, memory };
+
+        //  messages are handed over whole; there is no stream to compress or encrypt
+        if(cfg.memory && (cfg.deflate || cfg.tls)) {
+            continue;
+        }
+
+        //  keep large payload runs to a sane amount of traffic
+        const uint64_t count = std::min<uint64_t>(messages, std::max<uint64_t>(1000, (256 << 20) / cfg.size));
+
+        std::unique_ptr<ServerProcess> process;
+        scio_beast::standin::ServerPtr inProcess;
+        std::string port;
+
+        if(cfg.memory) {
+            inProcess = makeServer(cfg);
+            inProcess->start();
+        } else {
+            process.reset(new ServerProcess(cfg));
+            port = process->getPort();
+        }
+
+        for(const auto& scenario : scenarios) {
+            std::cerr << scenario << " " << configJson(cfg).dump() << std::endl;
+
+            if("reconnect" == scenario) {
+                //  without TLS there is no session to resume; one run will do
+                for(const auto& sessionCache : cfg.tls ? sessionCaches : std::vector<std::string>(1, "off")) {
+                    json result = runReconnect(cfg, port, inProcess, reconnects, "on" == sessionCache);
+                    result["scenario"]  = scenario;
+                    result["config"]    = configJson(cfg);
+                    results.push_back(result);
+                }
+                continue;
+            }
+
+            json result;
+            {
+                BenchClient client(cfg, port, inProcess);
+
+                if("publish" == scenario) {
+                    result = runPublish(client, cfg, count);
+                } else if("rtt" == scenario) {
+                    result = runRtt(client, cfg, samples);
+                } else if("emit_rate" == scenario) {
+                    result = runEmitRate(client, cfg, count, window);
+                } else {
+                    std::cerr << "unknown scenario " << scenario << std::endl;
+                    continue;
+                }
+            }
+
+            result["scenario"]  = scenario;
+            result["config"]    = configJson(cfg);
+            results.push_back(result);
+        }
+    }}}}
+
+    return report(args, results);
+}
+
+//  CPU used over a phase, overall and per socket-second
+json phaseJson(const Stopwatch& sw, const uint64_t sockets) {
+    const double seconds    = sw.seconds();
+    const uint64_t cpu      = sw.cpuMicros();
+
+    return {
+        { "seconds",                seconds },
+        { "cpuPercent",             cpu / (seconds * 10000) },
+        { "cpuUsPerSocketSecond",   cpu / seconds / sockets }
+    };
+}
+
+//
+//  Cost of |n| sockets, each with its own io_service, thread, buffers and timers:
+//  RSS and threads once all are connected and subscribed, then CPU while idle,
+//  while the server pings and with a light publish load fanned out to all of them.
+//
+json runScale(const BenchConfig& cfg, const uint64_t n, const Args& args) {
+    const uint64_t phaseSeconds = argNumber(args, "phase_seconds", 5);
+    const uint64_t pingInterval = argNumber(args, "ping_interval", 1000);
+    const uint64_t publishRate  = argNumber(args, "publish_rate", 1);
+
+    ServerProcess server(cfg);
+
+    scio_beast::SocketClusterClientOptions opts = makeClientOptions(cfg, server.getPort());
+    opts.connectAdmission.maxInFlight = argNumber(args, "connect_window", 256);
+
+    const uint64_t rssBefore        = rssBytes();
+    const uint64_t threadsBefore    = threadCount();
+
+    auto client = scio_beast::SocketClusterClient::create(opts);
+
+    std::vector<scio_beast::SocketClusterClient::SCSocketPtr> sockets;
+    std::vector<scio_beast::SCChannelPtr> channels;
+    std::atomic<uint64_t> connected(0);
+    std::atomic<uint64_t> delivered(0);
+    std::string error;
+
+    sockets.reserve(n);
+    channels.reserve(n);
+
+    Stopwatch connectSw;
+
+    for(uint64_t i = 0; i < n; ++i) {
+        auto socket = client->socket();
+
+        socket->on<scio_beast::SCSocket::ConnectEvent>([ &connected ](const json&) {
+            ++connected;
+        });
+
+        auto channel = socket->subscribe("scale");
+        channel->watch([ &delivered ](const json&) {
+            ++delivered;
+        });
+
+        try {
+            socket->connect();
+        } catch(const std::exception& e) {
+            error = e.what();   //  typically out of threads or address space
+            break;
+        }
+
+        sockets.push_back(socket);
+        channels.push_back(channel);
+    }
+
+    const auto subscribed = [ &channels ]() {
+        for(const auto& channel : channels) {
+            if(scio_beast::ChannelState::SUBSCRIBED != channel->getState()) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(300);
+    while(connected < sockets.size() || !subscribed()) {
+        if(std::chrono::steady_clock::now() > deadline) {
+            error = "timed out connecting";
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+
+    const double connectSeconds = connectSw.seconds();
+    const uint64_t count        = connected;
+
+    json result = {
+        { "sockets",            n },
+        { "connected",          count },
+        { "connectSeconds",     connectSeconds },
+        { "rssBytes",           rssBytes() },
+        { "rssBytesPerSocket",  count ? (rssBytes() - rssBefore) / count : 0 },
+        { "threads",            threadCount() },
+        { "threadsPerSocket",   count ? static_cast<double>(threadCount() - threadsBefore) / count : 0 }
+    };
+
+    if(!error.empty()) {
+        result["error"] = error;
+    }
+
+    if(count) {
+        auto control = sockets.front();
+
+        {
+            Stopwatch sw;
+            std::this_thread::sleep_for(std::chrono::seconds(phaseSeconds));
+            result["idle"] = phaseJson(sw, count);
+        }
+
+        control->emit("bench.ping", json({ { "interval", pingInterval } }));
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        {
+            const uint64_t pingsBefore = client->snapshot().pings;
+
+            Stopwatch sw;
+            std::this_thread::sleep_for(std::chrono::seconds(phaseSeconds));
+
+            json phase = phaseJson(sw, count);
+            phase["pings"] = client->snapshot().pings - pingsBefore;
+            result["ping"] = phase;
+        }
+
+        {
+            const json request = {
+                { "channel",    "scale" },
+                { "payload",    makePayload(64) },
+                { "rate",       publishRate },
+                { "count",      publishRate * phaseSeconds }
+            };
+
+            const uint64_t deliveredBefore = delivered;
+
+            Stopwatch sw;
+            control->emit("bench.publish", request);
+            std::this_thread::sleep_for(std::chrono::seconds(phaseSeconds));
+
+            const uint64_t messages = delivered - deliveredBefore;
+
+            json phase = phaseJson(sw, count);
+            phase["delivered"]      = messages;
+            phase["cpuUsPerMessage"] = messages ? static_cast<double>(sw.cpuMicros()) / messages : 0;
+            result["publish"] = phase;
+        }
+    }
+
+    client->shutdown();
+
+    return result;
+}
+
+int scale(const Args& args) {
+    const BenchConfig cfg = {
+        split(arg(args, "codecs", "json")).front(),
+        "on" == split(arg(args, "deflate", "off")).front(),
+        "on" == split(arg(args, "tls", "off")).front(),
+        64,
+        "on" == arg(args, "nodelay", "on"),
+        false   //  socket cost includes its descriptors; always over TCP
+    };
+
+    json results = json::array();
+
+    for(const auto& n : split(arg(args, "sockets", "1000,10000"))) {
+        std::cerr << "scale " << n << " " << configJson(cfg).dump() << std::endl;
+
+        json result = runScale(cfg, std::stoull(n), args);
+        result["scenario"]  = "scale";
+        result["config"]    = configJson(cfg);
+        results.push_back(result);
+    }
+
+    return report(args, results);
+}
+
+int report(const Args& args, const json& results) {
+    json argsJson = json::object();
+    for(const auto& a : args) {
+        argsJson[a.first] = a.second;
+    }
+
+    const json report = {
+        { "benchmark",  "scio_bench" },
+        { "compiler",   __VERSION__ },
+        { "timestamp",  std::chrono::duration_cast<std::chrono::seconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count() },
+        { "args",       argsJson },
+        { "results",    results }
+    };
+
+    std::cout << report.dump(2) << std::endl;
+    return 0;
+}
+
+}   //  end anon ns
+
+int main(int argc, char** argv) {
+    bool serveMode = false;
+    Args args;
+
+    for(int i = 1; i < argc; ++i) {
+        const std::string a = argv[i];
+
+        if("--serve" == a) {
+            serveMode = true;
+            continue;
+        }
+
+        const size_t eq = a.find('=');
+        if(std::string::npos == eq) {
+            std::cerr << "usage: " << argv[0] << " [name=value ...]" << std::endl;
+            return 1;
+        }
+
+        args[a.substr(0, eq)] = a.substr(eq + 1);
+    }
+
+    raiseFileLimit();
+
+    try {
+        if(serveMode) {
+            return serve(args);
+        }
+        return "scale" == arg(args, "mode", "sweep") ? scale(args) : bench(args);
+    } catch(const std::exception& e) {
+        std::cerr << "scio_bench: " << e.what() << std::endl;
+        return 1;
+    }
+}
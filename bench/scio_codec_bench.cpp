@@ -0,0 +1,291 @@
+//
+//  scio_codec_bench: encode & decode cost of each ICodecEngine over a corpus of
+//  SocketCluster packets. Reports ns/op, heap allocations per op (counted by the
+//  operator new replacement below) and encoded size.
+//
+//  Usage: scio_codec_bench [codecs=json,minbin] [min_ms=200] > codecs.json
+//
+//  To measure your own codec, add it to makeCodecs().
+//
+
+//  STL
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+
+//  scio_beast
+#include "../src/scio_beast.hpp"
+
+using json = nlohmann::json;
+
+namespace {
+    std::atomic<uint64_t> g_allocations(0);
+    std::atomic<uint64_t> g_allocatedBytes(0);
+
+    void* countedAlloc(const std::size_t size) {
+        g_allocations.fetch_add(1, std::memory_order_relaxed);
+        g_allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+
+        return std::malloc(size ? size : 1);
+    }
+
+    //  out of line so GCC doesn't pair the inlined free() with operator new and warn
+    __attribute__((noinline)) void countedFree(void* p) {
+        std::free(p);
+    }
+}
+
+//
+//  Replacing the global allocation functions counts every heap allocation in the
+//  program; the benchmark only looks at the deltas around its own loops.
+//
+void* operator new(std::size_t size) {
+    if(void* p = countedAlloc(size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+    if(void* p = countedAlloc(size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    return countedAlloc(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    return countedAlloc(size);
+}
+
+void operator delete(void* p) noexcept { countedFree(p); }
+void operator delete[](void* p) noexcept { countedFree(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { countedFree(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { countedFree(p); }
+
+namespace {
+
+typedef std::map<std::string, std::shared_ptr<scio_beast::ICodecEngine>> Codecs;
+
+Codecs makeCodecs() {
+    Codecs codecs;
+    codecs["json"]      = std::make_shared<scio_beast::CodecEngineJson>();
+    codecs["minbin"]    = std::make_shared<scio_beast::CodecEngineMinBin>();
+    return codecs;
+}
+
+struct Packet {
+    std::string     name;
+    json            packet;
+};
+
+json chatMessage(const int i) {
+    return {
+        { "user",       "user" + std::to_string(i) },
+        { "text",       "the quick brown fox jumps over the lazy dog" },
+        { "ts",         1500000000000LL + i },
+        { "mentions",   { "alice", "bob" } }
+    };
+}
+
+json publishPacket(const std::string& channel, const json& data) {
+    return {
+        { "event",  "#publish" },
+        { "data",   {
+            { "channel",    channel },
+            { "data",       data }
+        }}
+    };
+}
+
+std::vector<Packet> makeCorpus() {
+    std::vector<Packet> corpus;
+
+    corpus.push_back( { "emit_small", {
+        { "event",  "chat" },
+        { "data",   chatMessage(1) },
+        { "cid",    42 }
+    }});
+
+    corpus.push_back( { "emit_no_ack", {
+        { "event",  "typing" },
+        { "data",   { { "user", "user1" } } }
+    }});
+
+    corpus.push_back( { "publish_small", publishPacket("room:lobby", chatMessage(2)) });
+
+    corpus.push_back( { "ack", {
+        { "rid",    42 },
+        { "data",   { { "ok", true }, { "id", 12345 } } }
+    }});
+
+    corpus.push_back( { "ack_error", {
+        { "rid",    43 },
+        { "error",  { { "name", "BadRequest" }, { "message", "missing field 'user'" } } }
+    }});
+
+    corpus.push_back( { "handshake_response", {
+        { "rid",    1 },
+        { "data",   {
+            { "id",                 "Xb3kE9s_1k2lA0AAAAAB" },
+            { "pingTimeout",        20000 },
+            { "isAuthenticated",    false }
+        }}
+    }});
+
+    json batch = json::array();
+    for(int i = 0; i < 16; ++i) {
+        batch.push_back(publishPacket("room:lobby", chatMessage(i)));
+    }
+    corpus.push_back( { "publish_batch_16", batch });
+
+    json rows = json::array();
+    for(int i = 0; i < 500; ++i) {
+        rows.push_back({
+            { "symbol", "SYM" + std::to_string(i) },
+            { "bid",    100.0 + i / 8.0 },
+            { "ask",    100.5 + i / 8.0 },
+            { "volume", 1000 * i }
+        });
+    }
+    corpus.push_back( { "publish_large_object", publishPacket("quotes", { { "rows", rows } }) });
+
+    corpus.push_back( { "publish_large_string", publishPacket("blobs", { { "blob", std::string(64 * 1024, 'x') } }) });
+
+    return corpus;
+}
+
+struct Measurement {
+    double      nsPerOp;
+    double      allocsPerOp;
+    double      allocBytesPerOp;
+    uint64_t    iterations;
+};
+
+//  runs |op| in doubling batches until a batch takes at least |minMs|
+template<typename Op>
+Measurement measure(Op op, const uint64_t minMs) {
+    //  warm up, and let the allocator settle
+    op();
+
+    uint64_t iterations = 1;
+    for(;;) {
+        const uint64_t allocsBefore = g_allocations.load(std::memory_order_relaxed);
+        const uint64_t bytesBefore  = g_allocatedBytes.load(std::memory_order_relaxed);
+        const auto start            = std::chrono::steady_clock::now();
+
+        for(uint64_t i = 0; i < iterations; ++i) {
+            op();
+        }
+
+        const auto elapsed = std::chrono::steady_clock::now() - start;
+
+        if(elapsed >= std::chrono::milliseconds(minMs) || iterations >= (uint64_t(1) << 30)) {
+            const Measurement m = {
+                std::chrono::duration<double, std::nano>(elapsed).count() / iterations,
+                static_cast<double>(g_allocations.load(std::memory_order_relaxed) - allocsBefore) / iterations,
+                static_cast<double>(g_allocatedBytes.load(std::memory_order_relaxed) - bytesBefore) / iterations,
+                iterations
+            };
+            return m;
+        }
+
+        iterations *= 2;
+    }
+}
+
+json measurementJson(const Measurement& m) {
+    return {
+        { "nsPerOp",            m.nsPerOp },
+        { "allocsPerOp",        m.allocsPerOp },
+        { "allocBytesPerOp",    m.allocBytesPerOp },
+        { "iterations",         m.iterations }
+    };
+}
+
+std::string arg(const std::map<std::string, std::string>& args, const std::string& name, const std::string& def) {
+    const auto it = args.find(name);
+    return args.end() == it ? def : it->second;
+}
+
+}   //  end anon ns
+
+int main(int argc, char** argv) {
+    std::map<std::string, std::string> args;
+
+    for(int i = 1; i < argc; ++i) {
+        const std::string a = argv[i];
+        const size_t eq     = a.find('=');
+
+        if(std::string::npos == eq) {
+            std::cerr << "usage: " << argv[0] << " [codecs=json,minbin] [min_ms=200]" << std::endl;
+            return 1;
+        }
+
+        args[a.substr(0, eq)] = a.substr(eq + 1);
+    }
+
+    const uint64_t minMs = std::stoull(arg(args, "min_ms", "200"));
+
+    std::vector<std::string> selected;
+    boost::split(selected, arg(args, "codecs", "json,minbin"), boost::is_any_of(","));
+
+    const Codecs codecs             = makeCodecs();
+    const std::vector<Packet> corpus = makeCorpus();
+
+    volatile size_t sink = 0;   //  keeps results observable so the loops aren't optimized away
+
+    json results = json::array();
+
+    for(const auto& name : selected) {
+        const auto codec = codecs.find(name);
+        if(codecs.end() == codec) {
+            std::cerr << "unknown codec " << name << std::endl;
+            return 1;
+        }
+
+        scio_beast::ICodecEngine& engine = *codec->second;
+
+        for(const auto& p : corpus) {
+            std::cerr << name << " " << p.name << std::endl;
+
+            const std::string encoded = engine.encode(p.packet);
+
+            //  a codec that loses information is not worth timing
+            const bool roundTrips = engine.decode(encoded) == p.packet;
+
+            const Measurement enc = measure([ & ]() {
+                sink += engine.encode(p.packet).size();
+            }, minMs);
+
+            const Measurement dec = measure([ & ]() {
+                sink += engine.decode(encoded).size();
+            }, minMs);
+
+            results.push_back({
+                { "codec",          name },
+                { "packet",         p.name },
+                { "inputBytes",     p.packet.dump().size() },
+                { "encodedBytes",   encoded.size() },
+                { "roundTrips",     roundTrips },
+                { "encode",         measurementJson(enc) },
+                { "decode",         measurementJson(dec) }
+            });
+        }
+    }
+
+    const json report = {
+        { "benchmark",  "scio_codec_bench" },
+        { "compiler",   __VERSION__ },
+        { "timestamp",  std::chrono::duration_cast<std::chrono::seconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count() },
+        { "results",    results }
+    };
+
+    std::cout << report.dump(2) << std::endl;
+    return 0;
+}
@@ -0,0 +1,182 @@
+//
+//  scio_replay: feeds a wire capture (ConnectOptions::setWireCapture) back through
+//  SCSocket's decode & dispatch path with no network, to reproduce a production
+//  load profile locally or to time handler pipelines on real traffic.
+//
+//  Usage: scio_replay capture=PATH [name=value ...] > replay.json
+//
+//      codec       json            or minbin; must match the capture
+//      speed       0               0 = as fast as possible, 1 = recorded pace, 2 = twice that...
+//      repeat      1               passes over the capture
+//      handler_us  0               busy work per publish, to model a handler's cost
+//
+//  Every channel published to in the capture is subscribed first, so publishes
+//  reach a watcher as they did live.
+//
+
+//  STL
+#include <iostream>
+
+//  scio_beast
+#include "../src/scio_beast.hpp"
+
+using json = nlohmann::json;
+
+namespace {
+
+typedef std::map<std::string, std::string> Args;
+
+std::string arg(const Args& args, const std::string& name, const std::string& def) {
+    const auto it = args.find(name);
+    return args.end() == it ? def : it->second;
+}
+
+std::shared_ptr<scio_beast::ICodecEngine> makeCodec(const std::string& name) {
+    if("minbin" == name) {
+        return std::make_shared<scio_beast::CodecEngineMinBin>();
+    }
+    return std::make_shared<scio_beast::CodecEngineJson>();
+}
+
+void collectChannels(const json& packet, std::set<std::string>& channels) {
+    if(packet.is_array()) {
+        for(const auto& p : packet) {
+            collectChannels(p, channels);
+        }
+        return;
+    }
+
+    if(packet.is_object() && "#publish" == packet.value("event", "")) {
+        const auto data = packet.find("data");
+        if(packet.end() != data && data->is_object() && data->count("channel")) {
+            channels.insert(data->at("channel").get<std::string>());
+        }
+    }
+}
+
+void spin(const std::chrono::microseconds d) {
+    const auto until = std::chrono::steady_clock::now() + d;
+    while(std::chrono::steady_clock::now() < until) {
+    }
+}
+
+}   //  end anon ns
+
+int main(int argc, char** argv) {
+    Args args;
+
+    for(int i = 1; i < argc; ++i) {
+        const std::string a = argv[i];
+        const size_t eq     = a.find('=');
+
+        if(std::string::npos == eq) {
+            std::cerr << "usage: " << argv[0] << " capture=PATH [codec=json] [speed=0] [repeat=1] [handler_us=0]" << std::endl;
+            return 1;
+        }
+
+        args[a.substr(0, eq)] = a.substr(eq + 1);
+    }
+
+    const std::string path                  = arg(args, "capture", "");
+    const std::string codecName             = arg(args, "codec", "json");
+    const double speed                      = std::stod(arg(args, "speed", "0"));
+    const uint64_t repeat                   = std::stoull(arg(args, "repeat", "1"));
+    const std::chrono::microseconds work(std::stoull(arg(args, "handler_us", "0")));
+
+    const auto codec = makeCodec(codecName);
+
+    std::set<std::string> channels;
+    uint64_t outbound = 0;
+    {
+        scio_beast::WireCapture capture;
+        if(!capture.open(path)) {
+            std::cerr << "cannot open capture " << path << std::endl;
+            return 1;
+        }
+
+        size_t offset = 0;
+        scio_beast::WireCapture::Frame frame;
+
+        while(capture.next(offset, frame)) {
+            if(scio_beast::WireCapture::Direction::OUTBOUND == frame.direction) {
+                ++outbound;
+                continue;
+            }
+
+            try {
+                collectChannels(codec->decode(std::string(frame.data, frame.size)), channels);
+            } catch(const std::exception&) {
+                //  pings and the like; the socket handles them itself
+            }
+        }
+    }
+
+    scio_beast::SocketClusterClientOptions clientOpts;
+    clientOpts.connectOptions.setCodecEngine("json" == codecName ? nullptr : codec);
+
+    auto client = scio_beast::SocketClusterClient::create(clientOpts);
+    auto socket = client->socket();
+
+    uint64_t publishes = 0;
+    for(const auto& name : channels) {
+        socket->subscribe(name)->watch([ &publishes, work ](const json&) {
+            ++publishes;
+            if(work.count()) {
+                spin(work);
+            }
+        });
+    }
+
+    json passes = json::array();
+
+    for(uint64_t i = 0; i < repeat; ++i) {
+        scio_beast::ReplayStats stats;
+
+        scio_beast::ReplayOptions opts;
+        opts.speed = speed;
+
+        const boost::system::error_code ec = socket->replay(path, stats, opts);
+        if(ec) {
+            std::cerr << "replay failed: " << ec.message() << std::endl;
+            return 1;
+        }
+
+        const double seconds = std::chrono::duration<double>(stats.elapsed).count();
+
+        passes.push_back({
+            { "messages",       stats.messages },
+            { "bytes",          stats.bytes },
+            { "seconds",        seconds },
+            { "messagesPerSec", seconds > 0 ? stats.messages / seconds : 0 },
+            { "nsPerMessage",   stats.messages ? stats.elapsed.count() / static_cast<double>(stats.messages) : 0 }
+        });
+
+        std::cerr << "pass " << i << ": " << stats.messages << " messages in " << seconds << "s" << std::endl;
+    }
+
+    const scio_beast::SocketMetrics m = socket->snapshot();
+
+    const json report = {
+        { "benchmark",  "scio_replay" },
+        { "capture",    path },
+        { "codec",      codecName },
+        { "speed",      speed },
+        { "handlerUs",  work.count() },
+        { "channels",   channels.size() },
+        { "recordedOutbound", outbound },
+        { "publishesDelivered", publishes },
+        { "socket", {
+            { "messagesIn",     m.messagesIn },
+            { "publishesIn",    m.publishesIn },
+            { "eventsIn",       m.eventsIn },
+            { "acksIn",         m.acksIn },
+            { "decodeErrors",   m.decodeErrors },
+            { "messagesOut",    m.messagesOut },
+            { "slowHandlers",   m.slowHandlers }
+        }},
+        { "passes",     passes }
+    };
+
+    std::cout << report.dump(2) << std::endl;
+    return 0;
+}
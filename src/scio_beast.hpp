@@ -29,9 +29,21 @@
 #pragma once
 
 //  STL
+#include <algorithm>
+#include <atomic>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <limits>
+#include <map>
 #include <memory>
 #include <queue>
 #include <random>
+#include <set>
+#include <vector>
 
 //  Boost
 #include <boost/beast/core.hpp>
@@ -40,6 +52,9 @@
 #include <boost/asio/connect.hpp>
 #include <boost/asio/ip/tcp.hpp>
 #include <boost/asio/ssl/stream.hpp>
+#include <boost/asio/ssl/rfc2818_verification.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
 #include <boost/thread.hpp>
 #include <boost/unordered_map.hpp>
 #include <boost/signals2.hpp>
@@ -47,6 +62,12 @@
 #include <boost/archive/iterators/binary_from_base64.hpp>
 #include <boost/archive/iterators/transform_width.hpp>
 
+#if defined(__linux__)
+//  POSIX
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#endif
 
 //  json
 #include <json.hpp>
@@ -64,6 +85,12 @@ enum errors {
     json_parse_failure,
     response_error,
     ack_timeout,
+    message_too_big,
+    disconnected,
+    spool_unavailable,
+    spool_full,
+    capture_unavailable,
+    inbox_mismatch,
 };
 
 namespace detail {
@@ -79,6 +106,12 @@ namespace detail {
                 case json_parse_failure : return "json parse failure";
                 case response_error     : return "response contains error";
                 case ack_timeout        : return "acknowledgement timeout";
+                case message_too_big    : return "message exceeds maxMessageSize";
+                case disconnected       : return "connection closed before a response arrived";
+                case spool_unavailable  : return "offline spool could not be opened";
+                case spool_full         : return "offline spool full; message dropped";
+                case capture_unavailable: return "wire capture could not be opened";
+                case inbox_mismatch     : return "channel already exists with a different inbox";
                 default                 : return "scio_beast::category error";
             }
         }
@@ -109,7 +142,335 @@ namespace scio_beast {
 
     namespace detail {
         static const std::string EMPTY_STRING;
+
+        //  one generator shared by every socket rather than seeding one per reconnect; returns [0, 1)
+        inline double sharedRandom() {
+            static boost::mutex         lock;
+            static std::mt19937         gen(std::random_device{}());
+            std::uniform_real_distribution<> dis(0, 1);
+
+            boost::lock_guard<boost::mutex> guard(lock);
+            return dis(gen);
+        }
+
+        inline size_t roundUpPow2(size_t n) {
+            size_t p = 1;
+            while(p < n) {
+                p <<= 1;
+            }
+            return p;
+        }
+
+        //
+        //  A SettableSocketOption for the int valued options asio has no type for,
+        //  e.g. TCP_KEEPIDLE; setsockopt() takes flags such as TCP_QUICKACK as ints too.
+        //
+        template <int Level, int Name>
+        class IntegerSocketOption {
+        public:
+            explicit IntegerSocketOption(const int value) : m_value(value) {}
+
+            template <typename Protocol> int level(const Protocol&) const { return Level; }
+            template <typename Protocol> int name(const Protocol&) const { return Name; }
+            template <typename Protocol> const int* data(const Protocol&) const { return &m_value; }
+            template <typename Protocol> size_t size(const Protocol&) const { return sizeof(m_value); }
+
+        private:
+            int     m_value;
+        };
+
+        //
+        //  Bounded lock-free single producer / single consumer ring. The producer
+        //  is always a socket's io thread while the consumer is whatever thread
+        //  calls drain(). Capacity is rounded up to a power of two.
+        //
+        //  The indices are kept a cache line apart by padding rather than alignas():
+        //  plain new does not honour over-alignment before C++17.
+        //
+        template <typename T>
+        class SpscRing {
+        public:
+            explicit SpscRing(const size_t capacity)
+                : m_mask(roundUpPow2(capacity ? capacity : 1) - 1)
+                , m_slots(m_mask + 1)
+                , m_head(0)
+                , m_tail(0)
+                , m_headCache(0)
+            {
+            }
+
+            size_t capacity() const { return m_slots.size(); }
+
+            size_t size() const {
+                return m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire);
+            }
+
+            //  producer only; |item| is left untouched if the ring is full
+            bool tryPush(T&& item) {
+                const size_t tail = m_tail.load(std::memory_order_relaxed);
+
+                if(tail - m_headCache == m_slots.size()) {
+                    m_headCache = m_head.load(std::memory_order_acquire);
+                    if(tail - m_headCache == m_slots.size()) {
+                        return false;
+                    }
+                }
+
+                m_slots[tail & m_mask] = std::move(item);
+                m_tail.store(tail + 1, std::memory_order_release);
+                return true;
+            }
+
+            //  consumer only; appends up to |maxN| items to |out|
+            size_t popBatch(std::vector<T>& out, const size_t maxN) {
+                const size_t head   = m_head.load(std::memory_order_relaxed);
+                const size_t avail  = m_tail.load(std::memory_order_acquire) - head;
+                const size_t n      = std::min(avail, maxN);
+
+                for(size_t i = 0; i < n; ++i) {
+                    out.push_back(std::move(m_slots[(head + i) & m_mask]));
+                }
+
+                m_head.store(head + n, std::memory_order_release);
+                return n;
+            }
+
+        private:
+            static const size_t CACHE_LINE = 64;
+
+            const size_t                m_mask;
+            std::vector<T>              m_slots;
+            char                        m_pad0[CACHE_LINE];
+            std::atomic<size_t>         m_head;         //  consumer owned
+            char                        m_pad1[CACHE_LINE];
+            std::atomic<size_t>         m_tail;         //  producer owned
+            size_t                      m_headCache;    //  producer's last view of m_head
+            char                        m_pad2[CACHE_LINE];
+        };
+
+        class ReadSizePolicy {
+        public:
+            ReadSizePolicy(const size_t initialSize, const size_t maxSize, const bool adaptive)
+                : m_min(initialSize)
+                , m_max(std::max(initialSize, maxSize))
+                , m_adaptive(adaptive)
+                , m_average(static_cast<double>(initialSize))
+                , m_current(initialSize)
+            {
+            }
+
+            size_t next() const { return m_current; }
+
+            //  the current message needs more reads; grow to cut down on syscalls
+            void partialRead() {
+                if(m_adaptive) {
+                    m_current = std::min(m_current * 2, m_max);
+                }
+            }
+
+            void messageComplete(const size_t size) {
+                if(!m_adaptive) {
+                    return;
+                }
+
+                m_average += (static_cast<double>(size) - m_average) / 8;
+
+                const size_t target = roundUpPow2(static_cast<size_t>(m_average));
+                m_current = std::max(m_min, std::min(target, m_max));
+            }
+
+        private:
+            size_t      m_min;
+            size_t      m_max;
+            bool        m_adaptive;
+            double      m_average;
+            size_t      m_current;
+        };
     }   //  end detail ns
+
+//
+//  Pipeline tracing. Define SCIO_BEAST_ENABLE_TRACING to record a timestamped
+//  event at each stage of a message's life into a lock-free ring owned by the
+//  recording thread; otherwise SCIO_BEAST_TRACE() expands to nothing. A collector
+//  thread periodically calls trace::collect() and e.g. trace::writeChromeTrace().
+//
+#ifdef SCIO_BEAST_ENABLE_TRACING
+
+#ifndef SCIO_BEAST_TRACE_RING_CAPACITY
+#define SCIO_BEAST_TRACE_RING_CAPACITY 65536
+#endif
+
+    namespace trace {
+        enum class Stage : uint8_t {
+            READ_COMPLETE,      //  a read finished; id is the inbound message number
+            MESSAGE_COMPLETE,
+            DECODE_DONE,
+            DISPATCH_BEGIN,
+            DISPATCH_END,
+            ENQUEUE,            //  id is the outbound sequence number, given when queued
+            ENCODE_DONE,        //  same id as the ENQUEUE; pongs skip this stage
+            WRITE_BEGIN,
+            WRITE_COMPLETE,
+        };
+
+        inline const char* stageName(const Stage stage) {
+            switch(stage) {
+                case Stage::READ_COMPLETE       : return "read_complete";
+                case Stage::MESSAGE_COMPLETE    : return "message_complete";
+                case Stage::DECODE_DONE         : return "decode_done";
+                case Stage::DISPATCH_BEGIN      : return "dispatch_begin";
+                case Stage::DISPATCH_END        : return "dispatch_end";
+                case Stage::ENQUEUE             : return "enqueue";
+                case Stage::ENCODE_DONE         : return "encode_done";
+                case Stage::WRITE_BEGIN         : return "write_begin";
+                case Stage::WRITE_COMPLETE      : return "write_complete";
+                default                         : return "unknown";
+            }
+        }
+
+        struct Event {
+            uint64_t        timestampNs;    //  steady clock
+            uintptr_t       socket;
+            uint64_t        id;
+            Stage           stage;
+        };
+
+        struct CollectedEvent {
+            Event           event;
+            size_t          thread;         //  registration order of the recording thread
+        };
+
+        class Registry
+            : private boost::noncopyable
+        {
+        public:
+            struct ThreadBuffer {
+                explicit ThreadBuffer(const size_t idx)
+                    : index(idx)
+                    , ring(SCIO_BEAST_TRACE_RING_CAPACITY)
+                    , dropped(0)
+                {
+                }
+
+                size_t                      index;
+                detail::SpscRing<Event>     ring;
+                std::atomic<uint64_t>       dropped;    //  events lost to a full ring
+            };
+
+            static Registry& instance() {
+                static Registry registry;
+                return registry;
+            }
+
+            //  the calling thread's buffer; kept alive by the registry after the thread exits
+            ThreadBuffer& local() {
+                thread_local std::shared_ptr<ThreadBuffer> buffer = add();
+                return *buffer;
+            }
+
+            size_t collect(std::vector<CollectedEvent>& out) {
+                std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+                {
+                    boost::lock_guard<boost::mutex> lock(m_lock);
+                    buffers = m_buffers;
+                }
+
+                //  single consumer: collect() must not run concurrently with itself
+                size_t n = 0;
+                std::vector<Event> events;
+                for(const auto& buffer : buffers) {
+                    events.clear();
+                    buffer->ring.popBatch(events, buffer->ring.capacity());
+
+                    for(const auto& e : events) {
+                        const CollectedEvent collected = { e, buffer->index };
+                        out.push_back(collected);
+                    }
+                    n += events.size();
+                }
+
+                return n;
+            }
+
+            uint64_t dropped() const {
+                boost::lock_guard<boost::mutex> lock(m_lock);
+
+                uint64_t total = 0;
+                for(const auto& buffer : m_buffers) {
+                    total += buffer->dropped.load(std::memory_order_relaxed);
+                }
+                return total;
+            }
+
+        private:
+            std::shared_ptr<ThreadBuffer> add() {
+                boost::lock_guard<boost::mutex> lock(m_lock);
+
+                m_buffers.push_back(std::make_shared<ThreadBuffer>(m_buffers.size()));
+                return m_buffers.back();
+            }
+
+            mutable boost::mutex                        m_lock;
+            std::vector<std::shared_ptr<ThreadBuffer>>  m_buffers;
+        };
+
+        inline void record(const Stage stage, const void* socket, const uint64_t id) {
+            Event e = {
+                static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch()).count()),
+                reinterpret_cast<uintptr_t>(socket),
+                id,
+                stage
+            };
+
+            Registry::ThreadBuffer& buffer = Registry::instance().local();
+            if(!buffer.ring.tryPush(std::move(e))) {
+                buffer.dropped.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+
+        //  appends everything recorded since the last call to |out|, grouped by thread
+        inline size_t collect(std::vector<CollectedEvent>& out) {
+            return Registry::instance().collect(out);
+        }
+
+        inline uint64_t dropped() {
+            return Registry::instance().dropped();
+        }
+
+        //  Chrome trace event format; load in chrome://tracing or Perfetto
+        inline void writeChromeTrace(std::ostream& os, const std::vector<CollectedEvent>& events) {
+            json traceEvents = json::array();
+
+            for(const auto& collected : events) {
+                const Event& e = collected.event;
+
+                traceEvents.push_back({
+                    { "name",   stageName(e.stage) },
+                    { "ph",     "i" },
+                    { "s",      "t" },
+                    { "ts",     e.timestampNs / 1000.0 },   //  microseconds
+                    { "pid",    1 },
+                    { "tid",    collected.thread },
+                    { "args",   {
+                        { "socket", e.socket },
+                        { "id",     e.id }
+                    }}
+                });
+            }
+
+            os << json({ { "traceEvents", traceEvents } }).dump();
+        }
+    }   //  end trace ns
+
+#define SCIO_BEAST_TRACE(stage, socket, id) \
+    ::scio_beast::trace::record(::scio_beast::trace::Stage::stage, (socket), (id))
+
+#else
+
+#define SCIO_BEAST_TRACE(stage, socket, id) ((void)0)
+
+#endif  //  SCIO_BEAST_ENABLE_TRACING
     
 typedef uint64_t CallId;
 
@@ -125,8 +486,10 @@ struct ChannelStateData {
     ChannelState    newState;
 };
 
+typedef boost::beast::flat_buffer ReadBuffer;
+
 typedef boost::signals2::signal<
-    void(const boost::beast::multi_buffer&)
+    void(const ReadBuffer&)
 >                                                                       EventHandlerRaw;
 
 typedef boost::signals2::signal<void(const boost::system::error_code&)> EventHandlerError;
@@ -149,6 +512,17 @@ typedef boost::signals2::signal<void(const json&)>                      EventHan
 
 typedef std::function<void(const json& resp)> EmitEventResponseHandler;
 
+//
+//  A single #publish as handed out by drain() when pull mode is enabled
+//
+struct ChannelMessage {
+    std::string     channel;
+    json            data;
+    size_t          size;   //  encoded message size in bytes
+};
+
+typedef std::vector<ChannelMessage> ChannelMessageBatch;
+
 typedef boost::signals2::signal<
     void(
         const std::string& eventName, 
@@ -156,6 +530,43 @@ typedef boost::signals2::signal<
     )
 >                                                                       EventHandlerEmit;
 
+typedef boost::signals2::signal<void(size_t inboundBytes)>              EventHandlerReadPaused;
+typedef boost::signals2::signal<void(size_t inboundBytes)>              EventHandlerReadResumed;
+
+//
+//  Outcome of resubscribing the channels left pending by a disconnect
+//
+struct ResubscribeResult {
+    ResubscribeResult()
+        : total(0)
+        , subscribed(0)
+        , failed(0)
+        , timedOut(0)
+        , elapsed(0)
+    {
+    }
+
+    size_t                      total;
+    size_t                      subscribed;
+    size_t                      failed;     //  rejected by the server
+    size_t                      timedOut;   //  no answer before ResubscribeOptions::timeout
+    std::chrono::milliseconds   elapsed;
+};
+
+typedef boost::signals2::signal<void(const ResubscribeResult&)>         EventHandlerResubscribeComplete;
+
+//
+//  A user handler that ran for longer than WatchdogOptions::slowHandlerThreshold
+//
+struct SlowHandlerInfo {
+    size_t                      handlerId;  //  SCSocket::EventHandlerIds or ResponseHandlerId, or SCChannel's if |channel| is set
+    std::string                 channel;
+    std::chrono::microseconds   duration;
+};
+
+typedef boost::signals2::signal<void(const SlowHandlerInfo&)>           EventHandlerSlowHandler;
+typedef boost::signals2::signal<void(std::chrono::milliseconds lag)>    EventHandlerLoopLag;
+
 class ICodecEngine {
 public:
     virtual ~ICodecEngine() {}
@@ -165,6 +576,246 @@ public:
     virtual bool isBinary() const = 0;
 };
 
+//
+//  Receives messages too large to buffer as a sequence of fragments as they
+//  come off the wire. Streamed messages bypass the codec, RawEvent and normal
+//  dispatch; plug an incremental (SAX style) parser in here to consume them.
+//
+class IMessageStreamHandler {
+public:
+    virtual ~IMessageStreamHandler() {}
+
+    virtual void onMessageBegin() = 0;
+    virtual void onMessageFragment(const char* data, size_t size) = 0;
+    virtual void onMessageEnd() = 0;
+    virtual void onMessageAbort() = 0;  //  connection closed mid-message
+};
+
+//
+//  A message oriented duplex link SCSocket can run over in place of TCP, TLS and
+//  WebSocket; see ConnectOptions::setTransport(). Handlers are always posted to
+//  the io_service given to asyncOpen(), never run inline.
+//
+class IMessageTransport {
+public:
+    typedef std::function<void(const boost::system::error_code&)> Handler;
+
+    virtual ~IMessageTransport() {}
+
+    virtual void asyncOpen(boost::asio::io_service& ios, Handler handler) = 0;
+
+    //  appends one whole message to |buffer|; one read outstanding at a time
+    virtual void asyncRead(ReadBuffer& buffer, Handler handler) = 0;
+
+    //  of the last message read
+    virtual bool gotBinary() const = 0;
+
+    //  |data| must stay valid until |handler| runs
+    virtual void asyncWrite(const char* data, size_t size, bool binary, Handler handler) = 0;
+
+    //  fails outstanding and later reads on both ends with eof
+    virtual void close() = 0;
+};
+
+typedef std::shared_ptr<IMessageTransport>     MessageTransportPtr;
+typedef std::function<MessageTransportPtr()>   MessageTransportFactory;
+
+//
+//  One end of an in-memory link; createPair() returns both. Writes are copied to
+//  the peer's queue and completions posted to each end's io_service, so the ends
+//  may run on different threads. No kernel, no framing: useful for benchmarking
+//  the client alone and for deterministic protocol tests.
+//
+class MemoryTransport
+    : public IMessageTransport
+    , private boost::noncopyable
+{
+public:
+    typedef std::shared_ptr<MemoryTransport> Ptr;
+
+    static std::pair<Ptr, Ptr> createPair() {
+        auto link = std::make_shared<Link>();
+
+        Ptr a(new MemoryTransport(link, 0));
+        Ptr b(new MemoryTransport(link, 1));
+
+        link->ends[0].self = a;
+        link->ends[1].self = b;
+
+        return std::make_pair(a, b);
+    }
+
+    //  drops a read still outstanding here and closes the link for the peer
+    virtual ~MemoryTransport() {
+        {
+            boost::lock_guard<boost::mutex> lock(m_link->lock);
+
+            End& me = m_link->ends[m_end];
+
+            me.readHandler  = nullptr;
+            me.readBuffer   = nullptr;
+            me.readWork.reset();
+        }
+
+        close();
+    }
+
+    virtual void asyncOpen(boost::asio::io_service& ios, Handler handler) override {
+        boost::lock_guard<boost::mutex> lock(m_link->lock);
+
+        m_link->ends[m_end].ios = &ios;
+
+        const boost::system::error_code ec = m_link->closed ?
+            boost::asio::error::connection_refused :
+            boost::system::error_code()
+            ;
+        ios.post(std::bind(handler, ec));
+    }
+
+    virtual void asyncRead(ReadBuffer& buffer, Handler handler) override {
+        boost::lock_guard<boost::mutex> lock(m_link->lock);
+
+        End& me = m_link->ends[m_end];
+
+        me.readBuffer   = &buffer;
+        me.readHandler  = handler;
+        me.readWork     = std::make_shared<boost::asio::io_service::work>(*me.ios);   //  like a socket read, keeps run() going
+
+        if(!me.queue.empty() || m_link->closed) {
+            me.ios->post(std::bind(&MemoryTransport::completeRead, me.self.lock()));
+        }
+    }
+
+    virtual bool gotBinary() const override { return m_gotBinary; }
+
+    virtual void asyncWrite(const char* data, size_t size, bool binary, Handler handler) override {
+        boost::lock_guard<boost::mutex> lock(m_link->lock);
+
+        End& me = m_link->ends[m_end];
+
+        if(m_link->closed) {
+            me.ios->post(std::bind(handler, boost::system::error_code(boost::asio::error::broken_pipe)));
+            return;
+        }
+
+        End& peer = m_link->ends[1 - m_end];
+
+        const Message message = { std::string(data, size), binary };
+        peer.queue.push_back(message);
+
+        //  the peer end may not be open yet; its first read picks the message up
+        if(peer.readHandler && 1 == peer.queue.size()) {
+            peer.ios->post(std::bind(&MemoryTransport::completeRead, peer.self.lock()));
+        }
+
+        me.ios->post(std::bind(handler, boost::system::error_code()));
+    }
+
+    virtual void close() override {
+        boost::lock_guard<boost::mutex> lock(m_link->lock);
+
+        if(m_link->closed) {
+            return;
+        }
+
+        m_link->closed = true;
+
+        //  messages already queued are still delivered, then reads fail
+        for(auto& end : m_link->ends) {
+            if(end.readHandler && end.queue.empty()) {
+                end.ios->post(std::bind(&MemoryTransport::completeRead, end.self.lock()));
+            }
+        }
+    }
+
+private:
+    struct Message {
+        std::string     data;
+        bool            binary;
+    };
+
+    struct End {
+        End() : ios(nullptr), readBuffer(nullptr) {}
+
+        boost::asio::io_service*                        ios;
+        std::deque<Message>                             queue;  //  written by the other end
+        ReadBuffer*                                     readBuffer;
+        Handler                                         readHandler;
+        std::shared_ptr<boost::asio::io_service::work>  readWork;
+        std::weak_ptr<MemoryTransport>                  self;
+    };
+
+    struct Link {
+        Link() : closed(false) {}
+
+        boost::mutex    lock;
+        End             ends[2];
+        bool            closed;
+    };
+
+    MemoryTransport(std::shared_ptr<Link> link, const size_t end)
+        : m_link(link)
+        , m_end(end)
+        , m_gotBinary(false)
+    {
+    }
+
+    //  on this end's io thread
+    void completeRead() {
+        Handler handler;
+        boost::system::error_code ec;
+        {
+            boost::lock_guard<boost::mutex> lock(m_link->lock);
+
+            End& me = m_link->ends[m_end];
+            if(!me.readHandler) {
+                return; //  a close raced a delivery; already completed
+            }
+
+            if(!me.queue.empty()) {
+                const Message& message = me.queue.front();
+
+                me.readBuffer->commit(boost::asio::buffer_copy(
+                    me.readBuffer->prepare(message.data.size()), boost::asio::buffer(message.data)
+                ));
+                m_gotBinary = message.binary;
+
+                me.queue.pop_front();
+            } else if(m_link->closed) {
+                ec = boost::asio::error::eof;
+            } else {
+                return;
+            }
+
+            handler.swap(me.readHandler);
+            me.readBuffer = nullptr;
+            me.readWork.reset();
+        }
+
+        handler(ec);
+    }
+
+    std::shared_ptr<Link>   m_link;
+    size_t                  m_end;
+    bool                    m_gotBinary;
+};
+
+//  Plain JSON text; what SCSocket speaks when no codec engine is set
+class CodecEngineJson
+    : public ICodecEngine
+{
+public:
+    virtual std::string encode(const json& obj) override {
+        return obj.dump();
+    }
+
+    virtual json decode(const std::string& payload) override {
+        return json::parse(payload);
+    }
+
+    virtual bool isBinary() const override { return false; }
+};
+
 //  Port from sc-codec-min-bin @ https://github.com/SocketCluster/sc-codec-min-bin
 class CodecEngineMinBin
     : public ICodecEngine
@@ -228,7 +879,7 @@ private:
                 return;
             }
 
-            json a = { eventName, data.at("data") };
+            json a = { data.at("channel"), data.at("data") };
 
             const CallId cid = obj.value("cid", 0);
             if(0 != cid) {
@@ -343,11 +994,13 @@ class ChannelSubscriptionOptions {
 public:
     ChannelSubscriptionOptions()
         : waitForAuth(false)
+        , inboxCapacity(0)
     {       
     }
 
     bool        waitForAuth;
     json        data;
+    size_t      inboxCapacity;  //  >0 enables pull mode: messages are queued for drain() instead of watch()
 };
 
 class SCSocket; //  forward
@@ -367,6 +1020,7 @@ public:
         : m_name(name)
         , m_socket(socket)
         , m_state(ChannelState::UNSUBSCRIBED)
+        , m_subscribeInFlight(false)
     {
     }
 
@@ -392,6 +1046,20 @@ public:
     inline void unsubscribe();
     inline void destroy();
 
+    //
+    //  Pull mode: move up to |maxN| queued messages into |batch|. Only valid for
+    //  channels subscribed with ChannelSubscriptionOptions::inboxCapacity; must
+    //  be called from a single consumer thread.
+    //
+    inline size_t drain(ChannelMessageBatch& batch, const size_t maxN);
+
+    bool hasInbox() const { return nullptr != m_inbox; }
+
+    //  |capacity| as requested; rings are rounded up to a power of two
+    bool hasInboxCapacity(const size_t capacity) const {
+        return m_inbox && m_inbox->capacity() == detail::roundUpPow2(capacity);
+    }
+
     ChannelState getState() const { return m_state; }
 
 private:
@@ -405,16 +1073,20 @@ private:
         EventHandlerUnsubscribe,
         EventHandlerChannel
     > EventTable;
+
+    typedef detail::SpscRing<ChannelMessage>    Inbox;
     
     std::string                     m_name;
     std::shared_ptr<SCSocket>       m_socket;
     EventTable                      m_eventTable;
     ChannelState                    m_state;    
+    std::unique_ptr<Inbox>          m_inbox;
+    ChannelSubscriptionOptions      m_subOptions;           //  re-used when resubscribing after a reconnect
+    bool                            m_subscribeInFlight;    //  #subscribe sent, no response yet
 
+    //  defined after SCSocket; slow handlers are reported through the socket's watchdog
     template<size_t HandlerId, typename ...Args>
-    void triggerEvent(Args&& ...args) {
-        (std::get<HandlerId>(m_eventTable))(std::forward<Args>(args)...);
-    }
+    inline void triggerEvent(Args&& ...args);
 };
 
 typedef std::shared_ptr<SCChannel> SCChannelPtr;
@@ -426,6 +1098,7 @@ public:
         , randomness(10000)
         , multiplier(1.5)
         , maxDelay(60000)
+        , decorrelatedJitter(false)
     {       
     }
 
@@ -433,867 +1106,4303 @@ public:
     uint32_t        randomness;     //  milliseconds
     double          multiplier;     //  default is 1.5
     uint32_t        maxDelay;       //  milliseconds
+    bool            decorrelatedJitter; //  delay = random(initialDelay, 3 * previous delay); ignores randomness & multiplier
 };
 
-class SecureConnectOptions {
+//
+//  Client wide admission control for connect attempts: at most |maxInFlight|
+//  sockets between starting to connect and completing the SocketCluster
+//  handshake, started at no more than |ratePerSecond| with bursts of |burst|.
+//  0 disables the respective limit.
+//
+class ConnectAdmissionOptions {
 public:
-    std::shared_ptr<ssl::context>   context;
+    ConnectAdmissionOptions()
+        : maxInFlight(0)
+        , ratePerSecond(0)
+        , burst(1)
+    {
+    }
+
+    uint32_t        maxInFlight;
+    double          ratePerSecond;
+    uint32_t        burst;
 };
 
-class ConnectOptions {
+struct ConnectAdmissionStats {
+    uint64_t        admitted;
+    uint64_t        queued;         //  attempts that had to wait
+    uint64_t        queueDepth;     //  waiting right now
+    uint64_t        maxQueueDepth;
+    uint64_t        inFlight;
+};
+
+class ConnectAdmission
+    : private boost::noncopyable
+{
 public:
-    ConnectOptions()
-        : host("localhost")
-        , port("http")
-        , secure(false)
-        , path("/socketcluster/")
-        , autoReconnect(true)
-        , ackTimeout(10)
-        , codecEngine(nullptr)
-    {       
+    //  called once admitted, from whichever thread admits; must not block
+    typedef std::function<void()> AdmitHandler;
+    typedef uint64_t Token;
+
+    explicit ConnectAdmission(const ConnectAdmissionOptions& opts)
+        : m_opts(opts)
+        , m_tokens(std::max<uint32_t>(1, opts.burst))
+        , m_lastRefill(Clock::now())
+        , m_inFlight(0)
+        , m_nextToken(0)
+        , m_stats()
+    {
     }
 
-    ConnectOptions& setHost(const std::string& h) {
-        host = h;
-        return *this;
-    }
+    //  returns true if |admit| was invoked immediately, false if it was queued;
+    //  |token| (if given) identifies the attempt to cancel()
+    bool acquire(const AdmitHandler& admit, Token* token = nullptr) {
+        {
+            boost::lock_guard<boost::mutex> lock(m_lock);
 
-    ConnectOptions& setPort(const std::string& p) {
-        port = p;
-        return *this;
-    }
+            const Token t = ++m_nextToken;
+            if(token) {
+                *token = t;
+            }
 
-    ConnectOptions& setSecure(const bool enableSecure = true) {
-        secure = enableSecure;
-        return *this;
+            if(!m_waiters.empty() || !tryTakeSlot()) {
+                m_waiters.push_back(Waiter(t, admit));
+
+                ++m_stats.queued;
+                m_stats.queueDepth      = m_waiters.size();
+                m_stats.maxQueueDepth   = std::max(m_stats.maxQueueDepth, m_stats.queueDepth);
+                return false;
+            }
+        }
+
+        admit();
+        return true;
     }
 
-    ConnectOptions& setPath(const std::string& p) {
-        path = p;
-        return *this;
-    }
+    //  the admitted attempt has completed, successfully or not
+    void release() {
+        {
+            boost::lock_guard<boost::mutex> lock(m_lock);
+            if(m_inFlight) {
+                --m_inFlight;
+                m_stats.inFlight = m_inFlight;
+            }
+        }
 
-    ConnectOptions& setAutoReconnect(const bool r) {
-        autoReconnect = r;
-        return *this;
+        poll();
     }
 
-    ConnectOptions& setAckTimeout(const uint32_t t) {
-        ackTimeout = t;
-        return *this;
-    }
+    //  drops a queued attempt; false if it was admitted already, and so must release()
+    bool cancel(const Token token) {
+        boost::lock_guard<boost::mutex> lock(m_lock);
 
-    ConnectOptions& setPerMessageDeflate(const bool enabled) {
-        perMessageDeflateOpts.client_enable = enabled;
-        return *this;
+        const auto waiter = std::find_if(m_waiters.begin(), m_waiters.end(), [token](const Waiter& w) {
+            return token == w.first;
+        });
+
+        if(m_waiters.end() == waiter) {
+            return false;
+        }
+
+        m_waiters.erase(waiter);
+        m_stats.queueDepth = m_waiters.size();
+        return true;
     }
 
-    ConnectOptions& setPerMessageDeflate(const websocket::permessage_deflate& pmd) {
-        perMessageDeflateOpts = pmd;
-        return *this;
+    //  admit as many waiters as the limits now allow
+    void poll() {
+        std::vector<AdmitHandler> admitted;
+        {
+            boost::lock_guard<boost::mutex> lock(m_lock);
+
+            while(!m_waiters.empty() && tryTakeSlot()) {
+                admitted.push_back(m_waiters.front().second);
+                m_waiters.pop_front();
+            }
+
+            m_stats.queueDepth = m_waiters.size();
+        }
+
+        for(const auto& admit : admitted) {
+            admit();
+        }
     }
 
-    ConnectOptions& setCodecEngine(std::shared_ptr<ICodecEngine> ce) {
-        codecEngine = ce;
-        return *this;
+    //  how often queued sockets should poll(); zero when only release() can admit
+    std::chrono::milliseconds pollInterval() const {
+        if(m_opts.ratePerSecond <= 0) {
+            return std::chrono::milliseconds(0);
+        }
+
+        const int64_t ms = static_cast<int64_t>(std::ceil(1000.0 / m_opts.ratePerSecond));
+        return std::chrono::milliseconds(std::max<int64_t>(1, std::min<int64_t>(1000, ms)));
     }
 
-    ConnectOptions& setUserAgent(const std::string& ua) {
-        userAgent = ua;
-        return *this;
+    ConnectAdmissionStats getStats() const {
+        boost::lock_guard<boost::mutex> lock(m_lock);
+        return m_stats;
     }
 
-    std::string                     host;
-    std::string                     port;
-    std::string                     userAgent;
-    bool                            secure; //  SSL/TLS?
-    std::string                     path;
-    bool                            autoReconnect;
-    AutoReconnectOptions            autoReconnectOptions;
-    uint32_t                        ackTimeout;
-    SecureConnectOptions            secureOptions;
-    std::shared_ptr<ICodecEngine>   codecEngine;
-    websocket::permessage_deflate   perMessageDeflateOpts;
-};
+private:
+    typedef std::chrono::steady_clock Clock;
+    typedef std::pair<Token, AdmitHandler> Waiter;
 
-class SCSocket
-    : public std::enable_shared_from_this<SCSocket>
-{
-public:
-    enum EventHandlerIds {
-        RawEvent,
+    //  m_lock must be held
+    bool tryTakeSlot() {
+        if(m_opts.maxInFlight && m_inFlight >= m_opts.maxInFlight) {
+            return false;
+        }
 
-        ErrorEvent,
+        if(m_opts.ratePerSecond > 0) {
+            const Clock::time_point now = Clock::now();
+            const double elapsed = std::chrono::duration<double>(now - m_lastRefill).count();
 
-        ConnectingEvent,
-        ConnectEvent,
-        ConnectAbortEvent,
-        DisconnectEvent,
+            m_tokens        = std::min<double>(std::max<uint32_t>(1, m_opts.burst), m_tokens + elapsed * m_opts.ratePerSecond);
+            m_lastRefill    = now;
 
-        AuthenticateEvent,
-        AuthTokenChangeEvent,
-        DeauthenticateEvent,
+            if(m_tokens < 1) {
+                return false;
+            }
 
-        SubscribeEvent,
-        SubscribeFailEvent,
-        SubscriptionStateChangeEvent,
-        UnsubscribeEvent,
+            m_tokens -= 1;
+        }
 
-        EmitEvent
-    };
+        ++m_inFlight;
+        ++m_stats.admitted;
+        m_stats.inFlight = m_inFlight;
+        return true;
+    }
 
-    typedef std::function<void(boost::system::error_code ec, const json& resp)> ResponseHandler;
+    mutable boost::mutex        m_lock;
+    ConnectAdmissionOptions     m_opts;
+    double                      m_tokens;
+    Clock::time_point           m_lastRefill;
+    uint64_t                    m_inFlight;
+    Token                       m_nextToken;
+    std::deque<Waiter>          m_waiters;
+    ConnectAdmissionStats       m_stats;
+};
 
-    enum class State {
-        CLOSED,
-        CONNECTING,
-        OPEN
-    };
+//
+//  TCP level tuning for the socket under the (secure) websocket. Buffer sizes
+//  are applied before connecting so window scaling can take them into account;
+//  the rest once connected. Options unsupported by the platform are ignored.
+//
+class TransportOptions {
+public:
+    TransportOptions()
+        : noDelay(false)
+        , receiveBufferSize(0)
+        , sendBufferSize(0)
+        , keepAlive(false)
+        , keepAliveIdle(0)
+        , keepAliveInterval(0)
+        , keepAliveCount(0)
+        , quickAck(false)
+        , busyPoll(0)
+    {
+    }
 
-    enum class AuthState {
-        UNAUTHENTICATED,
-        AUTHENTICATED,
-    };
+    bool            noDelay;            //  TCP_NODELAY
+    int             receiveBufferSize;  //  SO_RCVBUF bytes; 0 = system default
+    int             sendBufferSize;     //  SO_SNDBUF bytes; 0 = system default
+    bool            keepAlive;          //  SO_KEEPALIVE
+    int             keepAliveIdle;      //  TCP_KEEPIDLE seconds; 0 = system default (Linux)
+    int             keepAliveInterval;  //  TCP_KEEPINTVL seconds; 0 = system default (Linux)
+    int             keepAliveCount;     //  TCP_KEEPCNT probes; 0 = system default (Linux)
+    bool            quickAck;           //  TCP_QUICKACK once connected; the kernel may drop back to delayed ACKs (Linux)
+    int             busyPoll;           //  SO_BUSY_POLL microseconds; 0 = off (Linux, may require CAP_NET_ADMIN)
+};
 
-    typedef std::map<std::string, SCChannelPtr> ChannelSubscriptions;
+//
+//  Happy Eyeballs (RFC 8305) style connecting: resolved endpoints are ordered
+//  alternating IPv6 / IPv4 and attempted in parallel, a new attempt starting
+//  every |attemptDelay| (or immediately when one fails) until one succeeds.
+//
+class ConnectAttemptOptions {
+public:
+    ConnectAttemptOptions()
+        : attemptDelay(250)
+        , timeout(30000)
+    {
+    }
 
-    explicit SCSocket(const ConnectOptions& connectOptions)
-        : m_state(State::CLOSED)
-        , m_connectOptions(connectOptions)
-        , m_resolver(m_ios)
-        , m_sslContext(connectOptions.secureOptions.context)
-        , m_nextCallId(1)
-        , m_connectAttempts(0)
-        , m_pingTimeout(connectOptions.ackTimeout * 1000)   //  seconds -> ms
-        , m_pingTimeoutTimer(m_ios)
+    uint32_t        attemptDelay;   //  milliseconds
+    uint32_t        timeout;        //  milliseconds for the whole TCP connect; 0 = none
+};
+
+//
+//  Inbound flow control. Bytes are counted while they sit in pull mode inboxes;
+//  once |maxInboundBytes| is exceeded the socket stops reading and lets the
+//  kernel's receive window push back on the server.
+//
+class BackpressureOptions {
+public:
+    BackpressureOptions()
+        : maxInboundBytes(0)
+        , resumeInboundBytes(0)
     {
-        if(connectOptions.secure && connectOptions.secureOptions.context) {
-            m_wss.reset(new SecureWebSocket(m_ios, *m_sslContext.get()));
+    }
 
-            setPerMessageDeflate(m_ws);
+    size_t          maxInboundBytes;    //  0 = unlimited
+    size_t          resumeInboundBytes; //  resume reading at or below; 0 = half of maxInboundBytes
+};
 
-            m_wss->binary(haveBinaryCodec());
-        } else {
-            m_ws.reset(new WebSocket(m_ios));
+//
+//  Controls the size hint passed to async_read_some(). With |adaptive| the
+//  hint follows a moving average of recent message sizes and doubles while
+//  a large message is still arriving, clamped to [initialReadSize, maxReadSize].
+//
+class ReadBufferOptions {
+public:
+    ReadBufferOptions()
+        : initialReadSize(4096)
+        , maxReadSize(1024 * 1024)
+        , adaptive(true)
+    {
+    }
 
-            setPerMessageDeflate(m_ws);
+    size_t          initialReadSize;    //  bytes
+    size_t          maxReadSize;        //  bytes
+    bool            adaptive;
+};
 
-            m_connectOptions.secure = false;    //  we have no SSL context
+//
+//  Client side TLS session store keyed by host:port. Shared by every socket
+//  using the same ssl::context so reconnects can resume rather than perform
+//  a full handshake.
+//
+class TlsSessionCache
+    : private boost::noncopyable
+{
+public:
+    TlsSessionCache()
+        : m_enabled(true)
+        , m_hits(0)
+        , m_misses(0)
+    {
+    }
 
-            m_ws->binary(haveBinaryCodec());
+    ~TlsSessionCache() {
+        for(auto& entry : m_sessions) {
+            ::SSL_SESSION_free(entry.second);
         }
     }
 
-    void connect() {
-        if(State::CLOSED != m_state) {
+    //  disabled, no sessions are offered or kept but handshakes are still counted, e.g. to compare
+    void setEnabled(const bool enabled) { m_enabled.store(enabled, std::memory_order_relaxed); }
+    bool isEnabled() const { return m_enabled.load(std::memory_order_relaxed); }
+
+    //  offer a cached session, if any, for the next handshake on |ssl|
+    void apply(const std::string& key, SSL* ssl) {
+        if(!isEnabled()) {
             return;
         }
 
-        startConnect();
+        boost::lock_guard<boost::mutex> lock(m_lock);
 
-        m_iosThread = boost::thread(std::bind(&SCSocket::ioThread, shared_from_this()));
+        const auto it = m_sessions.find(key);
+        if(m_sessions.end() != it) {
+            ::SSL_set_session(ssl, it->second);
+        }
     }
 
-    boost::system::error_code close() {
-        m_state = State::CLOSED;
-        //  :TODO: we shoudl be using teardown? http://vinniefalco.github.io/beast/beast/ref/beast__websocket__async_teardown/overload2.html
-        boost::system::error_code ec;
+    void store(const std::string& key, SSL* ssl) {
+        if(!isEnabled()) {
+            return;
+        }
 
-        if(m_connectOptions.secure) {
-            m_wss->close(websocket::close_code::normal, ec);
-        } else {
-            m_ws->close(websocket::close_code::normal, ec);
+        SSL_SESSION* session = ::SSL_get1_session(ssl);
+        if(!session) {
+            return;
         }
-    
-        m_ios.stop();
-        m_iosThread.join();
 
-        return ec;
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+        if(!::SSL_SESSION_is_resumable(session)) {
+            ::SSL_SESSION_free(session);
+            return;
+        }
+#endif
+
+        boost::lock_guard<boost::mutex> lock(m_lock);
+
+        SSL_SESSION*& slot = m_sessions[key];
+        if(slot) {
+            ::SSL_SESSION_free(slot);
+        }
+        slot = session;
     }
 
-    template <typename EmitData>
-    void emit(
-        const std::string& eventName, const EmitData& data, const ResponseHandler respHandler = 0, 
-        const bool noTimeout = false)
-    {
+    void recordHandshake(const bool resumed) {
+        (resumed ? m_hits : m_misses).fetch_add(1, std::memory_order_relaxed);
+    }
 
-        //  :TODO: should we connect if not already connected here? https://github.com/SocketCluster/socketcluster-client/blob/01a66770ea74b0f6185d7c59ea64b3d8bef078c6/lib/scsocket.js#L680
+    uint64_t getHits() const { return m_hits.load(std::memory_order_relaxed); }
+    uint64_t getMisses() const { return m_misses.load(std::memory_order_relaxed); }
 
-        auto self(shared_from_this());
+private:
+    typedef std::map<std::string, SSL_SESSION*> Sessions;
 
-        //  dispatch to our io thread
-        m_ios.dispatch( [ self, this, eventName, data, respHandler, noTimeout ]() {
+    boost::mutex            m_lock;
+    Sessions                m_sessions;
+    std::atomic<bool>       m_enabled;
+    std::atomic<uint64_t>   m_hits;
+    std::atomic<uint64_t>   m_misses;
+};
 
-            json payload = {
-                { "event",  eventName },
-                { "data",   data }
-            };
+//
+//  SHA-256 pins of the server's SubjectPublicKeyInfo (SPKI), checked against the
+//  leaf certificate after standard RFC 2818 verification. Verdicts are cached by
+//  the certificate's SHA-256 fingerprint so its public key is only extracted and
+//  digested once.
+//
+class PublicKeyPinSet
+    : private boost::noncopyable
+{
+public:
+    typedef std::array<unsigned char, 32> Pin;
 
-            if(respHandler) {
-                const CallId cid = m_nextCallId++;
-                
-                payload["cid"] = cid;
+    void addPin(const Pin& pin) {
+        boost::lock_guard<boost::mutex> lock(m_lock);
+        m_pins.push_back(pin);
+        m_verdicts.clear();
+    }
 
-                ResponseItem respItem( { respHandler, nullptr } );
+    //  |hexSha256| is 64 hex characters as produced by e.g. `openssl dgst -sha256`
+    bool addPin(const std::string& hexSha256) {
+        if(hexSha256.length() != 64) {
+            return false;
+        }
 
-                if(!noTimeout) {
-                    //
-                    //  If our event is not ACK'd by the server within |ackTimeout| we will
-                    //  respond to the handler with a timeout error
-                    //
-                    respItem.ackTimer.reset(
-                        new boost::asio::deadline_timer(m_ios, boost::posix_time::seconds(m_connectOptions.ackTimeout))
-                    );
+        Pin pin;
+        for(size_t i = 0; i < pin.size(); ++i) {
+            const int hi = hexValue(hexSha256[i * 2]);
+            const int lo = hexValue(hexSha256[i * 2 + 1]);
+            if(hi < 0 || lo < 0) {
+                return false;
+            }
+            pin[i] = static_cast<unsigned char>((hi << 4) | lo);
+        }
 
-                    respItem.ackTimer->async_wait( [ self, this, cid ](const boost::system::error_code& ec) {
-                        if(ec) {
-                            //  likely canceled
-                            return;
-                        }
+        addPin(pin);
+        return true;
+    }
 
-                        handleEmitAckTimeout(cid);          
-                    });
-                }
+    bool empty() const {
+        boost::lock_guard<boost::mutex> lock(m_lock);
+        return m_pins.empty();
+    }
+
+    bool verify(X509* cert) {
+        Fingerprint fingerprint;
+        unsigned int fingerprintLen = 0;
+
+        //  SHA-1 would let a colliding certificate pick up another's verdict
+        const bool haveFingerprint =
+            1 == ::X509_digest(cert, ::EVP_sha256(), fingerprint.data(), &fingerprintLen) &&
+            fingerprint.size() == fingerprintLen;
 
-                m_pendingResponses[cid] = respItem;
+        if(haveFingerprint) {
+            boost::lock_guard<boost::mutex> lock(m_lock);
+
+            const auto it = m_verdicts.find(fingerprint);
+            if(m_verdicts.end() != it) {
+                return it->second;
             }
+        }
 
-            m_outQueue.push(payload);
-        });
-    }
+        const bool verdict = matchesPin(cert);
 
-    void handleEmitAckTimeout(const CallId cid) {
-        try {
-            const ResponseItem respItem = m_pendingResponses.at(cid);
-            m_pendingResponses.erase(cid);          
-        
-            std::stringstream ackTimeoutErrMsg;
-            ackTimeoutErrMsg << "no ack for call id (cid) " << std::dec << cid;
+        if(haveFingerprint) {
+            boost::lock_guard<boost::mutex> lock(m_lock);
 
-            const json errorInfo = {
-                { "error", {
-                    { "message", ackTimeoutErrMsg.str() }
-                }}
-            };
+            if(m_verdicts.size() >= MAX_CACHED_VERDICTS) {
+                m_verdicts.clear();
+            }
+            m_verdicts[fingerprint] = verdict;
+        }
 
-            respItem.handler(make_error_code(ack_timeout), errorInfo);
-        } catch(std::out_of_range) {
-        }       
+        return verdict;
     }
 
-    template <size_t HandlerId, typename ...Args>
-    boost::signals2::connection on(Args&& ...args) {
-        return std::get<HandlerId>(m_eventTable).connect(std::forward<Args>(args)...);
+private:
+    typedef std::array<unsigned char, 32>   Fingerprint;
+    typedef std::map<Fingerprint, bool>     Verdicts;
+
+    static const size_t MAX_CACHED_VERDICTS = 256;
+
+    static int hexValue(const char c) {
+        if(c >= '0' && c <= '9') { return c - '0'; }
+        if(c >= 'a' && c <= 'f') { return c - 'a' + 10; }
+        if(c >= 'A' && c <= 'F') { return c - 'A' + 10; }
+        return -1;
     }
 
-    SCChannelPtr subscribe(const std::string& channelName, const ChannelSubscriptionOptions& channelSubOptions = ChannelSubscriptionOptions()) {
-        //  :TODO: support waitForAuth - see https://github.com/SocketCluster/socketcluster-client/blob/01a66770ea74b0f6185d7c59ea64b3d8bef078c6/lib/scsocket.js
+    bool matchesPin(X509* cert) const {
+        X509_PUBKEY* pubKey = ::X509_get_X509_PUBKEY(cert);
+        const int pubKeyLen = ::i2d_X509_PUBKEY(pubKey, nullptr);
+        if(pubKeyLen <= 0) {
+            return false;
+        }
 
-        SCChannelPtr channel;
+        std::vector<unsigned char> pubKeyDer(pubKeyLen);
+        unsigned char* pubKeyDerPtr = &pubKeyDer[0];
+        ::i2d_X509_PUBKEY(pubKey, &pubKeyDerPtr);
 
-        try {
-            channel = m_channels.at(channelName);
-        } catch(std::out_of_range) {            
-            channel.reset(new SCChannel(channelName, shared_from_this()));
-            m_channels[channelName] = channel;
+        Pin digest;
+        unsigned int digestLen = 0;
+        if(1 != ::EVP_Digest(&pubKeyDer[0], pubKeyLen, digest.data(), &digestLen, ::EVP_sha256(), nullptr) ||
+            digest.size() != digestLen)
+        {
+            return false;
         }
 
-        if(ChannelState::UNSUBSCRIBED == channel->getState()) {
-            channel->m_state = ChannelState::PENDING;
-            tryChannelSubscribe(channel, channelSubOptions);
+        boost::lock_guard<boost::mutex> lock(m_lock);
+        for(const auto& pin : m_pins) {
+            if(0 == std::memcmp(pin.data(), digest.data(), digest.size())) {
+                return true;
+            }
         }
 
-        return channel;
+        return false;
     }
 
-    void unsubscribe(const std::string& channelName) {
-        try {
-            const auto channel = m_channels.at(channelName);
+    mutable boost::mutex    m_lock;
+    std::vector<Pin>        m_pins;
+    Verdicts                m_verdicts;
+};
 
-            if(ChannelState::UNSUBSCRIBED != channel->getState()) {
-                triggerChannelUnsubscribe(channel);
-                sendChannelUnsubscribe(channel);
-            }
-        } catch(std::out_of_range) {
-        }   
+class SecureConnectOptions {
+public:
+    std::shared_ptr<ssl::context>       context;
+    std::shared_ptr<TlsSessionCache>    sessionCache;   //  SocketClusterClient shares one per context if unset
+    std::shared_ptr<PublicKeyPinSet>    publicKeyPins;  //  if non-empty, peer is verified with RFC 2818 + SPKI pins
+};
+
+//
+//  Resolved endpoints shared across sockets and reconnects. getaddrinfo() does not
+//  expose record TTLs so entries live for a fixed |ttl|; for |maxStale| beyond that
+//  the stale endpoints are still handed out while one socket re-resolves in the
+//  background, which keeps reconnects going through DNS outages. Sockets missing
+//  the same key together wait on a single resolve.
+//
+class ResolverCache
+    : private boost::noncopyable
+{
+public:
+    typedef std::vector<tcp::endpoint> Endpoints;
+    typedef std::function<void(const boost::system::error_code&, const Endpoints&)> ResolveHandler;
+
+    enum class Freshness {
+        MISS,
+        FRESH,
+        STALE,
+    };
+
+    explicit ResolverCache(
+        const std::chrono::seconds ttl = std::chrono::seconds(60),
+        const std::chrono::seconds maxStale = std::chrono::seconds(3600))
+        : m_ttl(ttl)
+        , m_maxStale(maxStale)
+    {
     }
 
-    void destroyChannel(const std::string& channelName) {
-        try {
-            auto channel = m_channels.at(channelName);
-            
-            channel->unwatch();
-            channel->unsubscribe();
+    //  |shouldRefresh| is set for exactly one caller per stale entry
+    Freshness lookup(const std::string& key, Endpoints& endpoints, bool& shouldRefresh) {
+        boost::lock_guard<boost::mutex> lock(m_lock);
 
-            m_channels.erase(channelName);
-        } catch(std::out_of_range) {            
+        shouldRefresh = false;
+
+        const auto it = m_entries.find(key);
+        if(m_entries.end() == it) {
+            return Freshness::MISS;
         }
-    }
 
-    void unwatch(const std::string& channelName) {
-        try {
-            auto channel = m_channels.at(channelName);
-            channel->unwatch();
-        } catch(std::out_of_range) {            
+        Entry& entry = it->second;
+        const Clock::time_point now = Clock::now();
+
+        if(now < entry.expiresAt) {
+            endpoints = entry.endpoints;
+            return Freshness::FRESH;
+        }
+
+        if(now < entry.expiresAt + m_maxStale) {
+            endpoints = entry.endpoints;
+            if(!entry.refreshing) {
+                entry.refreshing    = true;
+                shouldRefresh       = true;
+            }
+            return Freshness::STALE;
         }
+
+        m_entries.erase(it);
+        return Freshness::MISS;
     }
 
-    void unwatch(const std::string& channelName, const boost::signals2::connection& conn) {
+    void store(const std::string& key, const Endpoints& endpoints) {
+        boost::lock_guard<boost::mutex> lock(m_lock);
+
+        Entry& entry        = m_entries[key];
+        entry.endpoints     = endpoints;
+        entry.expiresAt     = Clock::now() + m_ttl;
+        entry.refreshing    = false;
+    }
+
+    //  keep serving what we have; the next stale lookup tries again
+    void refreshFailed(const std::string& key) {
+        boost::lock_guard<boost::mutex> lock(m_lock);
+
+        const auto it = m_entries.find(key);
+        if(m_entries.end() != it) {
+            it->second.refreshing = false;
+        }
+    }
+
+    //
+    //  After a MISS: returns true if the caller should resolve |key| itself and hand
+    //  the outcome to completeResolve(). Otherwise a resolve is already in flight and
+    //  |handler| is called with its outcome, on the thread that completes it.
+    //
+    bool joinResolve(const std::string& key, ResolveHandler handler) {
+        boost::lock_guard<boost::mutex> lock(m_lock);
+
+        const auto it = m_resolves.find(key);
+        if(m_resolves.end() != it) {
+            it->second.push_back(std::move(handler));
+            return false;
+        }
+
+        m_resolves[key];
+        return true;
+    }
+
+    //  stores |endpoints| unless |ec|, then passes the outcome to everyone who joined
+    void completeResolve(const std::string& key, const boost::system::error_code& ec, const Endpoints& endpoints) {
+        std::vector<ResolveHandler> waiters;
+
+        if(!ec) {
+            store(key, endpoints);
+        }
+
+        {
+            boost::lock_guard<boost::mutex> lock(m_lock);
+
+            const auto it = m_resolves.find(key);
+            if(m_resolves.end() != it) {
+                waiters.swap(it->second);
+                m_resolves.erase(it);
+            }
+        }
+
+        for(const auto& waiter : waiters) {
+            waiter(ec, endpoints);
+        }
+    }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Entry {
+        Entry() : refreshing(false) {}
+
+        Endpoints           endpoints;
+        Clock::time_point   expiresAt;
+        bool                refreshing;
+    };
+
+    boost::mutex                        m_lock;
+    std::chrono::seconds                m_ttl;
+    std::chrono::seconds                m_maxStale;
+    std::map<std::string, Entry>        m_entries;
+    std::map<std::string, std::vector<ResolveHandler>>  m_resolves;     //  in flight, with who is waiting on them
+};
+
+//
+//  Append-only, memory-mapped file of outbound messages. Each record is a 32 bit
+//  length followed by the message; the header keeps the read & write offsets, so
+//  a spool left behind by a previous process is picked up and replayed too.
+//  Replay reads ahead with next() while records stay put until pop()ed, so one
+//  handed out but never confirmed sent is replayed again after a rewind() (or a
+//  crash). Not thread safe; SCSocket only touches it from its io thread.
+//
+class OfflineSpool
+    : private boost::noncopyable
+{
+public:
+    typedef std::vector<uint8_t> Record;
+
+    OfflineSpool()
+        : m_header(nullptr)
+        , m_capacity(0)
+        , m_replayOffset(0)
+    {
+    }
+
+    ~OfflineSpool() {
+        flush();
+    }
+
+    //  maps |path|, creating or resizing it to |maxBytes|
+    bool open(const std::string& path, const size_t maxBytes) {
+        namespace bip = boost::interprocess;
+
+        if(maxBytes < HEADER_SIZE + sizeof(uint32_t) + 1) {
+            return false;
+        }
+
+        try {
+            {
+                std::filebuf fbuf;
+                if(!fbuf.open(path, std::ios_base::in | std::ios_base::out | std::ios_base::binary) &&
+                    !fbuf.open(path, std::ios_base::in | std::ios_base::out | std::ios_base::binary | std::ios_base::trunc))
+                {
+                    return false;
+                }
+
+                //  extend (sparse) to the full size so it can be mapped once
+                if(fbuf.pubseekoff(0, std::ios_base::end) < static_cast<std::streamoff>(maxBytes)) {
+                    fbuf.pubseekoff(maxBytes - 1, std::ios_base::beg);
+                    fbuf.sputc(0);
+                }
+            }
+
+            bip::file_mapping mapping(path.c_str(), bip::read_write);
+            m_region = bip::mapped_region(mapping, bip::read_write, 0, maxBytes);
+        } catch(const bip::interprocess_exception&) {
+            return false;
+        }
+
+        m_header    = static_cast<Header*>(m_region.get_address());
+        m_capacity  = maxBytes;
+
+        const bool valid =
+            MAGIC == m_header->magic &&
+            m_header->readOffset >= HEADER_SIZE &&
+            m_header->readOffset <= m_header->writeOffset &&
+            m_header->writeOffset <= m_capacity;
+
+        if(!valid) {
+            m_header->magic         = MAGIC;
+            m_header->readOffset    = HEADER_SIZE;
+            m_header->writeOffset   = HEADER_SIZE;
+            m_header->count         = 0;
+        }
+
+        m_replayOffset = m_header->readOffset;
+        return true;
+    }
+
+    bool isOpen() const { return nullptr != m_header; }
+    bool empty() const { return !m_header || 0 == m_header->count; }
+    size_t size() const { return m_header ? m_header->count : 0; }
+    size_t usedBytes() const { return m_header ? m_header->writeOffset - m_header->readOffset : 0; }
+
+    //  records not yet handed out by next()
+    bool replayPending() const { return m_header && m_replayOffset < m_header->writeOffset; }
+
+    //  false if the spool is full
+    bool append(const Record& record) {
+        const size_t needed = sizeof(uint32_t) + record.size();
+
+        if(m_header->writeOffset + needed > m_capacity) {
+            compact();
+
+            if(m_header->writeOffset + needed > m_capacity) {
+                return false;
+            }
+        }
+
+        uint8_t* const at       = base() + m_header->writeOffset;
+        const uint32_t length   = static_cast<uint32_t>(record.size());
+
+        std::memcpy(at, &length, sizeof(length));
+        std::memcpy(at + sizeof(length), record.data(), record.size());
+
+        m_header->writeOffset += needed;
+        ++m_header->count;
+        return true;
+    }
+
+    //  inserts |record| ahead of everything else, e.g. one that was never spooled; false if full
+    bool prepend(const Record& record) {
+        const size_t needed = sizeof(uint32_t) + record.size();
+
+        if(m_header->readOffset < HEADER_SIZE + needed) {
+            const size_t used = usedBytes();
+            if(HEADER_SIZE + needed + used > m_capacity) {
+                return false;
+            }
+
+            //  slide the unread records up to make room at the front
+            std::memmove(base() + HEADER_SIZE + needed, base() + m_header->readOffset, used);
+
+            m_header->readOffset    = HEADER_SIZE + needed;
+            m_header->writeOffset   = HEADER_SIZE + needed + used;
+        }
+
+        m_header->readOffset -= needed;
+
+        uint8_t* const at       = base() + m_header->readOffset;
+        const uint32_t length   = static_cast<uint32_t>(record.size());
+
+        std::memcpy(at, &length, sizeof(length));
+        std::memcpy(at + sizeof(length), record.data(), record.size());
+
+        ++m_header->count;
+
+        m_replayOffset = m_header->readOffset;
+        return true;
+    }
+
+    bool front(Record& record) const {
+        if(empty()) {
+            return false;
+        }
+
+        const uint8_t* const at = base() + m_header->readOffset;
+
+        uint32_t length;
+        std::memcpy(&length, at, sizeof(length));
+
+        record.assign(at + sizeof(length), at + sizeof(length) + length);
+        return true;
+    }
+
+    //  the record after the last one handed out; it stays in the spool until pop()ed
+    bool next(Record& record) {
+        if(!replayPending()) {
+            return false;
+        }
+
+        const uint8_t* const at = base() + m_replayOffset;
+
+        uint32_t length;
+        std::memcpy(&length, at, sizeof(length));
+
+        record.assign(at + sizeof(length), at + sizeof(length) + length);
+
+        m_replayOffset += sizeof(length) + length;
+        return true;
+    }
+
+    //  hand out everything still spooled again, starting from the front
+    void rewind() {
+        if(m_header) {
+            m_replayOffset = m_header->readOffset;
+        }
+    }
+
+    void pop() {
+        if(empty()) {
+            return;
+        }
+
+        uint32_t length;
+        std::memcpy(&length, base() + m_header->readOffset, sizeof(length));
+
+        m_header->readOffset += sizeof(length) + length;
+        --m_header->count;
+
+        if(0 == m_header->count) {
+            m_header->readOffset    = HEADER_SIZE;
+            m_header->writeOffset   = HEADER_SIZE;
+            m_replayOffset          = HEADER_SIZE;
+        } else {
+            m_replayOffset = std::max<size_t>(m_replayOffset, m_header->readOffset);
+        }
+    }
+
+    void flush() {
+        if(m_header) {
+            m_region.flush(0, 0, true);  //  async; the OS writes it back
+        }
+    }
+
+private:
+    struct Header {
+        uint32_t    magic;
+        uint32_t    reserved;
+        uint64_t    readOffset;
+        uint64_t    writeOffset;
+        uint64_t    count;
+    };
+
+    static const uint32_t   MAGIC       = 0x4c4f4f50;   //  "POOL"
+    static const size_t     HEADER_SIZE = 64;
+
+    uint8_t* base() const { return static_cast<uint8_t*>(m_region.get_address()); }
+
+    //  slide the unread records back to the start of the file
+    void compact() {
+        const size_t used = usedBytes();
+        if(HEADER_SIZE == m_header->readOffset) {
+            return;
+        }
+
+        std::memmove(base() + HEADER_SIZE, base() + m_header->readOffset, used);
+
+        m_replayOffset          -= m_header->readOffset - HEADER_SIZE;
+        m_header->readOffset    = HEADER_SIZE;
+        m_header->writeOffset   = HEADER_SIZE + used;
+    }
+
+    boost::interprocess::mapped_region  m_region;
+    Header*                             m_header;
+    size_t                              m_capacity;
+    size_t                              m_replayOffset;     //  next() reads here; not persisted
+};
+
+//
+//  Fire-and-forget emits (no response handler) made before the handshake completes,
+//  or while more than |maxQueuedMessages| are waiting in memory, go to an OfflineSpool
+//  at |path| instead of the out queue, as do those still queued when the connection
+//  drops. After the next handshake they are replayed in order, at up to |replayRate|
+//  messages per second (0 = unthrottled, |replayBatch| per io loop turn), never
+//  holding more than |maxQueuedMessages| in the out queue.
+//
+class SpoolOptions {
+public:
+    SpoolOptions()
+        : maxBytes(64 * 1024 * 1024)
+        , maxQueuedMessages(4096)
+        , replayRate(0)
+        , replayBatch(256)
+    {
+    }
+
+    std::string     path;   //  empty disables spooling
+    size_t          maxBytes;
+    size_t          maxQueuedMessages;
+    uint32_t        replayRate;
+    size_t          replayBatch;
+};
+
+//
+//  Memory-mapped recording of the WebSocket messages a socket sends and receives.
+//  Each record is a 16 byte header (nanoseconds since the capture began, length,
+//  direction and opcode) followed by the payload; the file header keeps the wall
+//  clock start time and the write offset, so a capture cut short by a crash is
+//  still readable. Recording stops, counting drops, once |maxBytes| is reached.
+//  Not thread safe; SCSocket only records from its io thread.
+//
+class WireCapture
+    : private boost::noncopyable
+{
+public:
+    enum class Direction : uint8_t {
+        INBOUND,
+        OUTBOUND
+    };
+
+    //  values are the WebSocket frame opcodes
+    enum class Opcode : uint8_t {
+        TEXT    = 1,
+        BINARY  = 2
+    };
+
+    struct Frame {
+        std::chrono::nanoseconds    timestamp;  //  since the capture began
+        Direction                   direction;
+        Opcode                      opcode;
+        const char*                 data;       //  points into the mapping
+        size_t                      size;
+    };
+
+    WireCapture()
+        : m_header(nullptr)
+        , m_capacity(0)
+    {
+    }
+
+    ~WireCapture() {
+        flush();
+    }
+
+    //  maps |path| for recording, truncating it and sizing it to |maxBytes|
+    bool create(const std::string& path, const size_t maxBytes) {
+        namespace bip = boost::interprocess;
+
+        if(maxBytes < HEADER_SIZE + RECORD_HEADER_SIZE) {
+            return false;
+        }
+
+        try {
+            {
+                std::filebuf fbuf;
+                if(!fbuf.open(path, std::ios_base::in | std::ios_base::out | std::ios_base::binary | std::ios_base::trunc)) {
+                    return false;
+                }
+
+                //  sparse; only what is recorded takes up disk
+                fbuf.pubseekoff(maxBytes - 1, std::ios_base::beg);
+                fbuf.sputc(0);
+            }
+
+            bip::file_mapping mapping(path.c_str(), bip::read_write);
+            m_region = bip::mapped_region(mapping, bip::read_write, 0, maxBytes);
+        } catch(const bip::interprocess_exception&) {
+            return false;
+        }
+
+        m_header    = static_cast<Header*>(m_region.get_address());
+        m_capacity  = maxBytes;
+        m_started   = std::chrono::steady_clock::now();
+
+        m_header->magic         = MAGIC;
+        m_header->version       = VERSION;
+        m_header->startedAt     = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        m_header->writeOffset   = HEADER_SIZE;
+        m_header->count         = 0;
+        m_header->dropped       = 0;
+
+        return true;
+    }
+
+    //  maps an existing capture read only, for replay
+    bool open(const std::string& path) {
+        namespace bip = boost::interprocess;
+
+        try {
+            bip::file_mapping mapping(path.c_str(), bip::read_only);
+            m_region = bip::mapped_region(mapping, bip::read_only);
+        } catch(const bip::interprocess_exception&) {
+            return false;
+        }
+
+        if(m_region.get_size() < HEADER_SIZE) {
+            return false;
+        }
+
+        m_header    = static_cast<Header*>(m_region.get_address());
+        m_capacity  = m_region.get_size();
+
+        const bool valid =
+            MAGIC == m_header->magic &&
+            VERSION == m_header->version &&
+            m_header->writeOffset >= HEADER_SIZE &&
+            m_header->writeOffset <= m_capacity;
+
+        if(!valid) {
+            m_header = nullptr;
+        }
+
+        return valid;
+    }
+
+    bool isOpen() const { return nullptr != m_header; }
+    size_t size() const { return m_header ? m_header->count : 0; }
+    uint64_t dropped() const { return m_header ? m_header->dropped : 0; }
+    size_t usedBytes() const { return m_header ? m_header->writeOffset - HEADER_SIZE : 0; }
+
+    //  wall clock time the capture began
+    std::chrono::system_clock::time_point startedAt() const {
+        return std::chrono::system_clock::time_point(std::chrono::duration_cast<std::chrono::system_clock::duration>(
+            std::chrono::nanoseconds(m_header ? m_header->startedAt : 0)));
+    }
+
+    //  false if the capture is full
+    bool record(const Direction direction, const Opcode opcode, const char* data, const size_t size) {
+        const size_t needed = RECORD_HEADER_SIZE + size;
+
+        if(size > std::numeric_limits<uint32_t>::max() || m_header->writeOffset + needed > m_capacity) {
+            ++m_header->dropped;
+            return false;
+        }
+
+        RecordHeader rh;
+        rh.timestamp    = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - m_started).count();
+        rh.size         = static_cast<uint32_t>(size);
+        rh.direction    = static_cast<uint8_t>(direction);
+        rh.opcode       = static_cast<uint8_t>(opcode);
+        rh.reserved     = 0;
+
+        char* const at = base() + m_header->writeOffset;
+
+        std::memcpy(at, &rh, sizeof(rh));
+        std::memcpy(at + RECORD_HEADER_SIZE, data, size);
+
+        m_header->writeOffset += needed;
+        ++m_header->count;
+        return true;
+    }
+
+    //
+    //  Reads the record at |offset| and advances it to the next one; start from
+    //  0. Returns false at the end of the capture.
+    //
+    bool next(size_t& offset, Frame& frame) const {
+        if(!m_header) {
+            return false;
+        }
+
+        if(offset < HEADER_SIZE) {
+            offset = HEADER_SIZE;
+        }
+
+        if(offset + RECORD_HEADER_SIZE > m_header->writeOffset) {
+            return false;
+        }
+
+        RecordHeader rh;
+        std::memcpy(&rh, base() + offset, sizeof(rh));
+
+        if(offset + RECORD_HEADER_SIZE + rh.size > m_header->writeOffset) {
+            return false;   //  torn record
+        }
+
+        frame.timestamp = std::chrono::nanoseconds(rh.timestamp);
+        frame.direction = static_cast<Direction>(rh.direction);
+        frame.opcode    = static_cast<Opcode>(rh.opcode);
+        frame.data      = base() + offset + RECORD_HEADER_SIZE;
+        frame.size      = rh.size;
+
+        offset += RECORD_HEADER_SIZE + rh.size;
+        return true;
+    }
+
+    void flush() {
+        if(m_header && m_region.get_mode() == boost::interprocess::read_write) {
+            m_region.flush(0, 0, true);
+        }
+    }
+
+private:
+    struct Header {
+        uint32_t    magic;
+        uint32_t    version;
+        uint64_t    startedAt;      //  system clock, ns since the epoch
+        uint64_t    writeOffset;
+        uint64_t    count;
+        uint64_t    dropped;
+    };
+
+    struct RecordHeader {
+        uint64_t    timestamp;
+        uint32_t    size;
+        uint8_t     direction;
+        uint8_t     opcode;
+        uint16_t    reserved;
+    };
+
+    static const uint32_t   MAGIC               = 0x50414353;   //  "SCAP"
+    static const uint32_t   VERSION             = 1;
+    static const size_t     HEADER_SIZE         = 64;
+    static const size_t     RECORD_HEADER_SIZE  = sizeof(RecordHeader);
+
+    char* base() const { return static_cast<char*>(m_region.get_address()); }
+
+    boost::interprocess::mapped_region      m_region;
+    Header*                                 m_header;
+    size_t                                  m_capacity;
+    std::chrono::steady_clock::time_point   m_started;
+};
+
+//
+//  Record every complete WebSocket message, in & out, to a WireCapture at |path|
+//  from the next connect(). Messages handed to an IMessageStreamHandler are not
+//  recorded. See SCSocket::replay().
+//
+class CaptureOptions {
+public:
+    CaptureOptions()
+        : maxBytes(256 * 1024 * 1024)
+    {
+    }
+
+    std::string     path;   //  empty disables capture
+    size_t          maxBytes;
+};
+
+//
+//  SCSocket::replay() pacing: |speed| 1 keeps the recorded gaps between messages,
+//  2 halves them and so on; 0 replays as fast as the socket can dispatch.
+//
+class ReplayOptions {
+public:
+    ReplayOptions()
+        : speed(0)
+    {
+    }
+
+    double          speed;
+};
+
+struct ReplayStats {
+    uint64_t                    messages;   //  inbound messages fed through the socket
+    uint64_t                    bytes;
+    std::chrono::nanoseconds    elapsed;
+};
+
+//
+//  Log-linear histogram in the spirit of HdrHistogram: 16 linear sub-buckets per
+//  power of two, so any recorded value is reported within ~6% of its true value.
+//  Values are clamped to 2^40. Not thread safe.
+//
+class LatencyHistogram {
+public:
+    LatencyHistogram()
+        : m_count(0)
+        , m_sum(0)
+        , m_min(std::numeric_limits<uint64_t>::max())
+        , m_max(0)
+    {
+        m_buckets.fill(0);
+    }
+
+    void record(uint64_t value) {
+        if(value > MAX_VALUE) {
+            value = MAX_VALUE;
+        }
+
+        ++m_buckets[bucketIndex(value)];
+        ++m_count;
+        m_sum += value;
+        m_min = std::min(m_min, value);
+        m_max = std::max(m_max, value);
+    }
+
+    void merge(const LatencyHistogram& other) {
+        for(size_t i = 0; i < BUCKETS; ++i) {
+            m_buckets[i] += other.m_buckets[i];
+        }
+
+        m_count += other.m_count;
+        m_sum   += other.m_sum;
+        m_min   = std::min(m_min, other.m_min);
+        m_max   = std::max(m_max, other.m_max);
+    }
+
+    uint64_t count() const { return m_count; }
+    uint64_t min() const { return m_count ? m_min : 0; }
+    uint64_t max() const { return m_max; }
+    double mean() const { return m_count ? static_cast<double>(m_sum) / m_count : 0; }
+
+    //  |p| in [0, 100]; the upper bound of the bucket holding that rank
+    uint64_t percentile(const double p) const {
+        if(0 == m_count) {
+            return 0;
+        }
+
+        const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(p / 100.0 * m_count)));
+
+        uint64_t seen = 0;
+        for(size_t i = 0; i < BUCKETS; ++i) {
+            seen += m_buckets[i];
+            if(seen >= rank) {
+                return std::min(bucketUpperBound(i), m_max);
+            }
+        }
+
+        return m_max;
+    }
+
+private:
+    static const size_t     SUB_BUCKET_BITS = 4;
+    static const size_t     SUB_BUCKETS     = 1 << SUB_BUCKET_BITS;
+    static const size_t     MAX_MAGNITUDE   = 40;
+    static const size_t     BUCKETS         = (MAX_MAGNITUDE - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+    static constexpr uint64_t MAX_VALUE     = (uint64_t(1) << MAX_MAGNITUDE) - 1;
+
+    static size_t bucketIndex(const uint64_t value) {
+        if(value < SUB_BUCKETS) {
+            return static_cast<size_t>(value);
+        }
+
+        size_t magnitude = SUB_BUCKET_BITS;
+        while(value >> (magnitude + 1)) {
+            ++magnitude;
+        }
+
+        const size_t shift = magnitude - SUB_BUCKET_BITS;
+        return (shift + 1) * SUB_BUCKETS + static_cast<size_t>((value >> shift) - SUB_BUCKETS);
+    }
+
+    static uint64_t bucketUpperBound(const size_t index) {
+        if(index < SUB_BUCKETS) {
+            return index;
+        }
+
+        const size_t shift  = index / SUB_BUCKETS - 1;
+        const uint64_t sub  = SUB_BUCKETS + index % SUB_BUCKETS;
+        return ((sub + 1) << shift) - 1;
+    }
+
+    std::array<uint64_t, BUCKETS>   m_buckets;
+    uint64_t                        m_count;
+    uint64_t                        m_sum;
+    uint64_t                        m_min;
+    uint64_t                        m_max;
+};
+
+//
+//  Ack latency of emits with a response handler, in microseconds. |queueWait| runs
+//  from emit() until the request is written, |network| from then until the ack is
+//  read; |total| covers both.
+//
+struct RpcLatency {
+    LatencyHistogram    total;
+    LatencyHistogram    queueWait;
+    LatencyHistogram    network;
+
+    void merge(const RpcLatency& other) {
+        total.merge(other.total);
+        queueWait.merge(other.queueWait);
+        network.merge(other.network);
+    }
+};
+
+typedef std::map<std::string, RpcLatency> RpcLatencyByEvent;
+
+//
+//  Per event name latency is opt-in; once |maxEventNames| names are tracked the
+//  rest are pooled under OTHER_EVENTS.
+//
+class RpcLatencyOptions {
+public:
+    RpcLatencyOptions()
+        : perEventName(false)
+        , maxEventNames(32)
+    {
+    }
+
+    static const char* OTHER_EVENTS() { return "*"; }
+
+    bool            perEventName;
+    size_t          maxEventNames;
+};
+
+//
+//  Every handler runs inline on the socket's io thread, so a slow one delays
+//  everything else, pings included. Every |lagCheckInterval| ms a timer measures
+//  how late the io loop runs it and fires LoopLagEvent past |lagThreshold| ms;
+//  handlers running longer than |slowHandlerThreshold| fire SlowHandlerEvent.
+//  0 disables either check.
+//
+class WatchdogOptions {
+public:
+    WatchdogOptions()
+        : lagCheckInterval(0)
+        , lagThreshold(100)
+        , slowHandlerThreshold(0)
+    {
+    }
+
+    uint32_t        lagCheckInterval;       //  milliseconds
+    uint32_t        lagThreshold;           //  milliseconds
+    uint32_t        slowHandlerThreshold;   //  microseconds
+};
+
+//
+//  Channels left pending by a disconnect are resubscribed in a pipelined burst
+//  right behind #handshake, keeping at most |maxInFlight| #subscribe calls
+//  outstanding. A single |timeout| (ms) covers the whole burst rather than one
+//  ack timer per channel.
+//
+class ResubscribeOptions {
+public:
+    ResubscribeOptions()
+        : maxInFlight(512)
+        , timeout(30000)
+    {
+    }
+
+    size_t          maxInFlight;
+    uint32_t        timeout;    //  milliseconds
+};
+
+namespace detail {
+    class SocketTimer;  //  forward
+}
+
+//
+//  Manually advanced time for SCSocket's protocol timers (ping & ack timeouts,
+//  reconnect backoff, admission polls, resubscribe timeouts, spool replay), so
+//  tests can step over them instead of sleeping; see ConnectOptions::setVirtualClock.
+//  Time starts at 0 and only moves in advance(). Connect attempt timeouts, the
+//  loop lag watchdog and replay pacing stay on real time.
+//
+class VirtualClock
+    : private boost::noncopyable
+{
+public:
+    typedef std::function<void(const boost::system::error_code&)>  WaitHandler;
+    typedef uint64_t                                                TimerId;
+
+    VirtualClock()
+        : m_now(0)
+        , m_nextId(1)
+    {
+    }
+
+    boost::posix_time::time_duration now() const {
+        boost::lock_guard<boost::mutex> lock(m_lock);
+        return boost::posix_time::microseconds(m_now);
+    }
+
+    //
+    //  Moves time on by |d|. Each timer that falls due is posted, in expiry order,
+    //  to its io_service; run or poll it to see them. Timers armed by those
+    //  handlers are not due until a later advance().
+    //
+    void advance(const boost::posix_time::time_duration& d) {
+        boost::lock_guard<boost::mutex> lock(m_lock);
+
+        m_now += d.total_microseconds();
+
+        while(!m_timers.empty() && m_timers.begin()->first.first <= m_now) {
+            const auto it = m_timers.begin();
+
+            it->second.ios->post(std::bind(it->second.handler, boost::system::error_code()));
+
+            m_timerKeys.erase(it->first.second);
+            m_timers.erase(it);
+        }
+    }
+
+    size_t pendingTimers() const {
+        boost::lock_guard<boost::mutex> lock(m_lock);
+        return m_timers.size();
+    }
+
+private:
+    friend class detail::SocketTimer;
+
+    typedef std::pair<int64_t, TimerId> Key;    //  expiry (us), then order of scheduling
+
+    struct Entry {
+        boost::asio::io_service*    ios;
+        WaitHandler                 handler;
+    };
+
+    TimerId schedule(boost::asio::io_service& ios, const boost::posix_time::time_duration& expiry, WaitHandler handler) {
+        boost::lock_guard<boost::mutex> lock(m_lock);
+
+        const TimerId id    = m_nextId++;
+        const Key key       = std::make_pair(expiry.total_microseconds(), id);
+        const Entry entry   = { &ios, handler };
+
+        m_timers[key]   = entry;
+        m_timerKeys[id] = key;
+        return id;
+    }
+
+    void cancel(const TimerId id) {
+        boost::lock_guard<boost::mutex> lock(m_lock);
+
+        const auto key = m_timerKeys.find(id);
+        if(m_timerKeys.end() == key) {
+            return; //  already fired
+        }
+
+        const auto it = m_timers.find(key->second);
+        it->second.ios->post(std::bind(it->second.handler, boost::system::error_code(boost::asio::error::operation_aborted)));
+
+        m_timers.erase(it);
+        m_timerKeys.erase(key);
+    }
+
+    mutable boost::mutex        m_lock;
+    int64_t                     m_now;  //  microseconds
+    TimerId                     m_nextId;
+    std::map<Key, Entry>        m_timers;
+    std::map<TimerId, Key>      m_timerKeys;
+};
+
+namespace detail {
+    //
+    //  The subset of deadline_timer SCSocket uses, on real time or, when given one,
+    //  on a VirtualClock.
+    //
+    class SocketTimer
+        : private boost::noncopyable
+    {
+    public:
+        SocketTimer(boost::asio::io_service& ios, std::shared_ptr<VirtualClock> clock)
+            : m_ios(ios)
+            , m_clock(clock)
+            , m_timer(ios)
+        {
+        }
+
+        SocketTimer(boost::asio::io_service& ios, std::shared_ptr<VirtualClock> clock, const boost::posix_time::time_duration& d)
+            : SocketTimer(ios, clock)
+        {
+            expires_from_now(d);
+        }
+
+        void expires_from_now(const boost::posix_time::time_duration& d) {
+            if(!m_clock) {
+                m_timer.expires_from_now(d);
+                return;
+            }
+
+            cancel();
+            m_expiry = m_clock->now() + d;
+        }
+
+        void async_wait(VirtualClock::WaitHandler handler) {
+            if(!m_clock) {
+                m_timer.async_wait(handler);
+                return;
+            }
+
+            m_waits.push_back(m_clock->schedule(m_ios, m_expiry, handler));
+        }
+
+        void cancel() {
+            if(!m_clock) {
+                m_timer.cancel();
+                return;
+            }
+
+            for(const auto id : m_waits) {
+                m_clock->cancel(id);
+            }
+            m_waits.clear();
+        }
+
+    private:
+        boost::asio::io_service&            m_ios;
+        std::shared_ptr<VirtualClock>       m_clock;
+        boost::asio::deadline_timer         m_timer;
+        boost::posix_time::time_duration    m_expiry;
+        std::vector<VirtualClock::TimerId>  m_waits;
+    };
+}   //  end detail ns
+
+class ConnectOptions {
+public:
+    ConnectOptions()
+        : host("localhost")
+        , port("http")
+        , secure(false)
+        , path("/socketcluster/")
+        , autoReconnect(true)
+        , ackTimeout(10)
+        , codecEngine(nullptr)
+        , inboxCapacity(0)
+        , maxMessageSize(16 * 1024 * 1024)
+        , streamThreshold(0)
+        , readBatchBudget(64)
+        , manualIo(false)
+    {       
+    }
+
+    ConnectOptions& setHost(const std::string& h) {
+        host = h;
+        return *this;
+    }
+
+    ConnectOptions& setPort(const std::string& p) {
+        port = p;
+        return *this;
+    }
+
+    ConnectOptions& setSecure(const bool enableSecure = true) {
+        secure = enableSecure;
+        return *this;
+    }
+
+    ConnectOptions& setPath(const std::string& p) {
+        path = p;
+        return *this;
+    }
+
+    ConnectOptions& setAutoReconnect(const bool r) {
+        autoReconnect = r;
+        return *this;
+    }
+
+    ConnectOptions& setAckTimeout(const uint32_t t) {
+        ackTimeout = t;
+        return *this;
+    }
+
+    ConnectOptions& setPerMessageDeflate(const bool enabled) {
+        perMessageDeflateOpts.client_enable = enabled;
+        return *this;
+    }
+
+    ConnectOptions& setPerMessageDeflate(const websocket::permessage_deflate& pmd) {
+        perMessageDeflateOpts = pmd;
+        return *this;
+    }
+
+    ConnectOptions& setCodecEngine(std::shared_ptr<ICodecEngine> ce) {
+        codecEngine = ce;
+        return *this;
+    }
+
+    ConnectOptions& setUserAgent(const std::string& ua) {
+        userAgent = ua;
+        return *this;
+    }
+
+    ConnectOptions& setInboxCapacity(const size_t capacity) {
+        inboxCapacity = capacity;
+        return *this;
+    }
+
+    ConnectOptions& setReadSize(const size_t initialSize, const size_t maxSize, const bool adaptive = true) {
+        readBufferOptions.initialReadSize   = initialSize;
+        readBufferOptions.maxReadSize       = maxSize;
+        readBufferOptions.adaptive          = adaptive;
+        return *this;
+    }
+
+    ConnectOptions& setReadBatchBudget(const size_t budget) {
+        readBatchBudget = budget;
+        return *this;
+    }
+
+    ConnectOptions& setTransportOptions(const TransportOptions& opts) {
+        transportOptions = opts;
+        return *this;
+    }
+
+    ConnectOptions& setConnectTimeout(const uint32_t t) {
+        connectAttemptOptions.timeout = t;
+        return *this;
+    }
+
+    ConnectOptions& setMaxMessageSize(const size_t size) {
+        maxMessageSize = size;
+        return *this;
+    }
+
+    ConnectOptions& setMessageStreamHandler(std::shared_ptr<IMessageStreamHandler> handler, const size_t threshold) {
+        streamHandler   = handler;
+        streamThreshold = threshold;
+        return *this;
+    }
+
+    ConnectOptions& setWatchdog(const uint32_t lagCheckInterval, const uint32_t lagThreshold, const uint32_t slowHandlerThreshold) {
+        watchdogOptions.lagCheckInterval        = lagCheckInterval;
+        watchdogOptions.lagThreshold            = lagThreshold;
+        watchdogOptions.slowHandlerThreshold    = slowHandlerThreshold;
+        return *this;
+    }
+
+    ConnectOptions& setOfflineSpool(const std::string& path, const size_t maxBytes = 64 * 1024 * 1024) {
+        spoolOptions.path       = path;
+        spoolOptions.maxBytes   = maxBytes;
+        return *this;
+    }
+
+    ConnectOptions& setWireCapture(const std::string& path, const size_t maxBytes = 256 * 1024 * 1024) {
+        captureOptions.path     = path;
+        captureOptions.maxBytes = maxBytes;
+        return *this;
+    }
+
+    //  a fresh transport per connect attempt; host, port, TLS & deflate options are then unused
+    ConnectOptions& setTransport(MessageTransportFactory factory) {
+        transportFactory = factory;
+        return *this;
+    }
+
+    ConnectOptions& setVirtualClock(std::shared_ptr<VirtualClock> clock) {
+        virtualClock = clock;
+        return *this;
+    }
+
+    ConnectOptions& setManualIo(const bool manual = true) {
+        manualIo = manual;
+        return *this;
+    }
+
+    ConnectOptions& setInboundByteBudget(const size_t maxBytes, const size_t resumeBytes = 0) {
+        backpressure.maxInboundBytes    = maxBytes;
+        backpressure.resumeInboundBytes = resumeBytes;
+        return *this;
+    }
+
+    std::string                     host;
+    std::string                     port;
+    std::string                     userAgent;
+    bool                            secure; //  SSL/TLS?
+    std::string                     path;
+    bool                            autoReconnect;
+    AutoReconnectOptions            autoReconnectOptions;
+    uint32_t                        ackTimeout;
+    SecureConnectOptions            secureOptions;
+    std::shared_ptr<ICodecEngine>   codecEngine;
+    websocket::permessage_deflate   perMessageDeflateOpts;
+    size_t                          inboxCapacity;  //  >0 enables a socket-wide pull inbox for all publishes
+    BackpressureOptions             backpressure;
+    ReadBufferOptions               readBufferOptions;
+    size_t                          maxMessageSize;     //  bytes; 0 = unlimited. Larger messages are rejected early
+    std::shared_ptr<IMessageStreamHandler>  streamHandler;
+    size_t                          streamThreshold;    //  bytes buffered before a message is handed to streamHandler
+    size_t                          readBatchBudget;    //  max batched packets dispatched before yielding to the io loop
+    std::shared_ptr<ResolverCache>  resolverCache;      //  SocketClusterClient shares one across its sockets if unset
+    ConnectAttemptOptions           connectAttemptOptions;
+    TransportOptions                transportOptions;
+    std::shared_ptr<ConnectAdmission>   connectAdmission;   //  set by SocketClusterClient when it limits connects
+    ResubscribeOptions              resubscribeOptions;
+    SpoolOptions                    spoolOptions;
+    RpcLatencyOptions               rpcLatencyOptions;
+    WatchdogOptions                 watchdogOptions;
+    CaptureOptions                  captureOptions;
+    MessageTransportFactory         transportFactory;   //  replaces TCP/TLS/WebSocket when set
+    std::shared_ptr<VirtualClock>   virtualClock;       //  protocol timers run on it when set
+    bool                            manualIo;           //  connect() starts no io thread; drive the socket with poll()
+};
+
+struct ConnectStats {
+    ConnectStats()
+        : attemptIndex(0)
+        , attemptsStarted(0)
+        , elapsed(0)
+    {
+    }
+
+    tcp::endpoint               endpoint;           //  the endpoint that won
+    size_t                      attemptIndex;       //  its position in the attempt order
+    size_t                      attemptsStarted;
+    std::chrono::milliseconds   elapsed;            //  from first attempt to established
+};
+
+struct ReadStats {
+    uint64_t        wakeups;                //  read completions that carried a complete message
+    uint64_t        messages;               //  packets dispatched
+    uint64_t        maxMessagesPerWakeup;
+};
+
+//
+//  Point-in-time copy of a socket's counters, see SCSocket::snapshot(). Byte counts
+//  are WebSocket message payloads, i.e. before permessage-deflate. Gauges are
+//  sampled by the io thread as it services the socket. The out queue is gauged in
+//  messages only: they are encoded as they are written, not when queued.
+//
+struct SocketMetrics {
+    uint64_t        messagesIn;             //  complete WebSocket messages, pings included
+    uint64_t        bytesIn;
+    uint64_t        messagesOut;
+    uint64_t        bytesOut;
+
+    //  inbound packets by protocol type
+    uint64_t        publishesIn;
+    uint64_t        eventsIn;
+    uint64_t        acksIn;
+    uint64_t        handshakesIn;
+    uint64_t        authTokenUpdatesIn;     //  #setAuthToken & #removeAuthToken
+    uint64_t        unknownIn;
+
+    uint64_t        pings;
+    uint64_t        lastPingIntervalMs;
+
+    uint64_t        ackTimeouts;
+    uint64_t        reconnects;             //  reconnect attempts scheduled
+    uint64_t        decodeErrors;           //  undecodable or malformed packets
+
+    uint64_t        outQueueDepth;          //  gauge
+    uint64_t        pendingResponses;       //  gauge
+
+    uint64_t        slowHandlers;
+    uint64_t        maxLoopLagMs;
+
+    ReadStats       read;
+
+    SocketMetrics& operator+=(const SocketMetrics& other) {
+        messagesIn              += other.messagesIn;
+        bytesIn                 += other.bytesIn;
+        messagesOut             += other.messagesOut;
+        bytesOut                += other.bytesOut;
+        publishesIn             += other.publishesIn;
+        eventsIn                += other.eventsIn;
+        acksIn                  += other.acksIn;
+        handshakesIn            += other.handshakesIn;
+        authTokenUpdatesIn      += other.authTokenUpdatesIn;
+        unknownIn               += other.unknownIn;
+        pings                   += other.pings;
+        lastPingIntervalMs      = std::max(lastPingIntervalMs, other.lastPingIntervalMs);
+        ackTimeouts             += other.ackTimeouts;
+        reconnects              += other.reconnects;
+        decodeErrors            += other.decodeErrors;
+        outQueueDepth           += other.outQueueDepth;
+        pendingResponses        += other.pendingResponses;
+        slowHandlers            += other.slowHandlers;
+        maxLoopLagMs            = std::max(maxLoopLagMs, other.maxLoopLagMs);
+        read.wakeups            += other.read.wakeups;
+        read.messages           += other.read.messages;
+        read.maxMessagesPerWakeup = std::max(read.maxMessagesPerWakeup, other.read.maxMessagesPerWakeup);
+        return *this;
+    }
+};
+//
+//  What happens to an emit still awaiting its response when the connection drops
+//
+enum class DisconnectPolicy {
+    FAIL_FAST,  //  respond right away with a |disconnected| error
+    RETRY,      //  retransmit with a fresh cid once reconnected; the event must be idempotent.
+                //  Fails with |disconnected| if not reconnected within |ackTimeout| of the emit
+};
+
+class EmitOptions {
+public:
+    EmitOptions()
+        : noTimeout(false)
+        , disconnectPolicy(DisconnectPolicy::FAIL_FAST)
+    {
+    }
+
+    EmitOptions& setNoTimeout(const bool n = true) {
+        noTimeout = n;
+        return *this;
+    }
+
+    EmitOptions& setDisconnectPolicy(const DisconnectPolicy policy) {
+        disconnectPolicy = policy;
+        return *this;
+    }
+
+    bool                noTimeout;
+    DisconnectPolicy    disconnectPolicy;
+};
+
+class SCSocket
+    : public std::enable_shared_from_this<SCSocket>
+{
+public:
+    enum EventHandlerIds {
+        RawEvent,
+
+        ErrorEvent,
+
+        ConnectingEvent,
+        ConnectEvent,
+        ConnectAbortEvent,
+        DisconnectEvent,
+
+        AuthenticateEvent,
+        AuthTokenChangeEvent,
+        DeauthenticateEvent,
+
+        SubscribeEvent,
+        SubscribeFailEvent,
+        SubscriptionStateChangeEvent,
+        UnsubscribeEvent,
+
+        EmitEvent,
+
+        ReadPausedEvent,
+        ReadResumedEvent,
+
+        ResubscribeCompleteEvent,
+
+        SlowHandlerEvent,
+        LoopLagEvent
+    };
+
+    //  SlowHandlerInfo::handlerId of an emit's response handler
+    static const size_t ResponseHandlerId = LoopLagEvent + 1;
+
+    typedef std::function<void(boost::system::error_code ec, const json& resp)> ResponseHandler;
+
+    enum class State {
+        CLOSED,
+        CONNECTING,
+        OPEN
+    };
+
+    enum class AuthState {
+        UNAUTHENTICATED,
+        AUTHENTICATED,
+    };
+
+    typedef std::map<std::string, SCChannelPtr> ChannelSubscriptions;
+
+    explicit SCSocket(const ConnectOptions& connectOptions)
+        : m_state(State::CLOSED)
+        , m_connectOptions(connectOptions)
+        , m_resolver(m_ios)
+        , m_sslContext(connectOptions.secureOptions.context)
+        , m_readSize(
+            connectOptions.readBufferOptions.initialReadSize,
+            connectOptions.readBufferOptions.maxReadSize,
+            connectOptions.readBufferOptions.adaptive)
+        , m_nextCallId(1)
+        , m_nextOutSeq(0)
+        , m_pongSeq(0)
+        , m_writeSeq(0)
+        , m_currentOutCid(0)
+        , m_retainedTimer(m_ios, connectOptions.virtualClock)
+        , m_handshakeCallId(0)
+        , m_connectAttempts(0)
+        , m_pingTimeout(connectOptions.ackTimeout * 1000)   //  seconds -> ms
+        , m_pingTimeoutTimer(m_ios, connectOptions.virtualClock)
+        , m_readPaused(false)
+        , m_readStalled(false)
+        , m_pumpRunning(false)
+        , m_writeInFlight(false)
+        , m_pongPending(false)
+        , m_streamingMessage(false)
+        , m_streamedBytes(0)
+        , m_resumePosted(false)
+        , m_inboundBytes(0)
+        , m_inboundBatchPos(0)
+        , m_inboundBatchPacketSize(0)
+        , m_inboundBatchDispatched(0)
+        , m_readWakeups(0)
+        , m_readMessages(0)
+        , m_maxMessagesPerWakeup(0)
+        , m_lastReconnectDelay(0)
+        , m_admissionTimer(m_ios, connectOptions.virtualClock)
+        , m_awaitingAdmission(false)
+        , m_holdsAdmission(false)
+        , m_admissionToken(0)
+        , m_admissionAttempt(0)
+        , m_resolveInFlight(false)
+        , m_refreshInFlight(false)
+        , m_resubscribeTimer(m_ios, connectOptions.virtualClock)
+        , m_resubscribeGeneration(0)
+        , m_handshakeDone(false)
+        , m_spoolReplayTimer(m_ios, connectOptions.virtualClock)
+        , m_spoolReplayStalled(false)
+        , m_loopLagTimer(m_ios)
+        , m_loopLagTimerStarted(false)
+        , m_replayOffset(0)
+        , m_replayTimer(m_ios)
+    {
+        if(connectOptions.inboxCapacity) {
+            m_inbox.reset(new Inbox(connectOptions.inboxCapacity));
+        }
+
+        if(connectOptions.secure && connectOptions.secureOptions.context && !connectOptions.transportFactory) {
+            resetSecureStream();
+        } else {
+            m_ws.reset(new WebSocket(m_ios));
+
+            setPerMessageDeflate(m_ws);
+            setReadMessageMax(m_ws);
+
+            m_connectOptions.secure = false;    //  we have no SSL context
+
+            m_ws->binary(haveBinaryCodec());
+        }
+    }
+
+    void connect() {
+        if(State::CLOSED != m_state) {
+            return;
+        }
+
+        if(!m_connectOptions.spoolOptions.path.empty() && !m_spool) {
+            std::unique_ptr<OfflineSpool> spool(new OfflineSpool());
+            if(spool->open(m_connectOptions.spoolOptions.path, m_connectOptions.spoolOptions.maxBytes)) {
+                m_spool = std::move(spool);
+            } else {
+                triggerEvent<ErrorEvent>(make_error_code(spool_unavailable));
+            }
+        }
+
+        const CaptureOptions& captureOpts = m_connectOptions.captureOptions;
+        if(!captureOpts.path.empty() && !m_capture) {
+            std::unique_ptr<WireCapture> capture(new WireCapture());
+            if(capture->create(captureOpts.path, captureOpts.maxBytes)) {
+                m_capture = std::move(capture);
+            } else {
+                triggerEvent<ErrorEvent>(make_error_code(capture_unavailable));
+            }
+        }
+
+        startConnect();
+
+        if(!m_loopLagTimerStarted) {
+            m_loopLagTimerStarted = true;
+            startLoopLagTimer();
+        }
+
+        if(m_connectOptions.manualIo) {
+            return;
+        }
+
+        //
+        //  Connecting again after a disconnect: a loop still running has picked up the
+        //  new attempt, otherwise it ran out of work and its thread is done.
+        //
+        if(m_iosThread.joinable()) {
+            if(!m_ios.stopped()) {
+                return;
+            }
+            m_iosThread.join();
+        }
+
+        m_ios.reset();
+        m_iosThread = boost::thread(std::bind(&SCSocket::ioThread, shared_from_this()));
+    }
+
+    //
+    //  ConnectOptions::manualIo: runs every ready handler on the calling thread,
+    //  including those they queue, and returns how many ran. With a MemoryTransport
+    //  and a VirtualClock a test can step the socket deterministically.
+    //
+    size_t poll() {
+        m_ios.reset();
+        return m_ios.poll();
+    }
+
+    boost::system::error_code close() {
+        m_state = State::CLOSED;
+        //  :TODO: we shoudl be using teardown? http://vinniefalco.github.io/beast/beast/ref/beast__websocket__async_teardown/overload2.html
+        boost::system::error_code ec;
+
+        if(m_transport) {
+            m_transport->close();
+        } else if(m_connectOptions.secure) {
+            m_wss->close(websocket::close_code::normal, ec);
+        } else {
+            m_ws->close(websocket::close_code::normal, ec);
+        }
+    
+        m_ios.stop();
+        m_iosThread.join();
+
+        abandonResolves();
+        cancelAdmission();
+
+        //  the io thread is gone; nobody will answer these
+        settlePendingResponses(false);
+
+        return ec;
+    }
+
+    //
+    //  Feeds the inbound messages of a WireCapture (see ConnectOptions::setWireCapture)
+    //  through the same decode & dispatch path as live reads, with no network, and
+    //  returns once all have been dispatched. Handlers, inboxes and metrics see them
+    //  as they would live; subscribe() first so publishes reach their channels. What
+    //  the socket would send in reply is encoded and dropped, so recorded acks have
+    //  nothing to answer and raise unexpected_rid. Runs the io loop on the calling
+    //  thread: the socket must be closed and not connected since, or close()d.
+    //
+    boost::system::error_code replay(
+        const std::string& path, ReplayStats& stats, const ReplayOptions& opts = ReplayOptions())
+    {
+        if(State::CLOSED != m_state || m_iosThread.joinable() || m_replayCapture) {
+            return boost::asio::error::already_started;
+        }
+
+        std::unique_ptr<WireCapture> capture(new WireCapture());
+        if(!capture->open(path)) {
+            return make_error_code(capture_unavailable);
+        }
+
+        m_replayCapture         = std::move(capture);
+        m_replayOptions         = opts;
+        m_replayOffset          = 0;
+        m_replayStats           = ReplayStats();
+        m_replayFirstTimestamp  = std::chrono::nanoseconds(-1);
+        m_replayStarted         = std::chrono::steady_clock::now();
+
+        m_ios.reset();
+        m_ios.post(std::bind(&SCSocket::replayNext, shared_from_this()));
+
+        {
+            //  an inbox consumer on another thread may resume a paused replay
+            boost::asio::io_service::work work(m_ios);
+            m_ios.run();
+        }
+
+        m_ios.reset();
+
+        //  replay has no peer to answer these
+        settlePendingResponses(false);
+
+        stats = m_replayStats;
+        return boost::system::error_code();
+    }
+
+    template <typename EmitData>
+    void emit(
+        const std::string& eventName, const EmitData& data, const ResponseHandler respHandler = 0,
+        const bool noTimeout = false)
+    {
+        emit(eventName, data, respHandler, EmitOptions().setNoTimeout(noTimeout));
+    }
+
+    template <typename EmitData>
+    void emit(
+        const std::string& eventName, const EmitData& data, const ResponseHandler respHandler,
+        const EmitOptions& emitOpts)
+    {
+
+        //  :TODO: should we connect if not already connected here? https://github.com/SocketCluster/socketcluster-client/blob/01a66770ea74b0f6185d7c59ea64b3d8bef078c6/lib/scsocket.js#L680
+
+        auto self(shared_from_this());
+
+        //  dispatch to our io thread
+        m_ios.dispatch( [ self, this, eventName, data, respHandler, emitOpts ]() {
+
+            json payload = {
+                { "event",  eventName },
+                { "data",   data }
+            };
+
+            if(respHandler) {
+                ResponseItem respItem;
+                respItem.handler    = respHandler;
+                respItem.options    = emitOpts;
+                respItem.enqueuedAt = LatencyClock::now();
+
+                if(m_connectOptions.rpcLatencyOptions.perEventName) {
+                    respItem.eventName = eventName;
+                }
+
+                if(DisconnectPolicy::RETRY == emitOpts.disconnectPolicy) {
+                    respItem.payload = payload; //  cid-less copy for retransmission
+
+                    if(!emitOpts.noTimeout) {
+                        respItem.deadline = timerNow() + boost::posix_time::seconds(m_connectOptions.ackTimeout);
+                    }
+                }
+
+                payload["cid"] = trackResponse(respItem);
+            } else if(shouldSpool(payload)) {
+                return spoolMessage(payload);
+            }
+
+            queueOut(payload);
+
+            startWrite();
+        });
+    }
+
+    void handleEmitAckTimeout(const CallId cid) {
+        try {
+            const ResponseItem respItem = m_pendingResponses.at(cid);
+            m_pendingResponses.erase(cid);
+
+            MetricCounters::inc(m_metrics.ackTimeouts);
+        
+            std::stringstream ackTimeoutErrMsg;
+            ackTimeoutErrMsg << "no ack for call id (cid) " << std::dec << cid;
+
+            const json errorInfo = {
+                { "error", {
+                    { "message", ackTimeoutErrMsg.str() }
+                }}
+            };
+
+            invokeResponseHandler(respItem, make_error_code(ack_timeout), errorInfo);
+        } catch(std::out_of_range) {
+        }       
+    }
+
+    template <size_t HandlerId, typename ...Args>
+    boost::signals2::connection on(Args&& ...args) {
+        return std::get<HandlerId>(m_eventTable).connect(std::forward<Args>(args)...);
+    }
+
+    SCChannelPtr subscribe(const std::string& channelName, const ChannelSubscriptionOptions& channelSubOptions = ChannelSubscriptionOptions()) {
+        //  :TODO: support waitForAuth - see https://github.com/SocketCluster/socketcluster-client/blob/01a66770ea74b0f6185d7c59ea64b3d8bef078c6/lib/scsocket.js
+
+        SCChannelPtr channel;
+
+        try {
+            channel = m_channels.at(channelName);
+        } catch(std::out_of_range) {            
+            channel.reset(new SCChannel(channelName, shared_from_this()));
+
+            if(channelSubOptions.inboxCapacity) {
+                channel->m_inbox.reset(new SCChannel::Inbox(channelSubOptions.inboxCapacity));
+            }
+
+            m_channels[channelName] = channel;
+        }
+
+        //
+        //  An existing channel keeps the inbox it was created with: a consumer may
+        //  be draining it, so it cannot be swapped out from under them.
+        //
+        if(channelSubOptions.inboxCapacity && !channel->hasInboxCapacity(channelSubOptions.inboxCapacity)) {
+            const boost::system::error_code ec = make_error_code(inbox_mismatch);
+
+            channel->triggerEvent<SCChannel::SubscribeFailEvent>(channelName, ec);
+            triggerEvent<SubscribeFailEvent>(channelName, ec);
+
+            return channel;
+        }
+
+        if(ChannelState::UNSUBSCRIBED == channel->getState()) {
+            channel->m_state        = ChannelState::PENDING;
+            channel->m_subOptions   = channelSubOptions;
+            tryChannelSubscribe(channel, channelSubOptions);
+        }
+
+        return channel;
+    }
+
+    void unsubscribe(const std::string& channelName) {
+        try {
+            const auto channel = m_channels.at(channelName);
+
+            if(ChannelState::UNSUBSCRIBED != channel->getState()) {
+                triggerChannelUnsubscribe(channel);
+                sendChannelUnsubscribe(channel);
+            }
+        } catch(std::out_of_range) {
+        }   
+    }
+
+    void destroyChannel(const std::string& channelName) {
+        try {
+            auto channel = m_channels.at(channelName);
+            
+            channel->unwatch();
+            channel->unsubscribe();
+
+            m_channels.erase(channelName);
+        } catch(std::out_of_range) {            
+        }
+    }
+
+    void unwatch(const std::string& channelName) {
+        try {
+            auto channel = m_channels.at(channelName);
+            channel->unwatch();
+        } catch(std::out_of_range) {            
+        }
+    }
+
+    void unwatch(const std::string& channelName, const boost::signals2::connection& conn) {
+        try {
+            auto channel = m_channels.at(channelName);
+            channel->unwatch(conn);
+        } catch(std::out_of_range) {            
+        }
+    }
+
+    boost::system::error_code disconnect() {
+        boost::system::error_code ec;
+
+        if(m_transport) {
+            m_transport->close();
+        } else if(m_connectOptions.secure) {
+            m_wss->close(websocket::close_code::normal, ec);
+        } else {
+            m_ws->close(websocket::close_code::normal, ec);
+        }
+
+        //  :TODO: why do we get an error here? Needs investigation
+        return ec;
+    }
+
+    json const& getAuthToken() const { return m_authToken; }
+    std::string const& getSignedAuthToken() const { return m_signedAuthToken; }
+    
+    State getState() const { return m_state; }
+    AuthState getAuthState() const { return m_signedAuthToken.empty() ? AuthState::UNAUTHENTICATED : AuthState::AUTHENTICATED; }
+
+    ChannelSubscriptions const& getChannels() const { return m_channels; }
+
+    boost::asio::io_service& getIoService() { return m_ios; }
+
+    ConnectOptions const& getConnectOptions() const { return m_connectOptions; }
+
+    //
+    //  Pull mode: move up to |maxN| messages from the socket-wide inbox into |batch|.
+    //  Requires ConnectOptions::inboxCapacity; must be called from a single consumer
+    //  thread. While an inbox is full the socket stops reading, so a consumer that
+    //  falls behind for longer than the ping timeout will eventually be disconnected.
+    //
+    size_t drain(ChannelMessageBatch& batch, const size_t maxN) {
+        if(!m_inbox) {
+            return 0;
+        }
+
+        const size_t n = m_inbox->popBatch(batch, maxN);
+        inboxDrained(batch, n);
+        return n;
+    }
+
+    bool isReadPaused() const { return m_readPaused; }
+
+    ConnectStats getLastConnectStats() const {
+        boost::lock_guard<boost::mutex> lock(m_connectStatsLock);
+        return m_lastConnectStats;
+    }
+
+    //
+    //  The connected TCP socket, e.g. to check TransportOptions took effect; -1 when
+    //  not connected or over a message transport. It belongs to the io thread: query
+    //  it, don't use or close it.
+    //
+    tcp::socket::native_handle_type getNativeHandle() {
+        if(State::OPEN != m_state || m_transport) {
+            return -1;
+        }
+
+        return m_connectOptions.secure ?
+            m_wss->next_layer().next_layer().native_handle() :
+            m_ws->next_layer().native_handle();
+    }
+
+    ReadStats getReadStats() const {
+        const ReadStats stats = {
+            m_readWakeups.load(std::memory_order_relaxed),
+            m_readMessages.load(std::memory_order_relaxed),
+            m_maxMessagesPerWakeup.load(std::memory_order_relaxed)
+        };
+        return stats;
+    }
+    size_t getInboundBytes() const { return m_inboundBytes; }
+
+    //  safe from any thread
+    RpcLatency getRpcLatency() const {
+        boost::lock_guard<boost::mutex> lock(m_latencyLock);
+        return m_rpcLatency;
+    }
+
+    //  empty unless RpcLatencyOptions::perEventName is set
+    RpcLatencyByEvent getRpcLatencyByEvent() const {
+        boost::lock_guard<boost::mutex> lock(m_latencyLock);
+        return m_rpcLatencyByEvent;
+    }
+
+    //  safe from any thread; counters are relaxed so fields may be from slightly different instants
+    SocketMetrics snapshot() const {
+        const MetricCounters& c = m_metrics;
+
+        SocketMetrics m = SocketMetrics();
+        m.messagesIn            = c.messagesIn.load(std::memory_order_relaxed);
+        m.bytesIn               = c.bytesIn.load(std::memory_order_relaxed);
+        m.messagesOut           = c.messagesOut.load(std::memory_order_relaxed);
+        m.bytesOut              = c.bytesOut.load(std::memory_order_relaxed);
+        m.publishesIn           = c.publishesIn.load(std::memory_order_relaxed);
+        m.eventsIn              = c.eventsIn.load(std::memory_order_relaxed);
+        m.acksIn                = c.acksIn.load(std::memory_order_relaxed);
+        m.handshakesIn          = c.handshakesIn.load(std::memory_order_relaxed);
+        m.authTokenUpdatesIn    = c.authTokenUpdatesIn.load(std::memory_order_relaxed);
+        m.unknownIn             = c.unknownIn.load(std::memory_order_relaxed);
+        m.pings                 = c.pings.load(std::memory_order_relaxed);
+        m.lastPingIntervalMs    = c.lastPingIntervalMs.load(std::memory_order_relaxed);
+        m.ackTimeouts           = c.ackTimeouts.load(std::memory_order_relaxed);
+        m.reconnects            = c.reconnects.load(std::memory_order_relaxed);
+        m.decodeErrors          = c.decodeErrors.load(std::memory_order_relaxed);
+        m.outQueueDepth         = c.outQueueDepth.load(std::memory_order_relaxed);
+        m.pendingResponses      = c.pendingResponses.load(std::memory_order_relaxed);
+        m.slowHandlers          = c.slowHandlers.load(std::memory_order_relaxed);
+        m.maxLoopLagMs          = c.maxLoopLagMs.load(std::memory_order_relaxed);
+        m.read                  = getReadStats();
+        return m;
+    }
+private:    
+    friend class SCChannel;
+
+    enum class ProtocolEvent {
+        UNKNOWN,
+
+        PUBLISH,
+        REMOVE_TOKEN,
+        SET_TOKEN,
+        EVENT,
+        IS_AUTHENTICATED,
+        ACK_RECEIVE
+    };  
+
+    //  |spooled| messages were replayed from the OfflineSpool; they leave it once written
+    struct OutItem {
+        OutItem() : seq(0), spooled(false) {}
+        explicit OutItem(const json& p, const bool s = false) : payload(p), seq(0), spooled(s) {}
+
+        json        payload;    //  null for a spooled record that failed to decode
+        uint64_t    seq;        //  see queueOut()
+        bool        spooled;
+    };
+
+    typedef std::queue<OutItem> OutQueue;
+
+    typedef detail::SocketTimer Timer;  //  protocol timers; on ConnectOptions::virtualClock if set
+
+    //  written by the io thread only; read by snapshot() from anywhere
+    struct MetricCounters {
+        typedef std::atomic<uint64_t> Counter;
+
+        MetricCounters()
+            : messagesIn(0), bytesIn(0), messagesOut(0), bytesOut(0)
+            , publishesIn(0), eventsIn(0), acksIn(0), handshakesIn(0), authTokenUpdatesIn(0), unknownIn(0)
+            , pings(0), lastPingIntervalMs(0)
+            , ackTimeouts(0), reconnects(0), decodeErrors(0)
+            , outQueueDepth(0), pendingResponses(0)
+            , slowHandlers(0), maxLoopLagMs(0)
+        {
+        }
+
+        static void inc(Counter& c, const uint64_t n = 1) {
+            //  single writer: a relaxed load + store is enough and avoids a locked RMW
+            c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+        }
+
+        static void set(Counter& c, const uint64_t v) {
+            c.store(v, std::memory_order_relaxed);
+        }
+
+        Counter messagesIn;
+        Counter bytesIn;
+        Counter messagesOut;
+        Counter bytesOut;
+        Counter publishesIn;
+        Counter eventsIn;
+        Counter acksIn;
+        Counter handshakesIn;
+        Counter authTokenUpdatesIn;
+        Counter unknownIn;
+        Counter pings;
+        Counter lastPingIntervalMs;
+        Counter ackTimeouts;
+        Counter reconnects;
+        Counter decodeErrors;
+        Counter outQueueDepth;
+        Counter pendingResponses;
+        Counter slowHandlers;
+        Counter maxLoopLagMs;
+    };
+
+    typedef std::chrono::steady_clock LatencyClock;
+
+    struct ResponseItem {
+        ResponseHandler                                 handler;
+        std::shared_ptr<Timer>                          ackTimer;
+        EmitOptions                                     options;
+        json                                            payload;    //  kept for DisconnectPolicy::RETRY only
+        LatencyClock::time_point                        enqueuedAt;
+        LatencyClock::time_point                        writtenAt;  //  default until the write completes
+        std::string                                     eventName;  //  kept for RpcLatencyOptions::perEventName only
+        boost::posix_time::ptime                        deadline;   //  of a retained RETRY emit; not_a_date_time for none
+    };
+
+    typedef boost::unordered_map<CallId, ResponseItem> PendingResponses;
+    typedef std::vector<ResponseItem> RetainedResponses;
+
+    //  state of one round of parallel connect attempts
+    struct ConnectRace {
+        explicit ConnectRace(boost::asio::io_service& ios)
+            : staggerTimer(ios)
+            , timeoutTimer(ios)
+            , next(0)
+            , pending(0)
+            , done(false)
+        {
+        }
+
+        ResolverCache::Endpoints                    endpoints;
+        std::vector<std::unique_ptr<tcp::socket>>   sockets;
+        boost::asio::deadline_timer                 staggerTimer;
+        boost::asio::deadline_timer                 timeoutTimer;
+        size_t                                      next;
+        size_t                                      pending;
+        bool                                        done;
+        std::chrono::steady_clock::time_point       started;
+    };
+
+    typedef detail::SpscRing<ChannelMessage>                Inbox;
+    typedef std::deque<std::pair<SCChannelPtr, ChannelMessage>>  InboxBacklog;   //  null channel -> socket inbox
+
+    //  these MUST be in the order of EventHandlerIds
+    typedef std::tuple<
+        EventHandlerRaw,
+        EventHandlerError,
+        EventHandlerConnecting,
+        EventHandlerConnect,
+        EventConnectAbort,
+        EventDisconnect,
+        EventHandlerAuthenticate,
+        EventHandlerAuthTokenChange,
+        EventHandlerDeauthenticate,
+        EventHandlerSubscribe,
+        EventHandlerSubscribeFail,
+        EventHandlerSubscriptionStateChange,
+        EventHandlerUnsubscribe,
+        EventHandlerEmit,
+        EventHandlerReadPaused,
+        EventHandlerReadResumed,
+        EventHandlerResubscribeComplete,
+        EventHandlerSlowHandler,
+        EventHandlerLoopLag
+    > EventTable;
+
+    static const uint32_t RECONENCT_DELAY_INVALID   = 0xffffffff;
+
+    typedef websocket::stream<tcp::socket>              WebSocket;
+    typedef websocket::stream<ssl::stream<tcp::socket>> SecureWebSocket;    
+    typedef std::unique_ptr<WebSocket>                  WebSocketPtr;
+    typedef std::unique_ptr<SecureWebSocket>            SecureWebSocketPtr;
+
+    State                               m_state;
+    boost::asio::io_service             m_ios;
+    ConnectOptions                      m_connectOptions;
+    tcp::resolver                       m_resolver;
+    std::shared_ptr<ssl::context>       m_sslContext;
+    //  :TODO: this is super ugly: It would be nice to have a single m_ws e.g. in a variant. This has proven problematic however.
+    //  ...templating is complex in that classes need to ref SCSocket & we want this to be switchable at runtime
+    WebSocketPtr                        m_ws;
+    SecureWebSocketPtr                  m_wss;
+    MessageTransportPtr                 m_transport;    //  current connection, with ConnectOptions::transportFactory
+    ReadBuffer                          m_buffer;       //  never shrinks; capacity is reused across messages
+    detail::ReadSizePolicy              m_readSize;
+    CallId                              m_nextCallId;
+    OutQueue                            m_outQueue;
+    std::string                         m_currentOutBuffer;
+    OutItem                             m_currentOut;       //  null payload once written
+    uint64_t                            m_nextOutSeq;
+    uint64_t                            m_pongSeq;
+    uint64_t                            m_writeSeq;         //  of the write in flight, pong or not
+    CallId                              m_currentOutCid;    //  call being written, 0 if none
+    mutable boost::mutex                m_latencyLock;
+    RpcLatency                          m_rpcLatency;
+    RpcLatencyByEvent                   m_rpcLatencyByEvent;
+    PendingResponses                    m_pendingResponses;
+    RetainedResponses                   m_retainedResponses;    //  DisconnectPolicy::RETRY emits awaiting a reconnect
+    Timer                               m_retainedTimer;        //  for the earliest retained deadline
+    CallId                              m_handshakeCallId;
+    boost::thread                       m_iosThread;
+    EventTable                          m_eventTable;
+    std::string                         m_signedAuthToken;
+    json                                m_authToken;
+    ChannelSubscriptions                m_channels;
+    uint32_t                            m_connectAttempts;
+    uint32_t                            m_pingTimeout;
+    Timer                               m_pingTimeoutTimer;
+    std::unique_ptr<Inbox>              m_inbox;
+    InboxBacklog                        m_inboxBacklog;
+    std::atomic<bool>                   m_readPaused;   //  set on io thread, read by consumers
+    std::unique_ptr<boost::asio::io_service::work>  m_pausedWork;   //  no read is outstanding; wait for the resume
+    bool                                m_readStalled;  //  read pump stopped while paused
+    bool                                m_pumpRunning;  //  handshake sent; the stream may be written
+    bool                                m_writeInFlight;
+    bool                                m_pongPending;
+    bool                                m_streamingMessage;
+    size_t                              m_streamedBytes;    //  of the current message, already handed to streamHandler
+    std::atomic<bool>                   m_resumePosted;
+    std::atomic<size_t>                 m_inboundBytes; //  bytes held in inboxes & backlog
+    json                                m_inboundBatch; //  batched packets being dispatched
+    size_t                              m_inboundBatchPos;
+    size_t                              m_inboundBatchPacketSize;
+    uint64_t                            m_inboundBatchDispatched;
+    std::atomic<uint64_t>               m_readWakeups;
+    std::atomic<uint64_t>               m_readMessages;
+    std::atomic<uint64_t>               m_maxMessagesPerWakeup;
+    MetricCounters                      m_metrics;
+    std::chrono::steady_clock::time_point   m_lastPing;
+    mutable boost::mutex                m_connectStatsLock;
+    ConnectStats                        m_lastConnectStats;
+    uint32_t                            m_lastReconnectDelay;   //  milliseconds
+    Timer                               m_admissionTimer;
+    bool                                m_awaitingAdmission;
+    bool                                m_holdsAdmission;
+    ConnectAdmission::Token             m_admissionToken;
+    uint64_t                            m_admissionAttempt;
+    bool                                m_resolveInFlight;      //  resolving for everyone who missed in the ResolverCache
+    bool                                m_refreshInFlight;
+    std::deque<SCChannelPtr>            m_resubscribeQueue;
+    std::set<SCChannelPtr>              m_resubscribeInFlight;
+    ResubscribeResult                   m_resubscribeResult;
+    std::chrono::steady_clock::time_point   m_resubscribeStarted;
+    Timer                               m_resubscribeTimer;
+    uint64_t                            m_resubscribeGeneration;    //  bumped to orphan a burst's late responses
+    bool                                m_handshakeDone;
+    std::unique_ptr<OfflineSpool>       m_spool;
+    Timer                               m_spoolReplayTimer;
+    bool                                m_spoolReplayStalled;   //  out queue full; pumpWriteHandler() resumes
+    boost::asio::deadline_timer         m_loopLagTimer;
+    std::chrono::steady_clock::time_point   m_loopLagExpected;
+    bool                                m_loopLagTimerStarted;
+    std::unique_ptr<WireCapture>        m_capture;
+    std::unique_ptr<WireCapture>        m_replayCapture;    //  set while replay() runs
+    ReplayOptions                       m_replayOptions;
+    size_t                              m_replayOffset;
+    WireCapture::Frame                  m_replayFrame;      //  next to be fed
+    ReplayStats                         m_replayStats;
+    std::chrono::steady_clock::time_point   m_replayStarted;
+    std::chrono::nanoseconds            m_replayFirstTimestamp;
+    boost::asio::deadline_timer         m_replayTimer;
+
+    void resetState() {
+        m_state         = State::CONNECTING;
+
+        resetPingTimer(true);
+    }
+
+    template<typename SocketType>
+    void setPerMessageDeflate(SocketType& s) {
+        s->set_option(m_connectOptions.perMessageDeflateOpts);
+    }
+
+    //  an SSL stream cannot handshake again once shut down; each attempt gets a fresh one
+    void resetSecureStream() {
+        m_wss.reset(new SecureWebSocket(m_ios, *m_sslContext.get()));
+
+        const auto& pins = m_connectOptions.secureOptions.publicKeyPins;
+        if(pins && !pins->empty()) {
+            m_wss->next_layer().set_verify_mode(ssl::verify_peer | ssl::verify_fail_if_no_peer_cert);
+            m_wss->next_layer().set_verify_callback(
+                std::bind(&SCSocket::verifyWithRfc2818AndPins, pins, m_connectOptions.host, std::placeholders::_1, std::placeholders::_2)
+            );
+        }
+
+        setPerMessageDeflate(m_wss);
+        setReadMessageMax(m_wss);
+
+        m_wss->binary(haveBinaryCodec());
+    }
+
+    static bool verifyWithRfc2818AndPins(
+        std::shared_ptr<PublicKeyPinSet> pins, const std::string& host, bool preverified, ssl::verify_context& ctx)
+    {
+        if(!ssl::rfc2818_verification(host)(preverified, ctx)) {
+            return false;
+        }
+
+        //  pins apply to the leaf certificate only
+        if(0 != ::X509_STORE_CTX_get_error_depth(ctx.native_handle())) {
+            return true;
+        }
+
+        X509* cert = ::X509_STORE_CTX_get_current_cert(ctx.native_handle());
+        return cert && pins->verify(cert);
+    }
+
+    std::string tlsSessionKey() const {
+        return m_connectOptions.host + ":" + m_connectOptions.port;
+    }
+
+    template<typename SocketType>
+    void setReadMessageMax(SocketType& s) {
+        //  Beast checks the message's size so far at each frame header, before the payload is read
+        s->read_message_max(m_connectOptions.maxMessageSize ? 
+            m_connectOptions.maxMessageSize : 
+            std::numeric_limits<std::size_t>::max()
+        );
+    }
+
+    boost::system::error_code internalClose(
+        const websocket::close_code code = websocket::close_code::normal)
+    {
+        boost::system::error_code ec;
+
+        resetPingTimer(true);   //  cancel only
+
+        if(State::OPEN == m_state) {
+            m_state = State::CLOSED;
+
+            if(m_transport) {
+                m_transport->close();
+            } else if(m_connectOptions.secure) {
+                //  TLS 1.3 tickets arrive after the handshake; pick up the latest before closing
+                if(m_connectOptions.secureOptions.sessionCache) {
+                    m_connectOptions.secureOptions.sessionCache->store(
+                        tlsSessionKey(), m_wss->next_layer().native_handle()
+                    );
+                }
+
+                m_wss->close(code, ec);
+            } else {
+                m_ws->close(code, ec);
+            }
+        }
+
+        cancelAdmission();
+        abandonResubscribe();
+
+        m_pumpRunning   = false;
+        m_pongPending   = false;
+        m_handshakeDone = false;
+        m_pausedWork.reset();
+        m_spoolReplayTimer.cancel();
+        m_spoolReplayStalled = false;
+
+        clearIoWriteQueue();
+        suspendChannelSubscriptions();
+
+        if(m_streamingMessage) {
+            m_streamingMessage  = false;
+            m_streamedBytes     = 0;
+            m_connectOptions.streamHandler->onMessageAbort();
+        }
+
+        m_buffer.consume(m_buffer.size());
+        m_inboundBatch = json();
+
+        return ec;
+    }
+
+    void startConnect() {
+        resetState();
+
+        if(m_connectOptions.secure && !m_connectOptions.transportFactory) {
+            resetSecureStream();
+        }
+        
+        triggerEvent<ConnectingEvent>();
+
+        const auto& admission = m_connectOptions.connectAdmission;
+        if(!admission) {
+            return beginConnect();
+        }
+
+        auto self(shared_from_this());
+
+        m_awaitingAdmission = true;
+
+        //  tells a stale post, for an attempt since cancelled, from the current one
+        const uint64_t attempt = ++m_admissionAttempt;
+
+        const bool admitted = admission->acquire( [ self, this, attempt ]() {
+            m_ios.post(std::bind(&SCSocket::connectAdmitted, self, attempt));
+        }, &m_admissionToken);
+
+        if(!admitted) {
+            scheduleAdmissionPoll();
+        }
+    }
+
+    void scheduleAdmissionPoll() {
+        const std::chrono::milliseconds interval = m_connectOptions.connectAdmission->pollInterval();
+        if(0 == interval.count()) {
+            return; //  another socket's release() will admit us
+        }
+
+        auto self(shared_from_this());
+
+        m_admissionTimer.expires_from_now(boost::posix_time::milliseconds(interval.count()));
+        m_admissionTimer.async_wait( [ self, this ](const boost::system::error_code& ec) {
+            if(ec || !m_awaitingAdmission) {
+                return;
+            }
+
+            m_connectOptions.connectAdmission->poll();
+
+            if(m_awaitingAdmission) {
+                scheduleAdmissionPoll();
+            }
+        });
+    }
+
+    void connectAdmitted(const uint64_t attempt) {
+        if(!m_awaitingAdmission || attempt != m_admissionAttempt) {
+            return; //  cancelAdmission() already gave the slot back
+        }
+
+        m_awaitingAdmission = false;
+        m_holdsAdmission    = true;
+
+        m_admissionTimer.cancel();
+
+        if(State::CONNECTING != m_state) {
+            return releaseAdmission();  //  closed while we waited
+        }
+
+        beginConnect();
+    }
+
+    void releaseAdmission() {
+        if(m_holdsAdmission) {
+            m_holdsAdmission = false;
+            m_connectOptions.connectAdmission->release();
+        }
+    }
+
+    //  leaves the admission queue, or gives back the slot if we were admitted
+    //  but connectAdmitted() has not run (and may never, once the io service stopped)
+    void cancelAdmission() {
+        if(m_awaitingAdmission) {
+            m_awaitingAdmission = false;
+            m_admissionTimer.cancel();
+
+            if(!m_connectOptions.connectAdmission->cancel(m_admissionToken)) {
+                m_holdsAdmission = true;
+            }
+        }
+
+        releaseAdmission();
+    }
+
+    void beginConnect() {
+        if(m_connectOptions.transportFactory) {
+            return openTransport();
+        }
+
+        ResolverCache::Endpoints endpoints;
+
+        //  numeric host & port: nothing to resolve
+        if(parseNumericEndpoint(endpoints)) {
+            return connectEndpoints(endpoints);
+        }
+
+        const auto& resolverCache = m_connectOptions.resolverCache;
+        if(resolverCache) {
+            bool shouldRefresh;
+            const ResolverCache::Freshness freshness = resolverCache->lookup(resolverCacheKey(), endpoints, shouldRefresh);
+
+            if(ResolverCache::Freshness::MISS != freshness) {
+                if(shouldRefresh) {
+                    //  stale-while-revalidate
+                    m_refreshInFlight = true;
+                    m_resolver.async_resolve(
+                        { m_connectOptions.host, m_connectOptions.port },
+                        std::bind(&SCSocket::refreshResolveHandler, shared_from_this(), std::placeholders::_1, std::placeholders::_2)
+                    );
+                }
+
+                return connectEndpoints(endpoints);
+            }
+
+            auto self(shared_from_this());
+
+            const bool resolving = resolverCache->joinResolve(resolverCacheKey(),
+                [ self, this ](const boost::system::error_code& ec, const ResolverCache::Endpoints& resolved) {
+                    m_ios.post(std::bind(&SCSocket::sharedResolveHandler, self, ec, resolved));
+                }
+            );
+
+            if(!resolving) {
+                return; //  another socket is already resolving this host
+            }
+
+            m_resolveInFlight = true;
+        }
+
+        m_resolver.async_resolve(
+            { m_connectOptions.host, m_connectOptions.port },
+            std::bind(&SCSocket::resolveHandler, shared_from_this(), std::placeholders::_1, std::placeholders::_2)
+        );
+    }
+
+    std::string resolverCacheKey() const {
+        return m_connectOptions.host + ":" + m_connectOptions.port;
+    }
+
+    bool parseNumericEndpoint(ResolverCache::Endpoints& endpoints) const {
+        const std::string& port = m_connectOptions.port;
+
+        if(port.empty() || port.size() > 5 || std::string::npos != port.find_first_not_of("0123456789")) {
+            return false;   //  service name, e.g. "http"
+        }
+
+        const unsigned long portNum = std::stoul(port);
+        if(portNum > 0xffff) {
+            return false;
+        }
+
+        boost::system::error_code ec;
+        const boost::asio::ip::address address = boost::asio::ip::address::from_string(m_connectOptions.host, ec);
+        if(ec) {
+            return false;
+        }
+
+        endpoints.assign(1, tcp::endpoint(address, static_cast<unsigned short>(portNum)));
+        return true;
+    }
+
+    void refreshResolveHandler(boost::system::error_code ec, tcp::resolver::iterator resolveIter) {
+        m_refreshInFlight = false;
+
+        if(ec) {
+            return m_connectOptions.resolverCache->refreshFailed(resolverCacheKey());
+        }
+
+        m_connectOptions.resolverCache->store(
+            resolverCacheKey(), ResolverCache::Endpoints(resolveIter, tcp::resolver::iterator())
+        );
+    }
+
+    void clearIoWriteQueue() {
+        if(m_spool) {
+            //
+            //  Replayed records that were not written are still at the front of the spool;
+            //  replay them again from there. Anything else unsent that the spool can take
+            //  was queued while it was empty, so it is older than all of it and goes first.
+            //
+            std::vector<OfflineSpool::Record> unsent;
+
+            if(!m_currentOut.spooled && isSpoolable(m_currentOut.payload)) {
+                unsent.push_back(json::to_cbor(m_currentOut.payload));  //  its write never completed
+            }
+
+            for(; !m_outQueue.empty(); m_outQueue.pop()) {
+                const OutItem& item = m_outQueue.front();
+                if(!item.spooled && isSpoolable(item.payload)) {
+                    unsent.push_back(json::to_cbor(item.payload));
+                }
+            }
+
+            m_spool->rewind();
+
+            for(auto record = unsent.rbegin(); record != unsent.rend(); ++record) {
+                if(!m_spool->prepend(*record)) {
+                    triggerEvent<ErrorEvent>(make_error_code(spool_full));
+                }
+            }
+
+            m_spool->flush();
+        }
+
+        m_currentOut = OutItem();
+        OutQueue().swap(m_outQueue);
+    }
+
+    //  user events sent without a response handler; protocol events are re-issued by us
+    static bool isSpoolable(const json& payload) {
+        if(!payload.is_object() || payload.count("cid")) {
+            return false;
+        }
+
+        const auto event = payload.find("event");
+        return payload.end() != event && event->is_string() && '#' != event->get<std::string>()[0];
+    }
+
+    bool shouldSpool(const json& payload) const {
+        if(!m_spool || !isSpoolable(payload)) {
+            return false;
+        }
+
+        //  while anything is spooled, new messages queue behind it to keep ordering
+        return !m_handshakeDone || !m_spool->empty() || outQueueFull();
+    }
+
+    bool outQueueFull() const {
+        return m_outQueue.size() >= std::max<size_t>(1, m_connectOptions.spoolOptions.maxQueuedMessages);
+    }
+
+    void spoolMessage(const json& payload) {
+        if(!m_spool->append(json::to_cbor(payload))) {
+            triggerEvent<ErrorEvent>(make_error_code(spool_full));
+        }
+    }
+
+    void replaySpool() {
+        if(!m_spool || !m_handshakeDone) {
+            return;
+        }
+
+        m_spoolReplayStalled = false;
+
+        const SpoolOptions& opts = m_connectOptions.spoolOptions;
+
+        //  rate limited replay runs in 100ms ticks
+        size_t n = opts.replayRate ? std::max<size_t>(1, opts.replayRate / 10) : std::max<size_t>(1, opts.replayBatch);
+
+        //  each record is popped from the spool only once it has been written, and
+        //  no more are decoded than the out queue may hold
+        OfflineSpool::Record record;
+        for(; n > 0 && !outQueueFull() && m_spool->next(record); --n) {
+            json payload;
+
+            try {
+                payload = json::from_cbor(record);
+            } catch(const std::exception&) {
+                triggerEvent<ErrorEvent>(make_error_code(json_parse_failure));
+            }
+
+            queueOut(payload, true);
+        }
+
+        startWrite();
+
+        if(!m_spool->replayPending()) {
+            return;
+        }
+
+        auto self(shared_from_this());
+
+        if(opts.replayRate) {
+            //  a tick that finds the out queue full reads nothing
+            m_spoolReplayTimer.expires_from_now(boost::posix_time::milliseconds(100));
+            m_spoolReplayTimer.async_wait( [ self, this ](const boost::system::error_code& ec) {
+                if(!ec) {
+                    replaySpool();
+                }
+            });
+        } else if(outQueueFull()) {
+            m_spoolReplayStalled = true;
+        } else {
+            m_ios.post(std::bind(&SCSocket::replaySpool, self));
+        }
+    }
+
+    void resetPingTimer(const bool cancelOnly = false) {
+        if(m_replayCapture) {
+            return; //  no connection to time out
+        }
+
+        m_pingTimeoutTimer.cancel();
+
+        if(!cancelOnly) {
+            auto self(shared_from_this());
+
+            //  set updated pingTimeout
+            m_pingTimeoutTimer.expires_from_now(boost::posix_time::milliseconds(m_pingTimeout));
+
+            m_pingTimeoutTimer.async_wait( [ self, this ](const boost::system::error_code& ec) {
+                if(ec) {
+                    //  likely canceled
+                    return;
+                }
+
+                if(m_transport) {
+                    m_transport->close();
+                } else if(m_connectOptions.secure) {
+                    m_wss->close(websocket::close_code::protocol_error);
+                } else {
+                    m_ws->close(websocket::close_code::protocol_error);
+                }
+            });
+        }
+    }
+
+    typedef std::function<void(const boost::system::error_code&)> SubscribeDoneHandler;
+
+    bool canSubscribe(SCChannelPtr channel, const ChannelSubscriptionOptions& channelSubOptions) const {
+        const bool meetsRequirements = !channelSubOptions.waitForAuth || AuthState::AUTHENTICATED == getAuthState();
+
+        return State::OPEN == m_state && meetsRequirements && !channel->m_subscribeInFlight;
+    }
+
+    void tryChannelSubscribe(SCChannelPtr channel, const ChannelSubscriptionOptions& channelSubOptions) {
+        if(canSubscribe(channel, channelSubOptions)) {
+            sendChannelSubscribe(channel, channelSubOptions);
+        }
+    }
+
+    void sendChannelSubscribe(
+        SCChannelPtr channel, const ChannelSubscriptionOptions& channelSubOptions,
+        const bool noTimeout = false, const SubscribeDoneHandler done = nullptr)
+    {
+        //  :TODO: need internal emit that waits for AUTH
+
+        //
+        //  We need to send a subscribe event to the server
+        //
+        json channelSubData = {
+            { "channel",    channel->getName() }
+        };
+
+        if(!channelSubOptions.data.empty()) {
+            channelSubData["data"] = channelSubOptions.data;
+        }
+
+        auto self(shared_from_this());
+
+        channel->m_subscribeInFlight = true;
+
+        emit("#subscribe", channelSubData, [ self, this, channel, channelSubOptions, done ](boost::system::error_code ec, const json&) {
+            channel->m_subscribeInFlight = false;
+
+            if(make_error_code(disconnected) == ec) {
+                return; //  still PENDING; resubscribed after reconnecting
+            }
+
+            if(ec) {
+                triggerChannelSubscribeFail(channel, ec, channelSubOptions);
+            } else {
+                triggerChannelSubscribe(channel, channelSubOptions);
+            }
+
+            if(done) {
+                done(ec);
+            }
+        }, noTimeout);
+    }
+
+    //
+    //  (Re)subscribe every channel left PENDING, e.g. by a disconnect. Called right after
+    //  queueing #handshake so the subscriptions share its round trip, and again once
+    //  authenticated for waitForAuth channels.
+    //
+    void processPendingSubscriptions() {
+        const bool idle = m_resubscribeQueue.empty() && m_resubscribeInFlight.empty();
+
+        size_t queued = 0;
+
+        for(const auto& sub : m_channels) {
+            const SCChannelPtr& channel = sub.second;
+
+            if(ChannelState::PENDING == channel->getState() && canSubscribe(channel, channel->m_subOptions)) {
+                channel->m_subscribeInFlight = true;    //  queued counts as in flight; nothing else may subscribe it
+                m_resubscribeQueue.push_back(channel);
+                ++queued;
+            }
+        }
+
+        if(0 == queued) {
+            return;
+        }
+
+        if(idle) {
+            m_resubscribeResult     = ResubscribeResult();
+            m_resubscribeStarted    = std::chrono::steady_clock::now();
+
+            const uint64_t generation = m_resubscribeGeneration;
+            auto self(shared_from_this());
+
+            m_resubscribeTimer.expires_from_now(boost::posix_time::milliseconds(m_connectOptions.resubscribeOptions.timeout));
+            m_resubscribeTimer.async_wait( [ self, this, generation ](const boost::system::error_code& ec) {
+                if(!ec && generation == m_resubscribeGeneration) {
+                    resubscribeTimedOut();
+                }
+            });
+        }
+
+        m_resubscribeResult.total += queued;
+
+        pumpResubscribe();
+    }
+
+    void pumpResubscribe() {
+        const size_t maxInFlight    = std::max<size_t>(1, m_connectOptions.resubscribeOptions.maxInFlight);
+        const uint64_t generation   = m_resubscribeGeneration;
+
+        while(m_resubscribeInFlight.size() < maxInFlight && !m_resubscribeQueue.empty()) {
+            SCChannelPtr channel = m_resubscribeQueue.front();
+            m_resubscribeQueue.pop_front();
+
+            if(ChannelState::PENDING != channel->getState()) {
+                //  unsubscribed while queued
+                channel->m_subscribeInFlight = false;
+                --m_resubscribeResult.total;
+                continue;
+            }
+
+            m_resubscribeInFlight.insert(channel);
+
+            sendChannelSubscribe(channel, channel->m_subOptions, true,
+                [ this, channel, generation ](const boost::system::error_code& ec) {
+                    if(generation != m_resubscribeGeneration) {
+                        return; //  burst abandoned by a close or timed out
+                    }
+
+                    m_resubscribeInFlight.erase(channel);
+
+                    if(ec) {
+                        ++m_resubscribeResult.failed;
+                    } else {
+                        ++m_resubscribeResult.subscribed;
+                    }
+
+                    pumpResubscribe();
+                }
+            );
+        }
+
+        if(m_resubscribeQueue.empty() && m_resubscribeInFlight.empty()) {
+            finishResubscribe();
+        }
+    }
+
+    void resubscribeTimedOut() {
+        const boost::system::error_code ec = make_error_code(ack_timeout);
+
+        m_resubscribeResult.timedOut += m_resubscribeQueue.size() + m_resubscribeInFlight.size();
+
+        std::vector<SCChannelPtr> abandoned(m_resubscribeQueue.begin(), m_resubscribeQueue.end());
+        abandoned.insert(abandoned.end(), m_resubscribeInFlight.begin(), m_resubscribeInFlight.end());
+
+        abandonResubscribe();
+
+        for(const auto& channel : abandoned) {
+            channel->m_subscribeInFlight = false;
+            triggerChannelSubscribeFail(channel, ec, channel->m_subOptions);
+        }
+
+        finishResubscribe();
+    }
+
+    void finishResubscribe() {
+        m_resubscribeTimer.cancel();
+
+        m_resubscribeResult.elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - m_resubscribeStarted
+        );
+
+        triggerEvent<ResubscribeCompleteEvent>(m_resubscribeResult);
+    }
+
+    //  late responses to the abandoned burst are ignored
+    void abandonResubscribe() {
+        ++m_resubscribeGeneration;
+
+        m_resubscribeTimer.cancel();
+        m_resubscribeQueue.clear();
+        m_resubscribeInFlight.clear();
+    }
+
+    void triggerChannelSubscribeFail(
+        SCChannelPtr channel, const boost::system::error_code& ec, ChannelSubscriptionOptions channelSubOptions)
+    {
+        const bool meetsRequirements = !channelSubOptions.waitForAuth || AuthState::AUTHENTICATED == getAuthState();
+
+        if(ChannelState::UNSUBSCRIBED != channel->getState() && meetsRequirements) {
+            channel->m_state = ChannelState::UNSUBSCRIBED;
+
+            //  channel
+            channel->triggerEvent<SCChannel::SubscribeFailEvent>(channel->getName(), ec);
+
+            //  socket
+            triggerEvent<SubscribeFailEvent>(channel->getName(), ec);
+        }
+    }
+
+    void triggerChannelSubscribe(SCChannelPtr channel, ChannelSubscriptionOptions channelSubOption) {
+        const ChannelState oldState = channel->getState();
+
+        if(ChannelState::SUBSCRIBED == oldState) {
+            return;
+        }
+
+        channel->m_state = ChannelState::SUBSCRIBED;
+
+        //  :TODO: JS version passes along channelSubOptions here as well
+        const ChannelStateData stateData = { channel->getName(), oldState, channel->getState() };
+
+        //  channel
+        channel->triggerEvent<SCChannel::SubscriptionStateChangeEvent>(stateData);
+        channel->triggerEvent<SCChannel::SubscribeEvent>(channel->getName());
+
+        //  socket
+        triggerEvent<SubscriptionStateChangeEvent>(stateData);
+        triggerEvent<SubscribeEvent>(channel->getName());
+    }
+
+    void triggerChannelUnsubscribe(
+        SCChannelPtr channel, const ChannelState newState = ChannelState::UNSUBSCRIBED)
+    {
+        const ChannelState oldState = channel->getState();
+
+        channel->m_state = newState;
+
+        cancelPendingSubscriberCallback(channel);
+
+        if(ChannelState::SUBSCRIBED == oldState) {
+            const ChannelStateData stateData( { channel->getName(), oldState, newState } );
+
+            //  channel
+            channel->triggerEvent<SCChannel::SubscriptionStateChangeEvent>(stateData);
+            channel->triggerEvent<SCChannel::UnsubscribeEvent>(channel->getName());
+
+            //  socket
+            triggerEvent<SubscriptionStateChangeEvent>(stateData);
+            triggerEvent<UnsubscribeEvent>(channel->getName());
+        }
+    }
+
+    void sendChannelUnsubscribe(SCChannelPtr channel) {
+        //  :TODO: If *our* state is not OPEN, do nothing
+
+        cancelPendingSubscriberCallback(channel);
+
+        //  :TODO: pass noTimeout option
+        emit("#unsubscribe", channel->getName());
+    }
+
+    void cancelPendingSubscriberCallback(SCChannelPtr channel) {
+        //  :TODO: if we have any pending subscriber callback for this channel, cancel it now
+
+    }
+
+    void suspendChannelSubscriptions() {
+        ChannelState newState;
+
+        for(const auto& sub : m_channels) {
+            const ChannelState state = sub.second->getState();
+
+            sub.second->m_subscribeInFlight = false;    //  its response will never arrive
+
+            if(ChannelState::SUBSCRIBED == state || ChannelState::PENDING == state) {
+                newState = ChannelState::PENDING;
+            } else {
+                newState = ChannelState::UNSUBSCRIBED;
+            }
+
+            triggerChannelUnsubscribe(sub.second, newState);
+        }
+    }
+
+    //  assigns a fresh cid, arms the ack timer and records |respItem| as pending
+    CallId trackResponse(ResponseItem respItem) {
+        const CallId cid = m_nextCallId++;
+
+        if(!respItem.options.noTimeout) {
+            auto self(shared_from_this());
+
+            //
+            //  If our event is not ACK'd by the server within |ackTimeout| we will
+            //  respond to the handler with a timeout error
+            //
+            respItem.ackTimer.reset(
+                new Timer(m_ios, m_connectOptions.virtualClock, boost::posix_time::seconds(m_connectOptions.ackTimeout))
+            );
+
+            respItem.ackTimer->async_wait( [ self, this, cid ](const boost::system::error_code& ec) {
+                if(ec) {
+                    //  likely canceled
+                    return;
+                }
+
+                handleEmitAckTimeout(cid);
+            });
+        }
+
+        m_pendingResponses[cid] = respItem;
+
+        return cid;
+    }
+
+    //
+    //  Responses to emits sent on a connection that is gone will never arrive. Fail them
+    //  now rather than after |ackTimeout|, or hold DisconnectPolicy::RETRY ones for
+    //  retransmission if we are going to reconnect.
+    //
+    void settlePendingResponses(const bool willReconnect) {
+        std::vector<ResponseItem> failed;
+
+        for(auto& pending : m_pendingResponses) {
+            ResponseItem& respItem = pending.second;
+
+            if(respItem.ackTimer) {
+                respItem.ackTimer->cancel();
+                respItem.ackTimer.reset();
+            }
+
+            if(willReconnect && DisconnectPolicy::RETRY == respItem.options.disconnectPolicy) {
+                m_retainedResponses.push_back(respItem);
+            } else {
+                failed.push_back(respItem);
+            }
+        }
+
+        m_pendingResponses.clear();
+
+        if(!willReconnect) {
+            failed.insert(failed.end(), m_retainedResponses.begin(), m_retainedResponses.end());
+            m_retainedResponses.clear();
+        }
+
+        failResponses(failed);
+        startRetainedTimer();
+    }
+
+    void failResponses(const std::vector<ResponseItem>& failed) {
+        const json errorInfo = {
+            { "error", {
+                { "message", "connection closed before a response arrived" }
+            }}
+        };
+
+        for(const auto& respItem : failed) {
+            invokeResponseHandler(respItem, make_error_code(disconnected), errorInfo);
+        }
+    }
+
+    //  the time base of our protocol timers
+    boost::posix_time::ptime timerNow() const {
+        if(m_connectOptions.virtualClock) {
+            return boost::posix_time::ptime(boost::gregorian::date(1970, 1, 1)) + m_connectOptions.virtualClock->now();
+        }
+
+        return boost::asio::deadline_timer::traits_type::now();
+    }
+
+    //  retained emits are failed at their deadline if we have not reconnected by then
+    void startRetainedTimer() {
+        m_retainedTimer.cancel();
+
+        boost::posix_time::ptime earliest;
+        for(const auto& respItem : m_retainedResponses) {
+            if(!respItem.deadline.is_not_a_date_time() && (earliest.is_not_a_date_time() || respItem.deadline < earliest)) {
+                earliest = respItem.deadline;
+            }
+        }
+
+        if(earliest.is_not_a_date_time()) {
+            return;
+        }
+
+        auto self(shared_from_this());
+
+        m_retainedTimer.expires_from_now(std::max(boost::posix_time::time_duration(), earliest - timerNow()));
+        m_retainedTimer.async_wait( [ self, this ](const boost::system::error_code& ec) {
+            if(ec) {
+                return;
+            }
+
+            const boost::posix_time::ptime now = timerNow();
+
+            std::vector<ResponseItem> expired;
+            RetainedResponses retained;
+
+            for(auto& respItem : m_retainedResponses) {
+                const bool due = !respItem.deadline.is_not_a_date_time() && respItem.deadline <= now;
+                (due ? expired : retained).push_back(respItem);
+            }
+
+            m_retainedResponses.swap(retained);
+
+            failResponses(expired);
+            startRetainedTimer();
+        });
+    }
+
+    //  queued behind the #handshake response; each retry gets a fresh cid and ack timer
+    void retransmitRetainedResponses() {
+        m_retainedTimer.cancel();
+
+        RetainedResponses retained;
+        retained.swap(m_retainedResponses);
+
+        for(auto& respItem : retained) {
+            json payload = respItem.payload;
+
+            respItem.writtenAt = LatencyClock::time_point();
+            payload["cid"] = trackResponse(respItem);
+
+            queueOut(payload);
+        }
+    }
+
+    void ioErrorHandler(const boost::system::error_code& ec) {
+        if(boost::asio::error::operation_aborted == ec || boost::asio::error::eof == ec ||
+            websocket::error::closed == ec)
+        {
+            return closeHandler(ec, false);
+        }
+
+        //  :TODO: Handle!
+        std::cout << "Unknown error: " << ec << std::endl << std::flush;
+    }
+
+    void closeHandler(const boost::system::error_code& ec, const bool isConnectionAbort) {
+        internalClose();
+
+        const bool willReconnect = boost::asio::error::operation_aborted != ec && m_connectOptions.autoReconnect;
+
+        settlePendingResponses(willReconnect);
+
+        /*
+        m_state = State::CLOSED;
+        
+        clearIoWriteQueue();
+        suspendChannelSubscriptions();
+        */
+
+        //
+        //  An boost::asio::error::operation_aborted reason is treated as a purposful
+        //  disconnect; we will not attempt auto-reconnect
+        //
+        if(willReconnect) {
+            //  :TODO: when do we not want to try to reconnect? / when do we want to ignore delay?
+            //  see https://github.com/SocketCluster/socketcluster-client/blob/01a66770ea74b0f6185d7c59ea64b3d8bef078c6/lib/scsocket.js#L580
+
+            tryReconnect();
+        }
+
+        if(isConnectionAbort) {
+            triggerEvent<ConnectAbortEvent>(ec);
+        } else {
+            triggerEvent<DisconnectEvent>(ec);
+        }       
+    }
+
+    void tryReconnect(const uint32_t initialDelay = RECONENCT_DELAY_INVALID) {
+        const uint32_t exponent = m_connectAttempts++;
+
+        MetricCounters::inc(m_metrics.reconnects);
+
+        uint32_t timeout;
+
+        const AutoReconnectOptions& reconnectOpts = m_connectOptions.autoReconnectOptions;
+
+        if(reconnectOpts.decorrelatedJitter && (RECONENCT_DELAY_INVALID == initialDelay || exponent > 0)) {
+            //  decorrelated jitter: spreads sockets that dropped together over a widening window
+            const double base   = reconnectOpts.initialDelay;
+            const double upper  = 3.0 * std::max(m_lastReconnectDelay, reconnectOpts.initialDelay);
+
+            timeout = std::round(base + (upper - base) * detail::sharedRandom());
+        } else if(RECONENCT_DELAY_INVALID == initialDelay || exponent > 0) {
+            const uint32_t initialTimeout = std::round( 
+                reconnectOpts.initialDelay + reconnectOpts.randomness * detail::sharedRandom()
+            );
+
+            timeout = std::round(initialTimeout * std::pow(reconnectOpts.multiplier, exponent));
+        } else {
+            timeout = initialDelay;
+        }
+
+        if(timeout > m_connectOptions.autoReconnectOptions.maxDelay) {
+            timeout = m_connectOptions.autoReconnectOptions.maxDelay;
+        }
+
+        m_lastReconnectDelay = timeout;
+
+        //  :TODO: clear any existing timer - use m_reconnectTimer for e.g.
+
+        auto self(shared_from_this());
+
+        std::shared_ptr<Timer> timer(new Timer(m_ios, m_connectOptions.virtualClock, boost::posix_time::milliseconds(timeout)));
+        timer->async_wait( [ self, this, timer ](const boost::system::error_code& ec) {
+            if(ec) {
+                //  :TODO: handle |ec| here
+                return;
+            }
+
+            startConnect();
+        });
+    }
+
+    ProtocolEvent getEventType(const json& payload) const {
         try {
-            auto channel = m_channels.at(channelName);
-            channel->unwatch(conn);
-        } catch(std::out_of_range) {            
+            std::string const& eventName = payload.at("event");
+
+            if("#publish" == eventName) {
+                return ProtocolEvent::PUBLISH;
+            } else if("#removeAuthToken" == eventName) {
+                return ProtocolEvent::REMOVE_TOKEN;
+            } else if("#setAuthToken" == eventName) {
+                return ProtocolEvent::SET_TOKEN;
+            } else {
+                return ProtocolEvent::EVENT;
+            }
+        } catch(std::out_of_range) {
+            //  fall through
+        }
+
+        const CallId rid = payload.value("rid", 0);
+        if(0 != rid && m_handshakeCallId == rid) {
+            return ProtocolEvent::IS_AUTHENTICATED;
+        }
+
+        return ProtocolEvent::ACK_RECEIVE;
+    }
+
+    template<size_t HandlerId, typename ...Args>
+    void triggerEvent(Args&& ...args) {
+        const uint32_t threshold = m_connectOptions.watchdogOptions.slowHandlerThreshold;
+
+        //  the watchdog's own events are not timed
+        if(0 == threshold || SlowHandlerEvent == HandlerId || LoopLagEvent == HandlerId) {
+            (std::get<HandlerId>(m_eventTable))(std::forward<Args>(args)...);
+            return;
+        }
+
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        (std::get<HandlerId>(m_eventTable))(std::forward<Args>(args)...);
+
+        checkHandlerDuration(HandlerId, detail::EMPTY_STRING, start);
+    }
+
+    //  response handlers are user code run inline too
+    void invokeResponseHandler(
+        const ResponseItem& respItem, const boost::system::error_code& ec, const json& resp)
+    {
+        if(0 == m_connectOptions.watchdogOptions.slowHandlerThreshold) {
+            return respItem.handler(ec, resp);
         }
+
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        respItem.handler(ec, resp);
+
+        checkHandlerDuration(ResponseHandlerId, detail::EMPTY_STRING, start);
     }
 
-    boost::system::error_code disconnect() {
-        boost::system::error_code ec;
+    void checkHandlerDuration(
+        const size_t handlerId, const std::string& channel, const std::chrono::steady_clock::time_point start)
+    {
+        const std::chrono::microseconds duration = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start
+        );
 
-        if(m_connectOptions.secure) {
-            m_wss->close(websocket::close_code::normal, ec);
-        } else {
-            m_ws->close(websocket::close_code::normal, ec);
+        if(duration.count() < static_cast<int64_t>(m_connectOptions.watchdogOptions.slowHandlerThreshold)) {
+            return;
         }
 
-        //  :TODO: why do we get an error here? Needs investigation
-        return ec;
+        MetricCounters::inc(m_metrics.slowHandlers);
+
+        const SlowHandlerInfo info = { handlerId, channel, duration };
+        triggerEvent<SlowHandlerEvent>(info);
     }
 
-    json const& getAuthToken() const { return m_authToken; }
-    std::string const& getSignedAuthToken() const { return m_signedAuthToken; }
-    
-    State getState() const { return m_state; }
-    AuthState getAuthState() const { return m_signedAuthToken.empty() ? AuthState::UNAUTHENTICATED : AuthState::AUTHENTICATED; }
+    void startLoopLagTimer() {
+        const uint32_t interval = m_connectOptions.watchdogOptions.lagCheckInterval;
+        if(0 == interval) {
+            return;
+        }
 
-    ChannelSubscriptions const& getChannels() const { return m_channels; }
+        auto self(shared_from_this());
 
-    boost::asio::io_service& getIoService() { return m_ios; }
+        m_loopLagExpected = std::chrono::steady_clock::now() + std::chrono::milliseconds(interval);
 
-    ConnectOptions const& getConnectOptions() const { return m_connectOptions; }
-private:    
-    enum class ProtocolEvent {
-        UNKNOWN,
+        m_loopLagTimer.expires_from_now(boost::posix_time::milliseconds(interval));
+        m_loopLagTimer.async_wait( [ self, this ](const boost::system::error_code& ec) {
+            if(ec) {
+                return;
+            }
 
-        PUBLISH,
-        REMOVE_TOKEN,
-        SET_TOKEN,
-        EVENT,
-        IS_AUTHENTICATED,
-        ACK_RECEIVE
-    };  
+            const std::chrono::milliseconds lag = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - m_loopLagExpected
+            );
 
-    typedef std::queue<json> OutQueue;
+            if(static_cast<uint64_t>(lag.count()) > m_metrics.maxLoopLagMs.load(std::memory_order_relaxed)) {
+                MetricCounters::set(m_metrics.maxLoopLagMs, lag.count());
+            }
 
-    struct ResponseItem {
-        ResponseHandler                                 handler;
-        std::shared_ptr<boost::asio::deadline_timer>    ackTimer;
-    };
+            if(lag.count() >= static_cast<int64_t>(m_connectOptions.watchdogOptions.lagThreshold)) {
+                triggerEvent<LoopLagEvent>(lag);
+            }
 
-    typedef boost::unordered_map<CallId, ResponseItem> PendingResponses;
+            startLoopLagTimer();
+        });
+    }
 
-    //  these MUST be in the order of EventHandlerIds
-    typedef std::tuple<
-        EventHandlerRaw,
-        EventHandlerError,
-        EventHandlerConnecting,
-        EventHandlerConnect,
-        EventConnectAbort,
-        EventDisconnect,
-        EventHandlerAuthenticate,
-        EventHandlerAuthTokenChange,
-        EventHandlerDeauthenticate,
-        EventHandlerSubscribe,
-        EventHandlerSubscribeFail,
-        EventHandlerSubscriptionStateChange,
-        EventHandlerUnsubscribe,
-        EventHandlerEmit
-    > EventTable;
+    void ioThread() {
+        m_ios.run();
+    }
 
-    static const uint32_t RECONENCT_DELAY_INVALID   = 0xffffffff;
+    //
+    //  Every outbound message is queued here. Its sequence number is the trace id of
+    //  each stage it passes through, so one message can be followed to the wire.
+    //
+    void queueOut(const json& payload, const bool spooled = false) {
+        OutItem item(payload, spooled);
+        item.seq = ++m_nextOutSeq;
 
-    typedef websocket::stream<tcp::socket>              WebSocket;
-    typedef websocket::stream<ssl::stream<tcp::socket>> SecureWebSocket;    
-    typedef std::unique_ptr<WebSocket>                  WebSocketPtr;
-    typedef std::unique_ptr<SecureWebSocket>            SecureWebSocketPtr;
+        m_outQueue.push(std::move(item));
+        MetricCounters::set(m_metrics.outQueueDepth, m_outQueue.size());
 
-    State                               m_state;
-    boost::asio::io_service             m_ios;
-    ConnectOptions                      m_connectOptions;
-    tcp::resolver                       m_resolver;
-    std::shared_ptr<ssl::context>       m_sslContext;
-    //  :TODO: this is super ugly: It would be nice to have a single m_ws e.g. in a variant. This has proven problematic however.
-    //  ...templating is complex in that classes need to ref SCSocket & we want this to be switchable at runtime
-    WebSocketPtr                        m_ws;
-    SecureWebSocketPtr                  m_wss;
-    boost::beast::multi_buffer          m_buffer;
-    CallId                              m_nextCallId;
-    OutQueue                            m_outQueue;
-    std::string                         m_currentOutBuffer;
-    PendingResponses                    m_pendingResponses;
-    boost::thread                       m_iosThread;
-    EventTable                          m_eventTable;
-    std::string                         m_signedAuthToken;
-    json                                m_authToken;
-    ChannelSubscriptions                m_channels;
-    uint32_t                            m_connectAttempts;
-    uint32_t                            m_pingTimeout;
-    boost::asio::deadline_timer         m_pingTimeoutTimer;
+        SCIO_BEAST_TRACE(ENQUEUE, this, m_outQueue.back().seq);
+    }
 
-    void resetState() {
-        m_state         = State::CONNECTING;
-        m_nextCallId    = 1;
+    void placeNextWriteQueueItemInPayload() {
+        m_currentOut = std::move(m_outQueue.front());
+        m_outQueue.pop();
 
-        resetPingTimer(true);
+        const json& obj = m_currentOut.payload;
+
+        m_currentOutCid = obj.value("cid", CallId(0));
+
+        m_currentOutBuffer = m_connectOptions.codecEngine ?
+            m_connectOptions.codecEngine->encode(obj) :
+            obj.dump()
+            ;
+
+        MetricCounters::inc(m_metrics.messagesOut);
+        MetricCounters::inc(m_metrics.bytesOut, m_currentOutBuffer.size());
+
+        SCIO_BEAST_TRACE(ENCODE_DONE, this, m_currentOut.seq);
     }
 
-    template<typename SocketType>
-    void setPerMessageDeflate(SocketType& s) {
-        s->set_option(m_connectOptions.perMessageDeflateOpts);
+    void sampleQueueGauges() {
+        MetricCounters::set(m_metrics.outQueueDepth, m_outQueue.size());
+        MetricCounters::set(m_metrics.pendingResponses, m_pendingResponses.size());
     }
 
-    boost::system::error_code internalClose(
-        const websocket::close_code code = websocket::close_code::normal)
-    {
-        boost::system::error_code ec;
+    //
+    //  Called once an inbound message has been handled: flush what it queued and
+    //  read the next one. Writes run independently of reads so anything queued
+    //  from another thread goes out right away rather than on the next inbound
+    //  message; at most one of each is in flight.
+    //
+    void ioPumpWrite() {
+        startWrite();
+        return ioPumpReadSome();
+    }
 
-        resetPingTimer(true);   //  cancel only
+    void startWrite() {
+        sampleQueueGauges();
 
-        if(State::OPEN == m_state) {
-            m_state = State::CLOSED;
+        if(m_replayCapture) {
+            return discardWrites();
+        }
 
-            if(m_connectOptions.secure) {
-                m_wss->close(code, ec);
+        if(!m_pumpRunning || m_writeInFlight) {
+            return;
+        }
+
+        if(m_pongPending) {
+            m_pongPending   = false;
+            m_writeInFlight = true;
+
+            static const char pong[] = { '#', '2' };
+
+            captureFrame(WireCapture::Direction::OUTBOUND, WireCapture::Opcode::TEXT, pong, sizeof(pong));
+
+            m_writeSeq = m_pongSeq;
+            SCIO_BEAST_TRACE(WRITE_BEGIN, this, m_writeSeq);
+
+            if(m_transport) {
+                m_transport->asyncWrite(
+                    pong, sizeof(pong), false,
+                    std::bind(&SCSocket::pumpWriteHandler, shared_from_this(), std::placeholders::_1)
+                );
+            } else if(m_connectOptions.secure) {
+                m_wss->async_write(
+                    boost::asio::buffer(pong),
+                    std::bind(&SCSocket::pumpWriteHandler, shared_from_this(), std::placeholders::_1)
+                );
             } else {
-                m_ws->close(code, ec);
+                m_ws->async_write(
+                    boost::asio::buffer(pong),
+                    std::bind(&SCSocket::pumpWriteHandler, shared_from_this(), std::placeholders::_1)
+                );
             }
+            return;
         }
 
-        clearIoWriteQueue();
-        suspendChannelSubscriptions();
+        //  spooled records that failed to decode; nothing ahead of them is unwritten now
+        while(!m_outQueue.empty() && m_outQueue.front().payload.is_null()) {
+            m_spool->pop();
+            m_outQueue.pop();
+        }
 
-        return ec;
-    }
+        if(m_outQueue.empty()) {
+            return;
+        }
 
-    void startConnect() {
-        resetState();
-        
-        triggerEvent<ConnectingEvent>();
+        m_writeInFlight = true;
 
-        m_resolver.async_resolve(
-            { m_connectOptions.host, m_connectOptions.port },
-            std::bind(&SCSocket::resolveHandler, shared_from_this(), std::placeholders::_1, std::placeholders::_2)
+        placeNextWriteQueueItemInPayload();
+
+        captureFrame(
+            WireCapture::Direction::OUTBOUND,
+            haveBinaryCodec() ? WireCapture::Opcode::BINARY : WireCapture::Opcode::TEXT,
+            m_currentOutBuffer.data(),
+            m_currentOutBuffer.size()
         );
+
+        m_writeSeq = m_currentOut.seq;
+        SCIO_BEAST_TRACE(WRITE_BEGIN, this, m_writeSeq);
+
+        if(m_transport) {
+            m_transport->asyncWrite(
+                m_currentOutBuffer.data(), m_currentOutBuffer.size(), haveBinaryCodec(),
+                std::bind(&SCSocket::pumpWriteHandler, shared_from_this(), std::placeholders::_1)
+            );
+        } else if(m_connectOptions.secure) {
+            m_wss->async_write(
+                boost::asio::buffer(m_currentOutBuffer),
+                std::bind(&SCSocket::pumpWriteHandler, shared_from_this(), std::placeholders::_1)
+            );
+        } else {
+            m_ws->async_write(
+                boost::asio::buffer(m_currentOutBuffer),
+                std::bind(&SCSocket::pumpWriteHandler, shared_from_this(), std::placeholders::_1)
+            );
+        }
     }
 
-    void clearIoWriteQueue() {
-        OutQueue().swap(m_outQueue);
+    //  replay() has no peer: encode what would be sent, then drop it
+    void discardWrites() {
+        m_pongPending = false;
+
+        while(!m_outQueue.empty()) {
+            if(m_outQueue.front().payload.is_null()) {
+                m_outQueue.pop();
+                continue;
+            }
+
+            placeNextWriteQueueItemInPayload();
+        }
+
+        m_currentOut    = OutItem();
+        m_currentOutCid = 0;
     }
 
-    void resetPingTimer(const bool cancelOnly = false) {
-        m_pingTimeoutTimer.cancel();
+    void captureFrame(
+        const WireCapture::Direction direction, const WireCapture::Opcode opcode, const char* data, const size_t size)
+    {
+        if(m_capture) {
+            m_capture->record(direction, opcode, data, size);
+        }
+    }
 
-        if(!cancelOnly) {
-            auto self(shared_from_this());
+    void pumpWriteHandler(boost::system::error_code ec) {
+        m_writeInFlight = false;
 
-            //  set updated pingTimeout
-            m_pingTimeoutTimer.expires_from_now(boost::posix_time::milliseconds(m_pingTimeout));
+        if(ec) {
+            //  a read is normally outstanding too and sees the failure; close once, from there
+            if(!m_pumpRunning || !m_readStalled) {
+                return;
+            }
+            return ioErrorHandler(ec);
+        }
 
-            m_pingTimeoutTimer.async_wait( [ self, this ](const boost::system::error_code& ec) {
-                if(ec) {
-                    //  likely canceled
-                    return;
-                }
+        SCIO_BEAST_TRACE(WRITE_COMPLETE, this, m_writeSeq);
 
-                if(m_connectOptions.secure) {
-                    m_wss->close(websocket::close_code::protocol_error);
-                } else {
-                    m_ws->close(websocket::close_code::protocol_error);
-                }
-            });
+        if(m_currentOutCid) {
+            const auto pending = m_pendingResponses.find(m_currentOutCid);
+            if(m_pendingResponses.end() != pending) {
+                pending->second.writtenAt = LatencyClock::now();
+            }
+
+            m_currentOutCid = 0;
         }
+
+        if(m_currentOut.spooled) {
+            m_spool->pop();
+        }
+
+        m_currentOut = OutItem();
+
+        if(m_spoolReplayStalled && !outQueueFull()) {
+            return replaySpool();   //  writes too
+        }
+
+        return startWrite();    //  write more if we can
     }
 
-    void tryChannelSubscribe(SCChannelPtr channel, const ChannelSubscriptionOptions& channelSubOptions) {
+    void recordRpcLatency(const ResponseItem& respItem) {
+        using std::chrono::microseconds;
+        using std::chrono::duration_cast;
 
-        const bool meetsRequirements = !channelSubOptions.waitForAuth || AuthState::AUTHENTICATED == getAuthState();
+        const LatencyClock::time_point now = LatencyClock::now();
 
-        if(State::OPEN == m_state && meetsRequirements) {   //  :TODO: we MUST ensure no other pending subscriptions are also going on here - there can only be one
+        //  a response can beat our write completion handler; count it all as network time then
+        const LatencyClock::time_point writtenAt =
+            LatencyClock::time_point() == respItem.writtenAt ? respItem.enqueuedAt : respItem.writtenAt;
 
-            //  :TODO: need internal emit that waits for AUTH
+        const uint64_t total        = duration_cast<microseconds>(now - respItem.enqueuedAt).count();
+        const uint64_t queueWait    = duration_cast<microseconds>(writtenAt - respItem.enqueuedAt).count();
+        const uint64_t network      = duration_cast<microseconds>(now - writtenAt).count();
 
-            //
-            //  We need to send a subscribe event to the server
-            //
-            json channelSubData = {
-                { "channel",    channel->getName() }
-            };
-    
-            if(!channelSubOptions.data.empty()) {
-                channelSubData["data"] = channelSubOptions.data;
-            }
-    
-            auto self(shared_from_this());
+        boost::lock_guard<boost::mutex> lock(m_latencyLock);
 
-            emit("#subscribe", channelSubData, [ self, this, channel, channelSubOptions ](boost::system::error_code ec, const json&) {
-                if(ec) {
-                    return triggerChannelSubscribeFail(channel, ec, channelSubOptions);
-                }
+        m_rpcLatency.total.record(total);
+        m_rpcLatency.queueWait.record(queueWait);
+        m_rpcLatency.network.record(network);
 
-                triggerChannelSubscribe(channel, channelSubOptions);
-            });
+        if(respItem.eventName.empty()) {
+            return;
         }
+
+        auto it = m_rpcLatencyByEvent.find(respItem.eventName);
+        if(m_rpcLatencyByEvent.end() == it) {
+            const bool full = m_rpcLatencyByEvent.size() >= m_connectOptions.rpcLatencyOptions.maxEventNames;
+            it = m_rpcLatencyByEvent.insert(std::make_pair(
+                full ? RpcLatencyOptions::OTHER_EVENTS() : respItem.eventName, RpcLatency()
+            )).first;
+        }
+
+        it->second.total.record(total);
+        it->second.queueWait.record(queueWait);
+        it->second.network.record(network);
     }
 
-    void triggerChannelSubscribeFail(
-        SCChannelPtr channel, const boost::system::error_code& ec, ChannelSubscriptionOptions channelSubOptions)
-    {
-        const bool meetsRequirements = !channelSubOptions.waitForAuth || AuthState::AUTHENTICATED == getAuthState();
+    void ioPumpReadSome() {
+        if(m_readPaused) {
+            //  stop issuing reads; resumeRead() restarts the pump
+            m_readStalled = true;
+            return;
+        }
+
+        if(m_replayCapture) {
+            return replayNext();
+        }
+
+        if(m_transport) {
+            m_transport->asyncRead(
+                m_buffer,
+                std::bind(&SCSocket::readSomeHandler, shared_from_this(), std::placeholders::_1)
+            );
+        } else if(m_connectOptions.secure) {
+            m_wss->async_read_some(
+                m_buffer,
+                m_readSize.next(),
+                std::bind(&SCSocket::readSomeHandler, shared_from_this(), std::placeholders::_1)
+            );
+        } else {
+            m_ws->async_read_some(
+                m_buffer,
+                m_readSize.next(),
+                std::bind(&SCSocket::readSomeHandler, shared_from_this(), std::placeholders::_1)
+            );
+        }
+    }
+
+    void kickStalledPump() {
+        //  paused reads also park the write pump; let queued writes go out
+        if(m_readStalled) {
+            m_readStalled = false;
+            ioPumpWrite();
+        }
+    }
+
+    bool inboundWithinResumeBudget() const {
+        const BackpressureOptions& bp = m_connectOptions.backpressure;
+
+        if(0 == bp.maxInboundBytes) {
+            return true;
+        }
+
+        const size_t resumeAt = bp.resumeInboundBytes ? bp.resumeInboundBytes : bp.maxInboundBytes / 2;
+        return m_inboundBytes <= resumeAt;
+    }
+
+    //  consumer thread; |batch| ends with the |n| messages just drained
+    void inboxDrained(const ChannelMessageBatch& batch, const size_t n) {
+        size_t bytes = 0;
+        for(size_t i = batch.size() - n; i < batch.size(); ++i) {
+            bytes += batch[i].size;
+        }
 
-        if(ChannelState::UNSUBSCRIBED != channel->getState() && meetsRequirements) {
-            channel->m_state = ChannelState::UNSUBSCRIBED;
+        m_inboundBytes -= bytes;
 
-            //  channel
-            channel->triggerEvent<SCChannel::SubscribeFailEvent>(channel->getName(), ec);
+        //  pairs with the fence in pauseRead(): either we see the pause or it sees our drain
+        std::atomic_thread_fence(std::memory_order_seq_cst);
 
-            //  socket
-            triggerEvent<SubscribeFailEvent>(channel->getName(), ec);
+        if(n && m_readPaused && inboundWithinResumeBudget()) {
+            scheduleResume();
         }
     }
 
-    void triggerChannelSubscribe(SCChannelPtr channel, ChannelSubscriptionOptions channelSubOption) {
-        const ChannelState oldState = channel->getState();
+    void scheduleResume() {
+        if(!m_resumePosted.exchange(true)) {
+            m_ios.post(std::bind(&SCSocket::resumeRead, shared_from_this()));
+        }
+    }
 
-        if(ChannelState::SUBSCRIBED == oldState) {
+    void pauseRead() {
+        if(m_readPaused) {
             return;
         }
 
-        channel->m_state = ChannelState::SUBSCRIBED;
-
-        //  :TODO: JS version passes along channelSubOptions here as well
-        const ChannelStateData stateData = { channel->getName(), oldState, channel->getState() };
+        m_readPaused = true;
+        m_pausedWork.reset(new boost::asio::io_service::work(m_ios));
+        std::atomic_thread_fence(std::memory_order_seq_cst);
 
-        //  channel
-        channel->triggerEvent<SCChannel::SubscriptionStateChangeEvent>(stateData);
-        channel->triggerEvent<SCChannel::SubscribeEvent>(channel->getName());
+        triggerEvent<ReadPausedEvent>(m_inboundBytes.load());
 
-        //  socket
-        triggerEvent<SubscriptionStateChangeEvent>(stateData);
-        triggerEvent<SubscribeEvent>(channel->getName());
+        //  the consumer may have drained before it could observe the pause; re-check once
+        scheduleResume();
     }
 
-    void triggerChannelUnsubscribe(
-        SCChannelPtr channel, const ChannelState newState = ChannelState::UNSUBSCRIBED)
-    {
-        const ChannelState oldState = channel->getState();
-
-        channel->m_state = newState;
-
-        cancelPendingSubscriberCallback(channel);
+    void resumeRead() {
+        m_resumePosted = false;
 
-        if(ChannelState::SUBSCRIBED == oldState) {
-            const ChannelStateData stateData( { channel->getName(), oldState, newState } );
+        while(!m_inboxBacklog.empty()) {
+            auto& pending = m_inboxBacklog.front();
+            Inbox& inbox = pending.first ? *pending.first->m_inbox : *m_inbox;
 
-            //  channel
-            channel->triggerEvent<SCChannel::SubscriptionStateChangeEvent>(stateData);
-            channel->triggerEvent<SCChannel::UnsubscribeEvent>(channel->getName());
+            if(!inbox.tryPush(std::move(pending.second))) {
+                return; //  still full; wait for another drain
+            }
 
-            //  socket
-            triggerEvent<SubscriptionStateChangeEvent>(stateData);
-            triggerEvent<UnsubscribeEvent>(channel->getName());
+            m_inboxBacklog.pop_front();
         }
-    }
 
-    void sendChannelUnsubscribe(SCChannelPtr channel) {
-        //  :TODO: If *our* state is not OPEN, do nothing
+        if(!m_readPaused || !inboundWithinResumeBudget()) {
+            return;
+        }
 
-        cancelPendingSubscriberCallback(channel);
+        m_readPaused = false;
+        m_pausedWork.reset();
+        triggerEvent<ReadResumedEvent>(m_inboundBytes.load());
 
-        //  :TODO: pass noTimeout option
-        emit("#unsubscribe", channel->getName());
+        kickStalledPump();
     }
 
-    void cancelPendingSubscriberCallback(SCChannelPtr channel) {
-        //  :TODO: if we have any pending subscriber callback for this channel, cancel it now
+    void deliverPublish(SCChannelPtr channel, json&& data, const size_t size) {
+        Inbox* inbox = channel->m_inbox ? channel->m_inbox.get() : m_inbox.get();
 
-    }
+        if(!inbox) {
+            return channel->triggerEvent<SCChannel::ChannelEvent>(data);
+        }
 
-    void suspendChannelSubscriptions() {
-        ChannelState newState;
+        ChannelMessage msg = { channel->getName(), std::move(data), size };
 
-        for(const auto& sub : m_channels) {
-            const ChannelState state = sub.second->getState();
+        m_inboundBytes += size;
 
-            if(ChannelState::SUBSCRIBED == state || ChannelState::PENDING == state) {
-                newState = ChannelState::PENDING;
-            } else {
-                newState = ChannelState::UNSUBSCRIBED;
+        if(m_inboxBacklog.empty() && inbox->tryPush(std::move(msg))) {
+            const size_t maxBytes = m_connectOptions.backpressure.maxInboundBytes;
+            if(maxBytes && m_inboundBytes > maxBytes) {
+                pauseRead();
             }
+            return;
+        }
 
-            triggerChannelUnsubscribe(sub.second, newState);
+        //
+        //  Inbox is full: hold on to the message and stop reading until the
+        //  consumer catches up. Order is kept by routing everything through
+        //  the backlog until it empties.
+        //
+        m_inboxBacklog.push_back(std::make_pair(channel->m_inbox ? channel : nullptr, std::move(msg)));
+        pauseRead();
+    }
+
+    inline bool isCurrentMessageComplete() const {
+        if(m_transport) {
+            return true;    //  transports deliver whole messages
         }
+
+        return m_connectOptions.secure ? 
+            m_wss->is_message_done() : 
+            m_ws->is_message_done()
+            ;
     }
 
-    void ioErrorHandler(const boost::system::error_code& ec) {
-        if(boost::asio::error::operation_aborted == ec || boost::asio::error::eof == ec) {
-            return closeHandler(ec, false);
+    inline bool isCurrentMessageBinary() const {
+        if(m_transport) {
+            return m_transport->gotBinary();
         }
 
-        //  :TODO: Handle!
-        std::cout << "Unknown error: " << ec << std::endl << std::flush;
+        return m_connectOptions.secure ?
+            m_wss->got_binary() :
+            m_ws->got_binary()
+            ;
     }
 
-    void closeHandler(const boost::system::error_code& ec, const bool isConnectionAbort) {
-        internalClose();
+    bool shouldStreamMessage() const {
+        return m_connectOptions.streamHandler && m_buffer.size() >= m_connectOptions.streamThreshold;
+    }
 
-        /*
-        m_state = State::CLOSED;
-        
-        clearIoWriteQueue();
-        suspendChannelSubscriptions();
-        */
+    void streamMessageFragment(const bool messageComplete) {
+        IMessageStreamHandler& handler = *m_connectOptions.streamHandler;
 
-        //
-        //  An boost::asio::error::operation_aborted reason is treated as a purposful
-        //  disconnect; we will not attempt auto-reconnect
-        //
-        if(boost::asio::error::operation_aborted != ec && m_connectOptions.autoReconnect) {
-            //  :TODO: when do we not want to try to reconnect? / when do we want to ignore delay?
-            //  see https://github.com/SocketCluster/socketcluster-client/blob/01a66770ea74b0f6185d7c59ea64b3d8bef078c6/lib/scsocket.js#L580
+        if(!m_streamingMessage) {
+            m_streamingMessage = true;
+            handler.onMessageBegin();
+        }
 
-            tryReconnect();
+        handler.onMessageFragment(boost::asio::buffer_cast<const char*>(m_buffer.data()), m_buffer.size());
+
+        MetricCounters::inc(m_metrics.bytesIn, m_buffer.size());
+        m_streamedBytes += m_buffer.size();
+        m_buffer.consume(m_buffer.size());
+
+        //  data is still flowing; don't let a long read trip the ping timeout
+        resetPingTimer();
+
+        if(!messageComplete) {
+            m_readSize.partialRead();
+            return ioPumpReadSome();
         }
 
-        if(isConnectionAbort) {
-            triggerEvent<ConnectAbortEvent>(ec);
-        } else {
-            triggerEvent<DisconnectEvent>(ec);
-        }       
+        m_streamingMessage  = false;
+        m_streamedBytes     = 0;
+        handler.onMessageEnd();
+
+        MetricCounters::inc(m_metrics.messagesIn);
+
+        return ioPumpWrite();
     }
 
-    void tryReconnect(const uint32_t initialDelay = RECONENCT_DELAY_INVALID) {
-        const uint32_t exponent = m_connectAttempts++;
+    void rejectOversizedMessage() {
+        const boost::system::error_code ec = make_error_code(message_too_big);
 
-        uint32_t timeout;
+        triggerEvent<ErrorEvent>(ec);
 
-        if(RECONENCT_DELAY_INVALID == initialDelay || exponent > 0) {
-            std::random_device rd;
-            std::mt19937 gen(rd());
-            std::uniform_real_distribution<> dis(0, 1);
+        internalClose(websocket::close_code::too_big);
+        closeHandler(ec, false);
+    }
 
-            const uint32_t initialTimeout = std::round( 
-                m_connectOptions.autoReconnectOptions.initialDelay + m_connectOptions.autoReconnectOptions.randomness * dis(gen)
-            );
+    void readSomeHandler(boost::system::error_code ec) {
+        if(ec) {
+            return ioErrorHandler(ec);
+        }
 
-            timeout = std::round(initialTimeout * std::pow(m_connectOptions.autoReconnectOptions.multiplier, exponent));
-        } else {
-            timeout = initialDelay;
+        SCIO_BEAST_TRACE(READ_COMPLETE, this, m_metrics.messagesIn.load(std::memory_order_relaxed) + 1);
+
+        if(0 == m_buffer.size()) {
+            return ioPumpWrite();
         }
 
-        if(timeout > m_connectOptions.autoReconnectOptions.maxDelay) {
-            timeout = m_connectOptions.autoReconnectOptions.maxDelay;
+        const bool messageComplete = isCurrentMessageComplete();
+
+        //
+        //  Beast already enforces read_message_max over a whole WebSocket message;
+        //  this covers an IMessageTransport, which has no such limit of its own.
+        //  Streamed fragments leave the buffer as they arrive, so count those too.
+        //
+        if(m_connectOptions.maxMessageSize &&
+            m_streamedBytes + m_buffer.size() > m_connectOptions.maxMessageSize)
+        {
+            return rejectOversizedMessage();
         }
 
-        //  :TODO: clear any existing timer - use m_reconnectTimer for e.g.
+        if(m_streamingMessage || (!messageComplete && shouldStreamMessage())) {
+            return streamMessageFragment(messageComplete);
+        }
 
-        auto self(shared_from_this());
+        if(!messageComplete) {
+            m_readSize.partialRead();
+            return ioPumpReadSome();
+        }
 
-        std::shared_ptr<boost::asio::deadline_timer> timer(new boost::asio::deadline_timer(m_ios, boost::posix_time::milliseconds(timeout)));
-        timer->async_wait( [ self, this, timer ](const boost::system::error_code& ec) {
-            if(ec) {
-                //  :TODO: handle |ec| here
-                return;
-            }
+        m_readSize.messageComplete(m_buffer.size());
 
-            startConnect();
-        });
+        captureFrame(
+            WireCapture::Direction::INBOUND,
+            isCurrentMessageBinary() ? WireCapture::Opcode::BINARY : WireCapture::Opcode::TEXT,
+            boost::asio::buffer_cast<const char*>(m_buffer.data()),
+            m_buffer.size()
+        );
+
+        return processMessage();
     }
 
-    ProtocolEvent getEventType(const json& payload) const {
-        try {
-            std::string const& eventName = payload.at("event");
+    //  decode & dispatch the complete message in |m_buffer|; replay() feeds captures in here too
+    void processMessage() {
+        MetricCounters::inc(m_metrics.messagesIn);
+        MetricCounters::inc(m_metrics.bytesIn, m_buffer.size());
 
-            if("#publish" == eventName) {
-                return ProtocolEvent::PUBLISH;
-            } else if("#removeAuthToken" == eventName) {
-                return ProtocolEvent::REMOVE_TOKEN;
-            } else if("#setAuthToken" == eventName) {
-                return ProtocolEvent::SET_TOKEN;
-            } else {
-                return ProtocolEvent::EVENT;
+        SCIO_BEAST_TRACE(MESSAGE_COMPLETE, this, m_metrics.messagesIn.load(std::memory_order_relaxed));
+
+        //  "raw" event
+        triggerEvent<RawEvent>(m_buffer);
+        
+        const char* bufferData  = boost::asio::buffer_cast<const char*>(m_buffer.data());
+        const size_t bufferSize = m_buffer.size();
+
+        //
+        //  Handle SocketCluster.io built in ping/pong (#1/#2)
+        //
+        if(2 == bufferSize) {
+            if('#' == bufferData[0] && '1' == bufferData[1]) {
+                m_buffer.consume(m_buffer.size());  //  consume ping
+
+                recordPing();
+
+                //  (re)start ping timer
+                resetPingTimer();
+
+                //  the pong jumps the out queue; a second ping before it goes out shares it
+                if(!m_pongPending) {
+                    m_pongPending   = true;
+                    m_pongSeq       = ++m_nextOutSeq;
+
+                    MetricCounters::inc(m_metrics.messagesOut);
+                    MetricCounters::inc(m_metrics.bytesOut, 2);
+
+                    SCIO_BEAST_TRACE(ENQUEUE, this, m_pongSeq);
+                }
+
+                return ioPumpWrite();
             }
-        } catch(std::out_of_range) {
-            //  fall through
         }
 
-        if(1 == payload.value("rid", 0)) {
-            return ProtocolEvent::IS_AUTHENTICATED;
+        //  flat buffer: the message is contiguous
+        const std::string buf(bufferData, bufferSize);
+
+        //  we've consumed all of the current message
+        m_buffer.consume(m_buffer.size());
+    
+        json payload;
+        try {
+            payload = m_connectOptions.codecEngine ?
+                m_connectOptions.codecEngine->decode(buf) :
+                json::parse(buf)
+                ;
+        } catch(std::invalid_argument& ia) {
+            MetricCounters::inc(m_metrics.decodeErrors);
+            triggerEvent<ErrorEvent>(make_error_code(json_parse_failure));
+            return ioPumpWrite();
         }
 
-        return ProtocolEvent::ACK_RECEIVE;
-    }
+        SCIO_BEAST_TRACE(DECODE_DONE, this, m_metrics.messagesIn.load(std::memory_order_relaxed));
 
-    template<size_t HandlerId, typename ...Args>
-    void triggerEvent(Args&& ...args) {
-        (std::get<HandlerId>(m_eventTable))(std::forward<Args>(args)...);
-    }
+        if(payload.is_array() && !payload.empty()) {
+            //
+            //  The server batched several packets into this message. Work through
+            //  them up to |readBatchBudget| at a time before yielding to the io loop.
+            //
+            m_inboundBatchPacketSize    = buf.size() / payload.size();
+            m_inboundBatch              = std::move(payload);
+            m_inboundBatchPos           = 0;
+            m_inboundBatchDispatched    = 0;
 
-    void ioThread() {
-        m_ios.run();
-    }
+            return dispatchInboundBatch();
+        }
 
-    void placeNextWriteQueueItemInPayload() {
-        const json obj = m_outQueue.front();
-        m_outQueue.pop();
+        if(!payload.is_object()) {
+            MetricCounters::inc(m_metrics.decodeErrors);
+            triggerEvent<ErrorEvent>(make_error_code(protocol_error));
+            return ioPumpWrite();
+        }
 
-        m_currentOutBuffer = m_connectOptions.codecEngine ?
-            m_connectOptions.codecEngine->encode(obj) :
-            obj.dump()
-            ;
+        dispatchPacket(payload, buf.size());
+        recordReadWakeup(1);
+
+        return ioPumpWrite();
     }
 
-    void ioPumpWrite() {
-        if(m_outQueue.empty()) {
-            //  nothing to write - try to read
-            return ioPumpReadSome();
-        }
+    //  finds the next inbound message in the capture and schedules it per ReplayOptions::speed
+    void replayNext() {
+        do {
+            if(!m_replayCapture->next(m_replayOffset, m_replayFrame)) {
+                return finishReplay();
+            }
+        } while(WireCapture::Direction::INBOUND != m_replayFrame.direction);
 
-        placeNextWriteQueueItemInPayload();
+        if(m_replayFirstTimestamp.count() < 0) {
+            m_replayFirstTimestamp = m_replayFrame.timestamp;
+        }
 
-        if(m_connectOptions.secure) {
-            m_wss->async_write(
-                boost::asio::buffer(m_currentOutBuffer),
-                std::bind(&SCSocket::pumpWriteHandler, shared_from_this(), std::placeholders::_1)
+        if(m_replayOptions.speed > 0) {
+            const std::chrono::nanoseconds offset = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                (m_replayFrame.timestamp - m_replayFirstTimestamp) / m_replayOptions.speed
             );
-        } else {
-            m_ws->async_write(
-                boost::asio::buffer(m_currentOutBuffer),
-                std::bind(&SCSocket::pumpWriteHandler, shared_from_this(), std::placeholders::_1)
+
+            const std::chrono::microseconds wait = std::chrono::duration_cast<std::chrono::microseconds>(
+                m_replayStarted + offset - std::chrono::steady_clock::now()
             );
-        }
-    }
 
-    void pumpWriteHandler(boost::system::error_code ec) {
-        if(ec) {
-            return ioErrorHandler(ec);
+            if(wait.count() > 0) {
+                auto self(shared_from_this());
+
+                m_replayTimer.expires_from_now(boost::posix_time::microseconds(wait.count()));
+                m_replayTimer.async_wait( [ self, this ](const boost::system::error_code& ec) {
+                    if(!ec) {
+                        replayFrame();
+                    }
+                });
+                return;
+            }
         }
 
-        return ioPumpWrite();   //  write more if we can
+        //  posted rather than called so a long capture doesn't recurse
+        m_ios.post(std::bind(&SCSocket::replayFrame, shared_from_this()));
     }
 
-    void ioPumpReadSome() {
+    void replayFrame() {
+        const WireCapture::Frame& frame = m_replayFrame;
 
-        if(m_connectOptions.secure) {
-            m_wss->async_read_some(
-                m_buffer,
-                0,  //  :TODO: make this part of options
-                std::bind(&SCSocket::readSomeHandler, shared_from_this(), std::placeholders::_1)
-            );
-        } else {
-            m_ws->async_read_some(
-                m_buffer,
-                0,  //  :TODO: make this part of options
-                std::bind(&SCSocket::readSomeHandler, shared_from_this(), std::placeholders::_1)
-            );
-        }
+        m_buffer.commit(boost::asio::buffer_copy(
+            m_buffer.prepare(frame.size), boost::asio::buffer(frame.data, frame.size)
+        ));
+
+        ++m_replayStats.messages;
+        m_replayStats.bytes += frame.size;
+
+        return processMessage();
     }
 
-    inline bool isCurrentMessageComplete() const {
-        return m_connectOptions.secure ? 
-            m_wss->is_message_done() : 
-            m_ws->is_message_done()
-            ;
+    void finishReplay() {
+        m_replayStats.elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - m_replayStarted
+        );
+
+        m_replayCapture.reset();
+
+        //  ack timers & the like would otherwise keep replay() waiting
+        m_ios.stop();
     }
 
-    void readSomeHandler(boost::system::error_code ec) {
-        if(ec) {
-            return ioErrorHandler(ec);
+    void dispatchInboundBatch() {
+        if(m_inboundBatch.empty()) {
+            return; //  connection was closed while we yielded
         }
 
-        if(0 == m_buffer.size()) {
-            return ioPumpWrite();
-        }
+        const size_t budget = std::max<size_t>(1, m_connectOptions.readBatchBudget);
+        size_t dispatched   = 0;
 
-        if(!isCurrentMessageComplete()) {
-            return ioPumpReadSome();
+        while(m_inboundBatchPos < m_inboundBatch.size() && dispatched < budget) {
+            json& packet = m_inboundBatch[m_inboundBatchPos++];
+
+            if(packet.is_object()) {
+                dispatchPacket(packet, m_inboundBatchPacketSize);
+            } else {
+                MetricCounters::inc(m_metrics.decodeErrors);
+                triggerEvent<ErrorEvent>(make_error_code(protocol_error));
+            }
+
+            ++dispatched;
         }
 
-        //  "raw" event
-        triggerEvent<RawEvent>(m_buffer);
-        
-        const auto bufferData = m_buffer.data();
+        m_inboundBatchDispatched += dispatched;
 
-        //
-        //  Handle SocketCluster.io built in ping/pong (#1/#2)
-        //
-        if(2 == boost::asio::buffer_size(bufferData)) {
-            std::array<char, 2> check;
-            boost::asio::buffer_copy(boost::asio::buffer(&check, 2), bufferData);
-            
-            if('#' == check[0] && '1' == check[1]) {
-                m_buffer.consume(m_buffer.size());  //  consume ping
+        if(m_inboundBatchPos < m_inboundBatch.size()) {
+            //  let timers & other queued work run; reading resumes once the batch is done
+            m_ios.post(std::bind(&SCSocket::dispatchInboundBatch, shared_from_this()));
+            return;
+        }
 
-                //  (re)start ping timer
-                resetPingTimer();
+        recordReadWakeup(m_inboundBatchDispatched);
+        m_inboundBatch = json();
 
-                if(m_connectOptions.secure) {
-                    m_wss->async_write(
-                        boost::asio::buffer("#2"),
-                        std::bind(&SCSocket::pumpWriteHandler, shared_from_this(), std::placeholders::_1)
-                    );
-                } else {
-                    m_ws->async_write(
-                        boost::asio::buffer("#2"),
-                        std::bind(&SCSocket::pumpWriteHandler, shared_from_this(), std::placeholders::_1)
-                    );
-                }
+        return ioPumpWrite();
+    }
 
-                return; //  nothing further to do with a ping
-            }
+    void recordReadWakeup(const uint64_t messages) {
+        m_readWakeups.fetch_add(1, std::memory_order_relaxed);
+        m_readMessages.fetch_add(messages, std::memory_order_relaxed);
+
+        if(messages > m_maxMessagesPerWakeup.load(std::memory_order_relaxed)) {
+            m_maxMessagesPerWakeup.store(messages, std::memory_order_relaxed);
         }
+    }
 
-        //  :TODO: there is VERY likely a more optimized way to do this -- see buffer views/etc.
-        std::string buf;
-        {
-            std::stringstream temp;
-            temp << boost::beast::buffers(bufferData);
-            buf = temp.str();
+    void recordPing() {
+        const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+        if(m_metrics.pings.load(std::memory_order_relaxed)) {
+            MetricCounters::set(m_metrics.lastPingIntervalMs,
+                std::chrono::duration_cast<std::chrono::milliseconds>(now - m_lastPing).count());
         }
 
-        //  we've consumed all of the current message
-        m_buffer.consume(m_buffer.size());
-    
-        json payload;
-        try {
-            payload = m_connectOptions.codecEngine ?
-                m_connectOptions.codecEngine->decode(buf) :
-                json::parse(buf)
-                ;
+        MetricCounters::inc(m_metrics.pings);
+        m_lastPing = now;
+    }
 
-            if(!payload.is_object()) {
-                triggerEvent<ErrorEvent>(make_error_code(protocol_error));
-                return ioPumpWrite();
-            }
-        } catch(std::invalid_argument& ia) {
-            triggerEvent<ErrorEvent>(make_error_code(json_parse_failure));
-            return ioPumpWrite();
+    void countInbound(const ProtocolEvent eventType) {
+        switch(eventType) {
+            case ProtocolEvent::PUBLISH             : return MetricCounters::inc(m_metrics.publishesIn);
+            case ProtocolEvent::EVENT               : return MetricCounters::inc(m_metrics.eventsIn);
+            case ProtocolEvent::ACK_RECEIVE         : return MetricCounters::inc(m_metrics.acksIn);
+            case ProtocolEvent::IS_AUTHENTICATED    : return MetricCounters::inc(m_metrics.handshakesIn);
+            case ProtocolEvent::SET_TOKEN           :
+            case ProtocolEvent::REMOVE_TOKEN        : return MetricCounters::inc(m_metrics.authTokenUpdatesIn);
+            default                                 : return MetricCounters::inc(m_metrics.unknownIn);
         }
+    }
 
-        const ProtocolEvent eventType = getEventType(payload);      
+    void dispatchPacket(json& payload, const size_t size) {
+        SCIO_BEAST_TRACE(DISPATCH_BEGIN, this, m_metrics.messagesIn.load(std::memory_order_relaxed));
+
+        dispatchPacketType(payload, size);
+
+        SCIO_BEAST_TRACE(DISPATCH_END, this, m_metrics.messagesIn.load(std::memory_order_relaxed));
+    }
+
+    void dispatchPacketType(json& payload, const size_t size) {
+        const ProtocolEvent eventType = getEventType(payload);
+        countInbound(eventType);
+      
         switch(eventType) {
             case ProtocolEvent::IS_AUTHENTICATED :
+                m_connectAttempts       = 0;
+                m_lastReconnectDelay    = 0;
+
+                releaseAdmission();
+                retransmitRetainedResponses();
+
+                m_handshakeDone = true;
+                replaySpool();
+
+                //  the server rejected (e.g. expired) the token we presented in #handshake
+                if(!m_signedAuthToken.empty() && !handshakeAuthenticated(payload)) {
+                    m_signedAuthToken   = detail::EMPTY_STRING;
+                    m_authToken         = json::object();
+
+                    triggerEvent<DeauthenticateEvent>();
+                }
+
                 //  like JS version, we emit when the handshake is complete.
                 triggerEvent<ConnectEvent>(payload);
                 break;
 
             case ProtocolEvent::PUBLISH :
                 try {
-                    json const& data                = payload.at("data");
+                    json& data                      = payload.at("data");
                     std::string const& channelName  = data.at("channel");
-                    json const& innerData           = data.at("data");
+                    json& innerData                 = data.at("data");
 
                     try {
                         auto channel = m_channels.at(channelName);
-                        channel->triggerEvent<SCChannel::ChannelEvent>(innerData);
+                        deliverPublish(channel, std::move(innerData), size);
                     } catch(std::out_of_range) {
                         //  :TODO: anything?
                     }
@@ -1347,6 +5456,9 @@ private:
 
                             if(oldJwtToken.empty()) {
                                 triggerEvent<AuthenticateEvent>(m_signedAuthToken);
+
+                                //  waitForAuth channels can go now
+                                processPendingSubscriptions();
                             }
 
                             triggerEvent<AuthTokenChangeEvent>(m_signedAuthToken);
@@ -1368,21 +5480,26 @@ private:
 
                     try {
                         const ResponseItem respItem = m_pendingResponses.at(rid);
+                        m_pendingResponses.erase(rid);
 
                         //  cancel ACK timer, if any
                         if(respItem.ackTimer) {
                             respItem.ackTimer->cancel();
                         }
 
+                        recordRpcLatency(respItem);
+
                         try {
                             json const& error = payload.at("error");
 
-                            respItem.handler(
+                            invokeResponseHandler(
+                                respItem,
                                 make_error_code(response_error),
                                 error
                             );
                         } catch(std::out_of_range) {
-                            respItem.handler(
+                            invokeResponseHandler(
+                                respItem,
                                 boost::system::error_code(),
                                 payload.value("data", json::object())   //  data is optional
                             );
@@ -1413,7 +5530,7 @@ private:
                                     { "data",       resp },
                                 };
 
-                                m_outQueue.push(emitRespPayload);
+                                queueOut(emitRespPayload);
                             }
                         );
                     } else {
@@ -1432,30 +5549,273 @@ private:
                 std::cout << "unknown event read " << std::dec << (int)eventType << std::endl << payload << std::endl;
                 break;
         }
-
-        return ioPumpWrite();
     }
 
     void resolveHandler(boost::system::error_code ec, tcp::resolver::iterator resolveIter) {
+        const ResolverCache::Endpoints endpoints(resolveIter, tcp::resolver::iterator());
+
+        if(m_resolveInFlight) {
+            m_resolveInFlight = false;
+            m_connectOptions.resolverCache->completeResolve(resolverCacheKey(), ec, endpoints);
+        }
+
+        if(ec) {
+            return closeHandler(ec, true);
+        }
+
+        connectEndpoints(endpoints);
+    }
+
+    //  another socket's resolve, which we joined on a ResolverCache miss, completed
+    void sharedResolveHandler(const boost::system::error_code& ec, const ResolverCache::Endpoints& endpoints) {
+        if(State::CONNECTING != m_state) {
+            return;
+        }
+
+        if(boost::asio::error::operation_aborted == ec) {
+            return beginConnect();  //  that socket was closed first; resolve ourselves
+        }
+
+        if(ec) {
+            return closeHandler(ec, true);
+        }
+
+        connectEndpoints(endpoints);
+    }
+
+    //
+    //  The io loop was stopped with resolves outstanding whose handlers will now never
+    //  run; let other sockets resolve in their place.
+    //
+    void abandonResolves() {
+        const auto& resolverCache = m_connectOptions.resolverCache;
+
+        if(m_resolveInFlight) {
+            m_resolveInFlight = false;
+            resolverCache->completeResolve(
+                resolverCacheKey(), boost::asio::error::operation_aborted, ResolverCache::Endpoints()
+            );
+        }
+
+        if(m_refreshInFlight) {
+            m_refreshInFlight = false;
+            resolverCache->refreshFailed(resolverCacheKey());
+        }
+    }
+
+    void connectEndpoints(const ResolverCache::Endpoints& endpoints) {
+        if(endpoints.empty()) {
+            return closeHandler(boost::asio::error::host_not_found, true);
+        }
+
+        auto self(shared_from_this());
+        std::shared_ptr<ConnectRace> race = std::make_shared<ConnectRace>(m_ios);
+
+        race->endpoints = interleaveAddressFamilies(endpoints);
+        race->started   = std::chrono::steady_clock::now();
+
+        const uint32_t timeout = m_connectOptions.connectAttemptOptions.timeout;
+        if(timeout) {
+            race->timeoutTimer.expires_from_now(boost::posix_time::milliseconds(timeout));
+            race->timeoutTimer.async_wait( [ self, this, race ](const boost::system::error_code& ec) {
+                if(ec || race->done) {
+                    return;
+                }
+
+                finishConnectRace(race, boost::asio::error::timed_out);
+            });
+        }
+
+        startNextConnectAttempt(race);
+    }
+
+    //  RFC 8305 section 4: alternate address families, starting with the first returned
+    static ResolverCache::Endpoints interleaveAddressFamilies(const ResolverCache::Endpoints& endpoints) {
+        ResolverCache::Endpoints primary;
+        ResolverCache::Endpoints secondary;
+
+        const bool firstIsV6 = endpoints.front().address().is_v6();
+        for(const auto& ep : endpoints) {
+            (ep.address().is_v6() == firstIsV6 ? primary : secondary).push_back(ep);
+        }
+
+        ResolverCache::Endpoints ordered;
+        ordered.reserve(endpoints.size());
+
+        for(size_t i = 0; i < std::max(primary.size(), secondary.size()); ++i) {
+            if(i < primary.size()) {
+                ordered.push_back(primary[i]);
+            }
+            if(i < secondary.size()) {
+                ordered.push_back(secondary[i]);
+            }
+        }
+
+        return ordered;
+    }
+
+    void startNextConnectAttempt(std::shared_ptr<ConnectRace> race) {
+        if(race->done || race->next >= race->endpoints.size()) {
+            return;
+        }
+
+        auto self(shared_from_this());
+        const size_t index = race->next++;
+
+        race->sockets.emplace_back(new tcp::socket(m_ios));
+        ++race->pending;
+
+        boost::system::error_code openEc;
+        race->sockets.back()->open(race->endpoints[index].protocol(), openEc);
+        if(!openEc) {
+            applyTransportOptions(*race->sockets.back(), true);
+        }
+
+        race->sockets.back()->async_connect(
+            race->endpoints[index],
+            [ self, this, race, index ](const boost::system::error_code& ec) {
+                connectAttemptHandler(race, index, ec);
+            }
+        );
+
+        if(race->next < race->endpoints.size()) {
+            race->staggerTimer.expires_from_now(
+                boost::posix_time::milliseconds(m_connectOptions.connectAttemptOptions.attemptDelay)
+            );
+            race->staggerTimer.async_wait( [ self, this, race ](const boost::system::error_code& ec) {
+                if(ec || race->done) {
+                    return;
+                }
+
+                startNextConnectAttempt(race);
+            });
+        }
+    }
+
+    template <typename Option>
+    void setTransportOption(tcp::socket& sock, const Option& option) {
+        boost::system::error_code ec;
+        sock.set_option(option, ec);
+
         if(ec) {
+            triggerEvent<ErrorEvent>(ec);   //  report, but carry on with defaults
+        }
+    }
+
+    void applyTransportOptions(tcp::socket& sock, const bool preConnect) {
+        const TransportOptions& opts = m_connectOptions.transportOptions;
+
+        if(preConnect) {
+            if(opts.receiveBufferSize > 0) {
+                setTransportOption(sock, boost::asio::socket_base::receive_buffer_size(opts.receiveBufferSize));
+            }
+            if(opts.sendBufferSize > 0) {
+                setTransportOption(sock, boost::asio::socket_base::send_buffer_size(opts.sendBufferSize));
+            }
+            return;
+        }
+
+        if(opts.noDelay) {
+            setTransportOption(sock, tcp::no_delay(true));
+        }
+
+        if(opts.keepAlive) {
+            setTransportOption(sock, boost::asio::socket_base::keep_alive(true));
+
+#if defined(__linux__)
+            typedef detail::IntegerSocketOption<IPPROTO_TCP, TCP_KEEPIDLE>    KeepAliveIdle;
+            typedef detail::IntegerSocketOption<IPPROTO_TCP, TCP_KEEPINTVL>   KeepAliveInterval;
+            typedef detail::IntegerSocketOption<IPPROTO_TCP, TCP_KEEPCNT>     KeepAliveCount;
+
+            if(opts.keepAliveIdle > 0) {
+                setTransportOption(sock, KeepAliveIdle(opts.keepAliveIdle));
+            }
+            if(opts.keepAliveInterval > 0) {
+                setTransportOption(sock, KeepAliveInterval(opts.keepAliveInterval));
+            }
+            if(opts.keepAliveCount > 0) {
+                setTransportOption(sock, KeepAliveCount(opts.keepAliveCount));
+            }
+#endif
+        }
+
+#if defined(__linux__)
+        if(opts.quickAck) {
+            setTransportOption(sock, detail::IntegerSocketOption<IPPROTO_TCP, TCP_QUICKACK>(1));
+        }
+
+#if defined(SO_BUSY_POLL)
+        if(opts.busyPoll > 0) {
+            setTransportOption(sock, detail::IntegerSocketOption<SOL_SOCKET, SO_BUSY_POLL>(opts.busyPoll));
+        }
+#endif
+#endif
+    }
+
+    void connectAttemptHandler(std::shared_ptr<ConnectRace> race, const size_t index, const boost::system::error_code& ec) {
+        --race->pending;
+
+        if(race->done) {
+            return; //  lost the race
+        }
+
+        if(!ec) {
+            return finishConnectRace(race, ec, index);
+        }
+
+        if(race->next < race->endpoints.size()) {
+            //  don't wait out the stagger delay once an attempt has failed
+            race->staggerTimer.cancel();
+            return startNextConnectAttempt(race);
+        }
+
+        if(0 == race->pending) {
+            finishConnectRace(race, ec);
+        }
+    }
+
+    void finishConnectRace(
+        std::shared_ptr<ConnectRace> race, const boost::system::error_code& ec, 
+        const size_t winner = std::numeric_limits<size_t>::max())
+    {
+        race->done = true;
+
+        race->staggerTimer.cancel();
+        race->timeoutTimer.cancel();
+
+        for(size_t i = 0; i < race->sockets.size(); ++i) {
+            if(i != winner) {
+                boost::system::error_code ignored;
+                race->sockets[i]->close(ignored);
+            }
+        }
+
+        if(winner >= race->sockets.size()) {
             return closeHandler(ec, true);
         }
 
+        {
+            boost::lock_guard<boost::mutex> lock(m_connectStatsLock);
+
+            m_lastConnectStats.endpoint         = race->endpoints[winner];
+            m_lastConnectStats.attemptIndex     = winner;
+            m_lastConnectStats.attemptsStarted  = race->next;
+            m_lastConnectStats.elapsed          = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - race->started
+            );
+        }
+
+        applyTransportOptions(*race->sockets[winner], false);
+
         if(m_connectOptions.secure) {
             //
             //  For TLS/SSL we have an additional handshake step
             //
-            boost::asio::async_connect(
-                m_wss->next_layer().next_layer(),
-                resolveIter,
-                std::bind(&SCSocket::secureConnectHandler, shared_from_this(), std::placeholders::_1)
-            );
+            m_wss->next_layer().next_layer() = std::move(*race->sockets[winner]);
+            secureConnectHandler(ec);
         } else {
-            boost::asio::async_connect(
-                m_ws->next_layer(), 
-                resolveIter,
-                std::bind(&SCSocket::connectHandler, shared_from_this(), std::placeholders::_1)
-            );
+            m_ws->next_layer() = std::move(*race->sockets[winner]);
+            connectHandler(ec);
         }
     }
 
@@ -1464,12 +5824,30 @@ private:
             return closeHandler(ec, true);
         }
 
+        const auto& sessionCache = m_connectOptions.secureOptions.sessionCache;
+        if(sessionCache) {
+            sessionCache->apply(tlsSessionKey(), m_wss->next_layer().native_handle());
+        }
+
         m_wss->next_layer().async_handshake(
             ssl::stream_base::client,
-            std::bind(&SCSocket::connectHandler, shared_from_this(), std::placeholders::_1)
+            std::bind(&SCSocket::secureHandshakeHandler, shared_from_this(), std::placeholders::_1)
         );
     }
 
+    void secureHandshakeHandler(boost::system::error_code ec) {
+        const auto& sessionCache = m_connectOptions.secureOptions.sessionCache;
+
+        if(!ec && sessionCache) {
+            SSL* ssl = m_wss->next_layer().native_handle();
+
+            sessionCache->recordHandshake(0 != ::SSL_session_reused(ssl));
+            sessionCache->store(tlsSessionKey(), ssl);
+        }
+
+        connectHandler(ec);
+    }
+
     void connectHandler(boost::system::error_code ec) {
         if(ec) {
             return closeHandler(ec, true);
@@ -1500,6 +5878,33 @@ private:
         );
     }
 
+    void openTransport() {
+        m_transport = m_connectOptions.transportFactory();
+
+        if(!m_transport) {
+            return closeHandler(boost::asio::error::connection_refused, true);
+        }
+
+        m_transport->asyncOpen(
+            m_ios,
+            std::bind(&SCSocket::transportOpenHandler, shared_from_this(), m_transport, std::placeholders::_1)
+        );
+    }
+
+    void transportOpenHandler(MessageTransportPtr transport, const boost::system::error_code& ec) {
+        if(transport != m_transport) {
+            return; //  superseded
+        }
+
+        if(ec) {
+            return closeHandler(ec, true);
+        }
+
+        m_state = State::OPEN;
+
+        return initialHandshakeHandler(ec);
+    }
+
     void initialHandshakeHandler(boost::system::error_code ec) {
         if(ec) {
             //  :TODO: emit error
@@ -1508,20 +5913,40 @@ private:
         }
 
         //
-        //  Send out a #handshake. We can't use emit as it's a special case
+        //  Send out a #handshake. We can't use emit as it's a special case. Presenting
+        //  the token we hold lets the server restore our session without an extra
+        //  #authenticate round trip.
         //
+        json authToken = nullptr;
+        if(!m_signedAuthToken.empty()) {
+            authToken = m_signedAuthToken;
+        }
+
+        m_handshakeCallId = m_nextCallId++;
+        m_pumpRunning     = true;
+
         const json handshakePayload = {
             { "event",  "#handshake" },
-            { "data",   nullptr },
-            //{ "data", {{ "authToken", nullptr }} },
-            { "cid",    m_nextCallId++ }
+            { "data",   {{ "authToken", authToken }} },
+            { "cid",    m_handshakeCallId }
         };
 
-        m_outQueue.push(handshakePayload);
+        queueOut(handshakePayload);
+
+        //
+        //  Pipeline resubscriptions behind the handshake; the server processes them in
+        //  order, so they go out in the same write as the #handshake itself.
+        //
+        processPendingSubscriptions();
 
         return ioPumpWrite();
     }
 
+    static bool handshakeAuthenticated(const json& payload) {
+        const auto data = payload.find("data");
+        return payload.end() != data && data->is_object() && data->value("isAuthenticated", false);
+    }
+
     bool haveBinaryCodec() const {
         return m_connectOptions.codecEngine && m_connectOptions.codecEngine->isBinary();
     }
@@ -1536,9 +5961,40 @@ void SCChannel::destroy() {
     m_socket->destroyChannel(m_name);
 }
 
+template<size_t HandlerId, typename ...Args>
+void SCChannel::triggerEvent(Args&& ...args) {
+    if(0 == m_socket->m_connectOptions.watchdogOptions.slowHandlerThreshold) {
+        (std::get<HandlerId>(m_eventTable))(std::forward<Args>(args)...);
+        return;
+    }
+
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    (std::get<HandlerId>(m_eventTable))(std::forward<Args>(args)...);
+
+    m_socket->checkHandlerDuration(HandlerId, m_name, start);
+}
+
+size_t SCChannel::drain(ChannelMessageBatch& batch, const size_t maxN) {
+    if(!m_inbox) {
+        return 0;
+    }
+
+    const size_t n = m_inbox->popBatch(batch, maxN);
+    m_socket->inboxDrained(batch, n);
+    return n;
+}
+
 class SocketClusterClientOptions {
 public:
+    SocketClusterClientOptions()
+        : shareResolverCache(true)
+    {
+    }
+
     ConnectOptions          connectOptions;
+    bool                    shareResolverCache; //  one ResolverCache for all sockets of the client
+    ConnectAdmissionOptions connectAdmission;   //  limits connect attempts across all sockets of the client
 };
 
 class SocketClusterClient
@@ -1564,25 +6020,58 @@ public:
     }
 
     void shutdown() {
-        for(auto& client : m_clientSockets) {
+        ClientSockets sockets;
+        {
+            boost::lock_guard<boost::mutex> lock(m_socketsLock);
+            sockets.swap(m_clientSockets);
+        }
+
+        for(auto& client : sockets) {
             client->close();
         }
+    }
+
+    //  totals across all sockets of this client; gauges are summed, maxima kept
+    SocketMetrics snapshot() const {
+        SocketMetrics total = SocketMetrics();
+
+        boost::lock_guard<boost::mutex> lock(m_socketsLock);
+        for(const auto& socket : m_clientSockets) {
+            total += socket->snapshot();
+        }
 
-        m_clientSockets.clear();
+        return total;
     }
 
+    //  null unless SocketClusterClientOptions::connectAdmission sets a limit and a socket was created
+    std::shared_ptr<ConnectAdmission> getConnectAdmission() const { return m_connectAdmission; }
+
     SCSocketPtr socket() { return socket(m_clientOpts.connectOptions); }
     
     SCSocketPtr socket(const ConnectOptions& connectOpts) {
         SCSocketPtr socket;
 
         if(connectOpts.secure) {                        
-            socket = std::make_shared<SCSocket>(connectOpts);
+            ConnectOptions secureConnectOpts(connectOpts);
+            SecureConnectOptions& secureOpts = secureConnectOpts.secureOptions;
+
+            if(secureOpts.context && !secureOpts.sessionCache) {
+                std::shared_ptr<TlsSessionCache>& cache = m_tlsSessionCaches[secureOpts.context];
+                if(!cache) {
+                    cache.reset(new TlsSessionCache());
+                }
+                secureOpts.sessionCache = cache;
+            }
+
+            socket = std::make_shared<SCSocket>(withSharedClientState(secureConnectOpts));
         } else {
-            socket = std::make_shared<SCSocket>(connectOpts);
+            socket = std::make_shared<SCSocket>(withSharedClientState(connectOpts));
         }
         
-        m_clientSockets.insert(socket);
+        {
+            boost::lock_guard<boost::mutex> lock(m_socketsLock);
+            m_clientSockets.insert(socket);
+        }
 
         return socket;
     }
@@ -1591,11 +6080,37 @@ protected:
         explicit PrivateTag(int) {}
     };
 
+    ConnectOptions withSharedClientState(const ConnectOptions& connectOpts) {
+        ConnectOptions opts(connectOpts);
+
+        const ConnectAdmissionOptions& admissionOpts = m_clientOpts.connectAdmission;
+        if(!opts.connectAdmission && (admissionOpts.maxInFlight || admissionOpts.ratePerSecond > 0)) {
+            if(!m_connectAdmission) {
+                m_connectAdmission.reset(new ConnectAdmission(admissionOpts));
+            }
+            opts.connectAdmission = m_connectAdmission;
+        }
+
+        if(m_clientOpts.shareResolverCache && !opts.resolverCache) {
+            if(!m_resolverCache) {
+                m_resolverCache.reset(new ResolverCache());
+            }
+            opts.resolverCache = m_resolverCache;
+        }
+
+        return opts;
+    }
+
 private:
     typedef std::set<SCSocketPtr> ClientSockets;
+    typedef std::map<std::shared_ptr<ssl::context>, std::shared_ptr<TlsSessionCache>> TlsSessionCaches;
 
     SocketClusterClientOptions      m_clientOpts;
+    mutable boost::mutex            m_socketsLock;  //  guards m_clientSockets for snapshot()
     ClientSockets                   m_clientSockets;
+    TlsSessionCaches                m_tlsSessionCaches;
+    std::shared_ptr<ResolverCache>  m_resolverCache;
+    std::shared_ptr<ConnectAdmission>   m_connectAdmission;
 };
 
 }   //  end scio_beast ns
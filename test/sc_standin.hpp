@@ -0,0 +1,1050 @@
+/*
+    Copyright (c) 2017, Bryan D. Ashby
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+      * Redistributions of source code must retain the above copyright notice,
+        this list of conditions and the following disclaimer.
+      * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+    LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+    OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+    DAMAGE.
+*/
+#ifndef SOCKETCLUSTER_IO_BEAST_STANDIN_H
+#define SOCKETCLUSTER_IO_BEAST_STANDIN_H
+
+#pragma once
+
+//
+//  In-process stand-in for a SocketCluster server, for tests and benchmarks that
+//  should not need Node. It speaks enough of the protocol for SCSocket: #handshake,
+//  #1/#2 ping/pong, emit/ack, #subscribe/#unsubscribe, #publish fan-out and
+//  #setAuthToken, in JSON or (with a CodecEngineMinBin) min-bin.
+//
+//  Protocol holds the protocol logic and knows nothing about sockets; it turns an
+//  inbound packet into Outbound packets. Server is the Beast I/O around it: one
+//  acceptor and all sessions on a single io_service thread. connectInMemory()
+//  serves a MemoryTransport instead, skipping TCP and WebSocket entirely.
+//
+
+#include "../src/scio_beast.hpp"
+
+#include <functional>
+#include <future>
+#include <string>
+
+#include <openssl/evp.h>
+#include <openssl/rsa.h>
+#include <openssl/x509.h>
+
+namespace scio_beast {
+    namespace standin {
+
+typedef uint64_t ConnectionId;
+
+//
+//  Server behaviour that tests and benchmarks script. Delays are in milliseconds.
+//
+class StandinOptions {
+public:
+    StandinOptions()
+        : handshakeDelay(0)
+        , ackDelay(0)
+        , pingInterval(0)
+        , pingTimeout(20000)
+        , perMessageDeflate(false)
+    {
+    }
+
+    uint32_t                        handshakeDelay;
+    uint32_t                        ackDelay;           //  default for Call::ackDelay
+    uint32_t                        pingInterval;       //  0 disables #1 pings
+    uint32_t                        pingTimeout;        //  advertised in the #handshake response
+    bool                            perMessageDeflate;
+    std::shared_ptr<ICodecEngine>   codecEngine;        //  must match the client's; null for JSON
+    std::shared_ptr<ssl::context>   sslContext;         //  serve wss:// with this, e.g. selfSignedContext()
+};
+
+//
+//  A user event as seen by a handler. Handlers fill in the reply; |cid| is 0
+//  when the client did not ask for one, and nothing is sent back then.
+//
+struct Call {
+    ConnectionId    conn;
+    std::string     event;
+    json            data;
+    CallId          cid;
+    json            response;   //  sent as "data" of the ack
+    json            error;      //  non-null sends an error ack instead
+    uint32_t        ackDelay;
+    json            authToken;  //  non-null issues a #setAuthToken carrying this payload
+};
+
+typedef std::function<void(Call& call)> EventHandler;
+
+struct Outbound {
+    ConnectionId    to;
+    json            packet;
+    uint32_t        delay;      //  milliseconds
+};
+
+typedef std::vector<Outbound> Outbox;
+
+struct StandinStats {
+    StandinStats()
+        : connections(0), messagesIn(0), messagesOut(0), pongs(0)
+        , emits(0), publishesIn(0), publishesOut(0), subscriptions(0)
+    {
+    }
+
+    uint64_t        connections;    //  gauge
+    uint64_t        messagesIn;
+    uint64_t        messagesOut;
+    uint64_t        pongs;
+    uint64_t        emits;          //  user events
+    uint64_t        publishesIn;
+    uint64_t        publishesOut;   //  after fan-out
+    uint64_t        subscriptions;  //  gauge
+};
+
+//
+//  SC protocol state machine. Not thread safe; Server only calls it from its io thread.
+//
+class Protocol
+    : private boost::noncopyable
+{
+public:
+    explicit Protocol(const StandinOptions& options)
+        : m_options(options)
+        , m_nextTokenId(1)
+    {
+    }
+
+    //  Events without a handler are acked with their own data, so emit round
+    //  trips work out of the box.
+    void on(const std::string& event, EventHandler handler) {
+        m_handlers[event] = handler;
+    }
+
+    void onOpen(const ConnectionId conn) {
+        m_connections.insert(conn);
+        m_stats.connections = m_connections.size();
+    }
+
+    void onClose(const ConnectionId conn) {
+        m_connections.erase(conn);
+
+        for(auto it = m_channels.begin(); it != m_channels.end(); ) {
+            it->second.erase(conn);
+            it = it->second.empty() ? m_channels.erase(it) : std::next(it);
+        }
+
+        m_stats.connections     = m_connections.size();
+        m_stats.subscriptions   = subscriptionCount();
+    }
+
+    void onPong(const ConnectionId) {
+        ++m_stats.pongs;
+    }
+
+    void onSent(const ConnectionId) {
+        ++m_stats.messagesOut;
+    }
+
+    //  |message| is a decoded WebSocket message: one packet or an array of them
+    void onMessage(const ConnectionId conn, const json& message, Outbox& out) {
+        ++m_stats.messagesIn;
+
+        if(message.is_array()) {
+            for(const auto& packet : message) {
+                onPacket(conn, packet, out);
+            }
+        } else {
+            onPacket(conn, message, out);
+        }
+    }
+
+    //  server side publish; reaches every subscriber of |channel|
+    void publish(const std::string& channel, const json& data, Outbox& out) {
+        const auto subscribers = m_channels.find(channel);
+        if(m_channels.end() == subscribers) {
+            return;
+        }
+
+        const json packet = {
+            { "event",  "#publish" },
+            { "data",   {
+                { "channel",    channel },
+                { "data",       data }
+            }}
+        };
+
+        for(const ConnectionId conn : subscribers->second) {
+            out.push_back( { conn, packet, 0 } );
+        }
+
+        m_stats.publishesOut += subscribers->second.size();
+    }
+
+    void setAuthToken(const ConnectionId conn, const json& token, Outbox& out) {
+        const std::string signedToken = signToken(token);
+
+        m_issuedTokens.insert(signedToken);
+
+        const json packet = {
+            { "event",  "#setAuthToken" },
+            { "data",   {
+                { "token",          signedToken },
+                { "pingTimeout",    m_options.pingTimeout }
+            }}
+        };
+
+        out.push_back( { conn, packet, 0 } );
+    }
+
+    size_t subscriberCount(const std::string& channel) const {
+        const auto subscribers = m_channels.find(channel);
+        return m_channels.end() == subscribers ? 0 : subscribers->second.size();
+    }
+
+    const std::set<ConnectionId>& connections() const { return m_connections; }
+    const StandinStats& stats() const { return m_stats; }
+
+    //
+    //  Unsigned JWT-looking token. The claims are space padded to a multiple of
+    //  3 bytes so the base64 needs no '=' padding, which SCSocket's decoder rejects.
+    //
+    std::string signToken(json token) {
+        token["jti"] = m_nextTokenId++;
+
+        std::string claims = token.dump();
+        claims.append((3 - claims.size() % 3) % 3, ' ');
+
+        return base64(R"({"alg":"none","typ":"JWT"} )") + "." + base64(claims) + ".standin";
+    }
+
+private:
+    typedef std::map<std::string, EventHandler>                 Handlers;
+    typedef std::map<std::string, std::set<ConnectionId>>       Channels;
+
+    void onPacket(const ConnectionId conn, const json& packet, Outbox& out) {
+        if(!packet.is_object()) {
+            return;
+        }
+
+        const auto eventIt = packet.find("event");
+        if(packet.end() == eventIt || !eventIt->is_string()) {
+            return; //  an ack for something we sent; we never ask for any
+        }
+
+        const std::string event = *eventIt;
+        const CallId cid        = packet.value("cid", CallId(0));
+        const json data         = packet.value("data", json());
+
+        if("#handshake" == event) {
+            return handshake(conn, cid, data, out);
+        }
+
+        if("#subscribe" == event) {
+            if(data.is_object() && data.value("channel", json()).is_string()) {
+                m_channels[data["channel"].get<std::string>()].insert(conn);
+                m_stats.subscriptions = subscriptionCount();
+            }
+            return ack(conn, cid, nullptr, nullptr, m_options.ackDelay, out);
+        }
+
+        if("#unsubscribe" == event) {
+            if(data.is_string()) {
+                const auto subscribers = m_channels.find(data.get<std::string>());
+                if(m_channels.end() != subscribers) {
+                    subscribers->second.erase(conn);
+                    if(subscribers->second.empty()) {
+                        m_channels.erase(subscribers);
+                    }
+                }
+                m_stats.subscriptions = subscriptionCount();
+            }
+            return ack(conn, cid, nullptr, nullptr, m_options.ackDelay, out);
+        }
+
+        if("#publish" == event) {
+            ++m_stats.publishesIn;
+            if(data.is_object() && data.value("channel", json()).is_string()) {
+                publish(data["channel"].get<std::string>(), data.value("data", json()), out);
+            }
+            return ack(conn, cid, nullptr, nullptr, m_options.ackDelay, out);
+        }
+
+        ++m_stats.emits;
+
+        Call call = { conn, event, data, cid, data, nullptr, m_options.ackDelay, nullptr };
+
+        const auto handler = m_handlers.find(event);
+        if(m_handlers.end() != handler) {
+            call.response = nullptr;
+            handler->second(call);
+        }
+
+        ack(conn, cid, call.response, call.error, call.ackDelay, out);
+
+        if(!call.authToken.is_null()) {
+            setAuthToken(conn, call.authToken, out);
+        }
+    }
+
+    void handshake(const ConnectionId conn, const CallId cid, const json& data, Outbox& out) {
+        const json token = data.is_object() ? data.value("authToken", json()) : json();
+
+        const bool isAuthenticated =
+            token.is_string() && m_issuedTokens.count(token.get<std::string>()) > 0;
+
+        const json packet = {
+            { "rid",    cid },
+            { "data",   {
+                { "id",                 "standin-" + std::to_string(conn) },
+                { "pingTimeout",        m_options.pingTimeout },
+                { "isAuthenticated",    isAuthenticated }
+            }}
+        };
+
+        out.push_back( { conn, packet, m_options.handshakeDelay } );
+    }
+
+    void ack(
+        const ConnectionId conn, const CallId cid, const json& response, const json& error,
+        const uint32_t delay, Outbox& out)
+    {
+        if(0 == cid) {
+            return;
+        }
+
+        json packet = { { "rid", cid } };
+        if(!error.is_null()) {
+            packet["error"] = error;
+        } else {
+            packet["data"] = response;
+        }
+
+        out.push_back( { conn, packet, delay } );
+    }
+
+    uint64_t subscriptionCount() const {
+        uint64_t n = 0;
+        for(const auto& channel : m_channels) {
+            n += channel.second.size();
+        }
+        return n;
+    }
+
+    static std::string base64(const std::string& in) {
+        static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+        std::string out;
+        out.reserve((in.size() + 2) / 3 * 4);
+
+        for(size_t i = 0; i < in.size(); i += 3) {
+            const size_t n = std::min<size_t>(3, in.size() - i);
+
+            uint32_t v = static_cast<uint8_t>(in[i]) << 16;
+            if(n > 1) { v |= static_cast<uint8_t>(in[i + 1]) << 8; }
+            if(n > 2) { v |= static_cast<uint8_t>(in[i + 2]); }
+
+            for(size_t j = 0; j < n + 1; ++j) {
+                out.push_back(alphabet[(v >> (18 - 6 * j)) & 0x3f]);
+            }
+        }
+
+        return out;
+    }
+
+    StandinOptions              m_options;
+    Handlers                    m_handlers;
+    std::set<ConnectionId>      m_connections;
+    Channels                    m_channels;
+    std::set<std::string>       m_issuedTokens;
+    uint64_t                    m_nextTokenId;
+    StandinStats                m_stats;
+};
+
+//
+//  Server context with a throwaway RSA key and self-signed certificate for
+//  |commonName|. SCSocket only checks the peer when public key pins are set.
+//
+inline std::shared_ptr<ssl::context> selfSignedContext(const std::string& commonName = "localhost") {
+    std::shared_ptr<EVP_PKEY> key(EVP_PKEY_new(), EVP_PKEY_free);
+    {
+        EVP_PKEY* generated = nullptr;
+        std::shared_ptr<EVP_PKEY_CTX> kctx(EVP_PKEY_CTX_new_id(EVP_PKEY_RSA, nullptr), EVP_PKEY_CTX_free);
+        if(!kctx || EVP_PKEY_keygen_init(kctx.get()) <= 0 ||
+            EVP_PKEY_CTX_set_rsa_keygen_bits(kctx.get(), 2048) <= 0 ||
+            EVP_PKEY_keygen(kctx.get(), &generated) <= 0)
+        {
+            throw std::runtime_error("standin: key generation failed");
+        }
+        key.reset(generated, EVP_PKEY_free);
+    }
+
+    std::shared_ptr<X509> cert(X509_new(), X509_free);
+    X509_set_version(cert.get(), 2);
+    ASN1_INTEGER_set(X509_get_serialNumber(cert.get()), 1);
+    X509_gmtime_adj(X509_get_notBefore(cert.get()), 0);
+    X509_gmtime_adj(X509_get_notAfter(cert.get()), 60 * 60 * 24);
+    X509_set_pubkey(cert.get(), key.get());
+
+    X509_NAME* name = X509_get_subject_name(cert.get());
+    X509_NAME_add_entry_by_txt(
+        name, "CN", MBSTRING_ASC, reinterpret_cast<const unsigned char*>(commonName.c_str()), -1, -1, 0);
+    X509_set_issuer_name(cert.get(), name);
+
+    if(!X509_sign(cert.get(), key.get(), EVP_sha256())) {
+        throw std::runtime_error("standin: certificate signing failed");
+    }
+
+    auto ctx = std::make_shared<ssl::context>(ssl::context::sslv23_server);
+    SSL_CTX_use_certificate(ctx->native_handle(), cert.get());
+    SSL_CTX_use_PrivateKey(ctx->native_handle(), key.get());
+
+    return ctx;
+}
+
+class Server;
+
+class ISession {
+public:
+    virtual ~ISession() {}
+
+    virtual ConnectionId getId() const = 0;
+    virtual void start() = 0;
+    virtual void send(const json& packet, const uint32_t delay) = 0;
+    virtual void close() = 0;
+    virtual void sendClose() = 0;
+    virtual void restartPingTimer() = 0;
+};
+
+typedef std::shared_ptr<ISession> SessionPtr;
+
+typedef websocket::stream<boost::asio::ip::tcp::socket>                          PlainWebSocket;
+typedef websocket::stream<boost::asio::ssl::stream<boost::asio::ip::tcp::socket>> SecureWebSocket;
+
+inline boost::asio::ip::tcp::socket& lowestLayer(PlainWebSocket& ws) { return ws.next_layer(); }
+inline boost::asio::ip::tcp::socket& lowestLayer(SecureWebSocket& ws) { return ws.next_layer().next_layer(); }
+
+template<typename Handler>
+void tlsHandshake(PlainWebSocket&, Handler handler) {
+    handler(boost::system::error_code());
+}
+
+template<typename Handler>
+void tlsHandshake(SecureWebSocket& ws, Handler handler) {
+    ws.next_layer().async_handshake(boost::asio::ssl::stream_base::server, handler);
+}
+
+template<typename WebSocket>
+void closeStream(WebSocket& ws) {
+    boost::system::error_code ec;
+    lowestLayer(ws).shutdown(boost::asio::ip::tcp::socket::shutdown_both, ec);
+    lowestLayer(ws).close(ec);
+}
+
+//
+//  The server end of an IMessageTransport behind the slice of the websocket::stream
+//  interface Session uses
+//
+class TransportStream {
+public:
+    TransportStream(boost::asio::io_service& ios, MessageTransportPtr transport)
+        : m_ios(ios)
+        , m_transport(transport)
+        , m_binary(false)
+    {
+    }
+
+    void set_option(const websocket::permessage_deflate&) {}
+    void binary(const bool b) { m_binary = b; }
+
+    template<typename Handler>
+    void async_accept(Handler handler) {
+        m_transport->asyncOpen(m_ios, handler);
+    }
+
+    template<typename Handler>
+    void async_read(ReadBuffer& buffer, Handler handler) {
+        m_transport->asyncRead(buffer, handler);
+    }
+
+    template<typename ConstBuffer, typename Handler>
+    void async_write(const ConstBuffer& buffer, Handler handler) {
+        m_transport->asyncWrite(
+            boost::asio::buffer_cast<const char*>(buffer), boost::asio::buffer_size(buffer), m_binary, handler
+        );
+    }
+
+    template<typename Handler>
+    void async_close(const websocket::close_reason&, Handler handler) {
+        m_transport->close();
+        m_ios.post(std::bind(handler, boost::system::error_code()));
+    }
+
+    void close() { m_transport->close(); }
+
+private:
+    boost::asio::io_service&    m_ios;
+    MessageTransportPtr         m_transport;
+    bool                        m_binary;
+};
+
+template<typename Handler>
+void tlsHandshake(TransportStream&, Handler handler) {
+    handler(boost::system::error_code());
+}
+
+inline void closeStream(TransportStream& ts) {
+    ts.close();
+}
+
+template<typename WebSocket>
+class Session
+    : public ISession
+    , public std::enable_shared_from_this<Session<WebSocket>>
+    , private boost::noncopyable
+{
+public:
+    //  |args| construct the stream: the accepted socket, plus the ssl::context for TLS, or a transport
+    template<typename ...Args>
+    Session(Server& server, boost::asio::io_service& ios, const ConnectionId id, Args&& ...args)
+        : m_server(server)
+        , m_ios(ios)
+        , m_id(id)
+        , m_ws(std::forward<Args>(args)...)
+        , m_writing(false)
+        , m_closed(false)
+        , m_pingTimer(ios)
+    {
+    }
+
+    virtual ConnectionId getId() const override { return m_id; }
+
+    inline virtual void start() override;
+    inline virtual void send(const json& packet, const uint32_t delay) override;
+
+    virtual void restartPingTimer() override {
+        m_pingTimer.cancel();
+        startPingTimer();
+    }
+
+    virtual void close() override {
+        if(m_closed) {
+            return;
+        }
+
+        m_closed = true;
+        m_pingTimer.cancel();
+
+        closeStream(m_ws);
+    }
+
+    //  the client answers with its own close frame, which ends the read loop
+    virtual void sendClose() override {
+        if(m_closed) {
+            return;
+        }
+
+        m_ws.async_close(websocket::close_code::normal, [](boost::system::error_code) {});
+    }
+
+private:
+    struct Frame {
+        std::string     data;
+        bool            binary;
+    };
+
+    std::shared_ptr<Session> self() { return this->shared_from_this(); }
+
+    inline void handshakeHandler(boost::system::error_code ec);
+    inline void acceptHandler(boost::system::error_code ec);
+    inline void readHandler(boost::system::error_code ec);
+    inline void writeHandler(boost::system::error_code ec);
+    inline void closed();
+
+    void readNext() {
+        m_ws.async_read(
+            m_buffer,
+            std::bind(&Session::readHandler, self(), std::placeholders::_1)
+        );
+    }
+
+    void queueFrame(std::string data, const bool binary) {
+        if(m_closed) {
+            return;
+        }
+
+        m_writeQueue.push_back( { std::move(data), binary } );
+        writeNext();
+    }
+
+    void writeNext() {
+        if(m_writing || m_writeQueue.empty()) {
+            return;
+        }
+
+        m_writing = true;
+
+        m_ws.binary(m_writeQueue.front().binary);
+        m_ws.async_write(
+            boost::asio::buffer(m_writeQueue.front().data),
+            std::bind(&Session::writeHandler, self(), std::placeholders::_1)
+        );
+    }
+
+    inline void startPingTimer();
+
+    Server&                                                 m_server;
+    boost::asio::io_service&                                m_ios;
+    ConnectionId                                            m_id;
+    WebSocket                                               m_ws;
+    ReadBuffer                                              m_buffer;
+    std::deque<Frame>                                       m_writeQueue;
+    bool                                                    m_writing;
+    bool                                                    m_closed;
+    boost::asio::deadline_timer                             m_pingTimer;
+};
+
+//
+//  Listens on 127.0.0.1 (an ephemeral port unless given one) and runs every session
+//  on one io thread. Register handlers before start(); the remaining public methods
+//  are safe from any thread.
+//
+class Server
+    : public std::enable_shared_from_this<Server>
+    , private boost::noncopyable
+{
+    template<typename WebSocket> friend class Session;
+
+public:
+    static std::shared_ptr<Server> create(const StandinOptions& options = StandinOptions()) {
+        return std::shared_ptr<Server>(new Server(options));
+    }
+
+    ~Server() {
+        stop();
+    }
+
+    void on(const std::string& event, EventHandler handler) {
+        m_protocol.on(event, handler);
+    }
+
+    unsigned short start(const unsigned short port = 0) {
+        const boost::asio::ip::tcp::endpoint endpoint(boost::asio::ip::address_v4::loopback(), port);
+
+        m_acceptor.open(endpoint.protocol());
+        m_acceptor.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
+        m_acceptor.bind(endpoint);
+        m_acceptor.listen();
+
+        m_port = m_acceptor.local_endpoint().port();
+
+        acceptNext();
+
+        m_iosThread = boost::thread( [ this ]() { m_ios.run(); } );
+
+        return m_port;
+    }
+
+    void stop() {
+        if(!m_iosThread.joinable()) {
+            return;
+        }
+
+        m_ios.post( [ this ]() {
+            boost::system::error_code ec;
+            m_acceptor.close(ec);
+            m_publishStreamTimer.cancel();
+
+            for(auto& session : m_sessions) {
+                session.second->close();
+            }
+        });
+
+        m_ios.post( [ this ]() { m_ios.stop(); } );
+        m_iosThread.join();
+    }
+
+    unsigned short getPort() const { return m_port; }
+    std::string getPortString() const { return std::to_string(m_port); }
+
+    void publish(const std::string& channel, const json& data) {
+        m_ios.post( [ this, channel, data ]() {
+            Outbox out;
+            m_protocol.publish(channel, data, out);
+            deliver(out);
+        });
+    }
+
+    //
+    //  Publishes |data| to |channel| at |ratePerSecond| (0 = as fast as the io loop
+    //  turns) until |count| messages have gone out, each fanned out to every
+    //  subscriber. Replaces any stream already running.
+    //
+    void startPublishStream(const std::string& channel, const json& data, const uint32_t ratePerSecond, const uint64_t count) {
+        m_ios.post( [ this, channel, data, ratePerSecond, count ]() {
+            m_publishStreamTimer.cancel();
+
+            m_publishStream.channel         = channel;
+            m_publishStream.data            = data;
+            m_publishStream.ratePerSecond   = ratePerSecond;
+            m_publishStream.remaining       = count;
+            m_publishStream.start           = std::chrono::steady_clock::now();
+            m_publishStream.sent            = 0;
+
+            publishStreamTick();
+        });
+    }
+
+    //  0 stops pinging
+    void setPingInterval(const uint32_t interval) {
+        m_ios.post( [ this, interval ]() {
+            m_options.pingInterval = interval;
+
+            for(auto& session : m_sessions) {
+                session.second->restartPingTimer();
+            }
+        });
+    }
+
+    //  sends |conn| |packet| as is, e.g. an array of packets batched into one message
+    void send(const ConnectionId conn, const json& packet) {
+        m_ios.post( [ this, conn, packet ]() {
+            const auto session = m_sessions.find(conn);
+            if(m_sessions.end() != session) {
+                session->second->send(packet, 0);
+            }
+        });
+    }
+
+    //  sends |conn| a WebSocket close frame, as a server going away cleanly would
+    void closeConnection(const ConnectionId conn) {
+        m_ios.post( [ this, conn ]() {
+            const auto session = m_sessions.find(conn);
+            if(m_sessions.end() != session) {
+                session->second->sendClose();
+            }
+        });
+    }
+
+    //  e.g. to deauthenticate or revoke a client mid test
+    void setAuthToken(const ConnectionId conn, const json& token) {
+        m_ios.post( [ this, conn, token ]() {
+            Outbox out;
+            m_protocol.setAuthToken(conn, token, out);
+            deliver(out);
+        });
+    }
+
+    //  runs |fn| on the io thread and waits for it; the server must be running
+    template<typename Fn>
+    auto inspect(Fn fn) -> decltype(fn(std::declval<const Protocol&>())) {
+        std::promise<decltype(fn(std::declval<const Protocol&>()))> result;
+        m_ios.post( [ this, &fn, &result ]() {
+            result.set_value(fn(static_cast<const Protocol&>(m_protocol)));
+        });
+        return result.get_future().get();
+    }
+
+    StandinStats getStats() {
+        return inspect( [](const Protocol& p) { return p.stats(); } );
+    }
+
+    //
+    //  The client end of a new in-memory connection, for ConnectOptions::setTransport();
+    //  the server end is served like an accepted socket. The server must be running.
+    //
+    MessageTransportPtr connectInMemory() {
+        const auto ends = MemoryTransport::createPair();
+        const MessageTransportPtr serverEnd = ends.second;
+
+        m_ios.post( [ this, serverEnd ]() {
+            auto session = std::make_shared<Session<TransportStream>>(
+                *this, m_ios, m_nextConnectionId++, m_ios, serverEnd);
+            session->start();
+        });
+
+        return ends.first;
+    }
+
+private:
+    struct PublishStream {
+        PublishStream() : ratePerSecond(0), remaining(0), sent(0) {}
+
+        std::string                             channel;
+        json                                    data;
+        uint32_t                                ratePerSecond;
+        uint64_t                                remaining;
+        std::chrono::steady_clock::time_point   start;
+        uint64_t                                sent;
+    };
+
+    explicit Server(const StandinOptions& options)
+        : m_options(options)
+        , m_protocol(m_options)
+        , m_acceptor(m_ios)
+        , m_socket(m_ios)
+        , m_port(0)
+        , m_nextConnectionId(1)
+        , m_publishStreamTimer(m_ios)
+    {
+    }
+
+    void acceptNext() {
+        m_acceptor.async_accept(m_socket, [ this ](boost::system::error_code ec) {
+            if(ec) {
+                return; //  closed
+            }
+
+            boost::system::error_code noDelayEc;
+            m_socket.set_option(boost::asio::ip::tcp::no_delay(true), noDelayEc);
+
+            SessionPtr session;
+            if(m_options.sslContext) {
+                session = std::make_shared<Session<SecureWebSocket>>(
+                    *this, m_ios, m_nextConnectionId++, std::move(m_socket), *m_options.sslContext);
+            } else {
+                session = std::make_shared<Session<PlainWebSocket>>(
+                    *this, m_ios, m_nextConnectionId++, std::move(m_socket));
+            }
+            m_socket = boost::asio::ip::tcp::socket(m_ios);
+
+            session->start();
+
+            acceptNext();
+        });
+    }
+
+    void opened(SessionPtr session) {
+        m_sessions[session->getId()] = session;
+        m_protocol.onOpen(session->getId());
+    }
+
+    void closed(const ConnectionId conn) {
+        m_sessions.erase(conn);
+        m_protocol.onClose(conn);
+    }
+
+    void message(const ConnectionId conn, const std::string& buf) {
+        json message;
+        try {
+            message = m_options.codecEngine ? m_options.codecEngine->decode(buf) : json::parse(buf);
+        } catch(const std::exception&) {
+            return;
+        }
+
+        Outbox out;
+        m_protocol.onMessage(conn, message, out);
+        deliver(out);
+    }
+
+    void deliver(const Outbox& out) {
+        for(const auto& o : out) {
+            const auto session = m_sessions.find(o.to);
+            if(m_sessions.end() != session) {
+                session->second->send(o.packet, o.delay);
+            }
+        }
+    }
+
+    std::string encode(const json& packet, bool& binary) {
+        binary = m_options.codecEngine && m_options.codecEngine->isBinary();
+        return m_options.codecEngine ? m_options.codecEngine->encode(packet) : packet.dump();
+    }
+
+    void publishStreamTick() {
+        PublishStream& s = m_publishStream;
+
+        //  rate limited streams run in 10ms ticks and catch up to where they should be
+        uint64_t n = s.remaining;
+        if(s.ratePerSecond) {
+            const uint64_t elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - s.start).count();
+            const uint64_t due = elapsedMs * s.ratePerSecond / 1000 + 1;
+            n = std::min(n, due > s.sent ? due - s.sent : 0);
+        } else {
+            n = std::min<uint64_t>(n, 256);
+        }
+
+        Outbox out;
+        for(uint64_t i = 0; i < n; ++i) {
+            m_protocol.publish(s.channel, s.data, out);
+        }
+        deliver(out);
+
+        s.remaining -= n;
+        s.sent      += n;
+
+        if(0 == s.remaining) {
+            return;
+        }
+
+        if(s.ratePerSecond) {
+            m_publishStreamTimer.expires_from_now(boost::posix_time::milliseconds(10));
+            m_publishStreamTimer.async_wait( [ this ](const boost::system::error_code& ec) {
+                if(!ec) {
+                    publishStreamTick();
+                }
+            });
+        } else {
+            m_ios.post(std::bind(&Server::publishStreamTick, this));
+        }
+    }
+
+    StandinOptions                                  m_options;
+    Protocol                                        m_protocol;
+    boost::asio::io_service                         m_ios;
+    boost::asio::ip::tcp::acceptor                  m_acceptor;
+    boost::asio::ip::tcp::socket                    m_socket;
+    unsigned short                                  m_port;
+    ConnectionId                                    m_nextConnectionId;
+    std::map<ConnectionId, SessionPtr>              m_sessions;
+    PublishStream                                   m_publishStream;
+    boost::asio::deadline_timer                     m_publishStreamTimer;
+    boost::thread                                   m_iosThread;
+};
+
+typedef std::shared_ptr<Server> ServerPtr;
+
+template<typename WebSocket>
+void Session<WebSocket>::start() {
+    if(m_server.m_options.perMessageDeflate) {
+        websocket::permessage_deflate pmd;
+        pmd.server_enable = true;
+        m_ws.set_option(pmd);
+    }
+
+    auto s(self());
+    tlsHandshake(m_ws, [ s, this ](boost::system::error_code ec) {
+        handshakeHandler(ec);
+    });
+}
+
+template<typename WebSocket>
+void Session<WebSocket>::send(const json& packet, const uint32_t delay) {
+    if(0 == delay) {
+        bool binary;
+        std::string data = m_server.encode(packet, binary);
+        return queueFrame(std::move(data), binary);
+    }
+
+    auto s(self());
+    auto timer = std::make_shared<boost::asio::deadline_timer>(m_ios);
+
+    timer->expires_from_now(boost::posix_time::milliseconds(delay));
+    timer->async_wait( [ s, this, timer, packet ](const boost::system::error_code& ec) {
+        if(!ec) {
+            send(packet, 0);
+        }
+    });
+}
+
+template<typename WebSocket>
+void Session<WebSocket>::handshakeHandler(boost::system::error_code ec) {
+    if(ec) {
+        return;
+    }
+
+    m_ws.async_accept(
+        std::bind(&Session::acceptHandler, self(), std::placeholders::_1)
+    );
+}
+
+template<typename WebSocket>
+void Session<WebSocket>::acceptHandler(boost::system::error_code ec) {
+    if(ec) {
+        return;
+    }
+
+    m_server.opened(self());
+
+    startPingTimer();
+    readNext();
+}
+
+template<typename WebSocket>
+void Session<WebSocket>::readHandler(boost::system::error_code ec) {
+    if(ec) {
+        return closed();
+    }
+
+    const char* bufferData  = boost::asio::buffer_cast<const char*>(m_buffer.data());
+    const std::string buf(bufferData, m_buffer.size());
+    m_buffer.consume(m_buffer.size());
+
+    if("#2" == buf) {
+        m_server.m_protocol.onPong(m_id);
+    } else {
+        m_server.message(m_id, buf);
+    }
+
+    if(!m_closed) {
+        readNext();
+    }
+}
+
+template<typename WebSocket>
+void Session<WebSocket>::writeHandler(boost::system::error_code ec) {
+    m_writing = false;
+
+    if(ec) {
+        return closed();
+    }
+
+    m_server.m_protocol.onSent(m_id);
+
+    m_writeQueue.pop_front();
+    writeNext();
+}
+
+template<typename WebSocket>
+void Session<WebSocket>::closed() {
+    if(!m_closed) {
+        close();
+    }
+
+    m_writeQueue.clear();
+    m_server.closed(m_id);
+}
+
+template<typename WebSocket>
+void Session<WebSocket>::startPingTimer() {
+    const uint32_t interval = m_server.m_options.pingInterval;
+    if(0 == interval || m_closed) {
+        return;
+    }
+
+    auto s(self());
+
+    m_pingTimer.expires_from_now(boost::posix_time::milliseconds(interval));
+    m_pingTimer.async_wait( [ s, this ](const boost::system::error_code& ec) {
+        if(ec) {
+            return;
+        }
+
+        queueFrame("#1", false);
+        startPingTimer();
+    });
+}
+
+    }   //  end standin ns
+}   //  end scio_beast ns
+
+#endif  //  SOCKETCLUSTER_IO_BEAST_STANDIN_H
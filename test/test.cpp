@@ -8,10 +8,15 @@
 #include <boost/asio/ssl/rfc2818_verification.hpp>
 
 //  STL
+#include <atomic>
 #include <iostream>
+#include <map>
+#include <mutex>
+#include <thread>
 
 //  scio_beast
 #include "../src/scio_beast.hpp"
+#include "sc_standin.hpp"
 
 //  catch
 #define CATCH_CONFIG_MAIN
@@ -21,6 +26,19 @@ using json = nlohmann::json;
 
 #define UNUSED(expr) do { (void)(expr); } while (0)
 
+//  polls |pred| until it holds or |timeoutMs| passes
+template<typename Pred>
+bool waitFor(Pred pred, const int timeoutMs = 5000) {
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    while(!pred()) {
+        if(std::chrono::steady_clock::now() > deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    return true;
+}
+
 TEST_CASE("client can connect to socketcluster server", "[comm]") {
 
     using namespace boost;
@@ -86,7 +104,7 @@ TEST_CASE("client can connect to socketcluster server", "[comm]") {
             std::string         lastRawEvent;
         } asyncInfo;
 
-        socket->on<scio_beast::SCSocket::RawEvent>([ &asyncInfo ](const boost::beast::multi_buffer& raw) {            
+        socket->on<scio_beast::SCSocket::RawEvent>([ &asyncInfo ](const scio_beast::ReadBuffer& raw) {            
             std::stringstream rawBuf;
             rawBuf << boost::beast::buffers(raw.data());
             asyncInfo.lastRawEvent = rawBuf.str();
@@ -241,3 +259,2264 @@ TEST_CASE("client can connect to socketcluster server", "[comm]") {
         //  :TODO: Put in deauth stuff
     }
 }
+
+TEST_CASE("pull mode inbox ring", "[inbox]") {
+    scio_beast::detail::SpscRing<scio_beast::ChannelMessage> ring(3);
+
+    REQUIRE(4 == ring.capacity());  //  rounded up to a power of two
+
+    for(int i = 0; i < 4; ++i) {
+        scio_beast::ChannelMessage msg = { "chan", i, 1 };
+        REQUIRE(ring.tryPush(std::move(msg)));
+    }
+
+    scio_beast::ChannelMessage overflow = { "chan", 4, 1 };
+    CHECK_FALSE(ring.tryPush(std::move(overflow)));
+    CHECK(4 == overflow.data);  //  untouched on failure
+
+    scio_beast::ChannelMessageBatch batch;
+    CHECK(3 == ring.popBatch(batch, 3));
+    CHECK(0 == batch.front().data);
+    CHECK(2 == batch.back().data);
+
+    //  wrap around
+    REQUIRE(ring.tryPush(std::move(overflow)));
+    batch.clear();
+    CHECK(2 == ring.popBatch(batch, 16));
+    CHECK(3 == batch.front().data);
+    CHECK(4 == batch.back().data);
+    CHECK(0 == ring.size());
+}
+
+TEST_CASE("pull mode channel inbox", "[inbox]") {
+    auto client = scio_beast::SocketClusterClient::create(scio_beast::SocketClusterClientOptions());
+    auto socket = client->socket();
+
+    boost::system::error_code failEc;
+    socket->on<scio_beast::SCSocket::SubscribeFailEvent>([ &failEc ](const std::string&, const boost::system::error_code& ec) {
+        failEc = ec;
+    });
+
+    scio_beast::ChannelSubscriptionOptions pull;
+    pull.inboxCapacity = 8;
+
+    auto pulled = socket->subscribe("pulled", pull);
+    CHECK(pulled->hasInbox());
+    CHECK(pulled == socket->subscribe("pulled", pull));
+    CHECK(!failEc);
+
+    //  a channel created in push mode cannot be switched to pull mode later
+    auto pushed = socket->subscribe("pushed");
+    CHECK(pushed == socket->subscribe("pushed", pull));
+    CHECK(scio_beast::make_error_code(scio_beast::inbox_mismatch) == failEc);
+    CHECK_FALSE(pushed->hasInbox());
+
+    client->shutdown();
+}
+
+TEST_CASE("adaptive read size", "[read]") {
+    scio_beast::detail::ReadSizePolicy policy(4096, 65536, true);
+
+    CHECK(4096 == policy.next());
+
+    //  a large message arriving in pieces grows the hint up to the max
+    for(int i = 0; i < 8; ++i) {
+        policy.partialRead();
+    }
+    CHECK(65536 == policy.next());
+
+    //  ...and a run of small messages brings it back down
+    for(int i = 0; i < 64; ++i) {
+        policy.messageComplete(100);
+    }
+    CHECK(4096 == policy.next());
+
+    scio_beast::detail::ReadSizePolicy fixed(4096, 65536, false);
+    fixed.partialRead();
+    fixed.messageComplete(1024 * 1024);
+    CHECK(4096 == fixed.next());
+}
+
+TEST_CASE("public key pins", "[tls]") {
+    scio_beast::PublicKeyPinSet pins;
+
+    CHECK(pins.empty());
+    CHECK_FALSE(pins.addPin("not a pin"));
+    CHECK_FALSE(pins.addPin(std::string(64, 'z')));
+    CHECK(pins.empty());
+
+    CHECK(pins.addPin("0345169322E8D06033F677A4FCCDDBD18C9C66963D0FCD694B1313BE7BE1FF8B"));
+    CHECK_FALSE(pins.empty());
+
+    auto ctx = scio_beast::standin::selfSignedContext();
+    X509* cert = SSL_CTX_get0_certificate(ctx->native_handle());
+    REQUIRE(cert);
+
+    //  the pin is the SHA-256 of the DER encoded SubjectPublicKeyInfo
+    X509_PUBKEY* pubKey = X509_get_X509_PUBKEY(cert);
+    std::vector<unsigned char> der(i2d_X509_PUBKEY(pubKey, nullptr));
+    unsigned char* derPtr = &der[0];
+    i2d_X509_PUBKEY(pubKey, &derPtr);
+
+    scio_beast::PublicKeyPinSet::Pin spki;
+    REQUIRE(1 == EVP_Digest(&der[0], der.size(), spki.data(), nullptr, EVP_sha256(), nullptr));
+
+    //  asked twice so the second answer comes from the verdict cache
+    CHECK_FALSE(pins.verify(cert));
+    CHECK_FALSE(pins.verify(cert));
+
+    scio_beast::PublicKeyPinSet matching;
+    matching.addPin(spki);
+    CHECK(matching.verify(cert));
+    CHECK(matching.verify(cert));
+
+    //  a pin added later invalidates the cached verdicts
+    pins.addPin(spki);
+    CHECK(pins.verify(cert));
+}
+
+TEST_CASE("tls session resumption", "[tls]") {
+    using namespace scio_beast::standin;
+
+    StandinOptions serverOpts;
+    serverOpts.sslContext = selfSignedContext();
+
+    auto server = Server::create(serverOpts);
+    server->start();
+
+    auto cache = std::make_shared<scio_beast::TlsSessionCache>();
+
+    scio_beast::SocketClusterClientOptions clientOpts;
+    clientOpts.connectOptions
+        .setHost("127.0.0.1")
+        .setPort(server->getPortString())
+        .setSecure()
+        .setAutoReconnect(false)
+        ;
+    clientOpts.connectOptions.secureOptions.context =
+        std::make_shared<boost::asio::ssl::context>(boost::asio::ssl::context::sslv23_client);
+    clientOpts.connectOptions.secureOptions.sessionCache = cache;
+
+    auto client = scio_beast::SocketClusterClient::create(clientOpts);
+    auto socket = client->socket();
+
+    std::atomic<int> connects(0);
+    socket->on<scio_beast::SCSocket::ConnectEvent>([ &connects ](const json&) { ++connects; });
+
+    socket->connect();
+    REQUIRE(waitFor([ &connects ]() { return 1 == connects; }));
+    CHECK(0 == cache->getHits());
+    CHECK(1 == cache->getMisses());
+
+    socket->disconnect();
+    REQUIRE(waitFor([ socket ]() { return scio_beast::SCSocket::State::CLOSED == socket->getState(); }));
+
+    socket->connect();
+    REQUIRE(waitFor([ &connects ]() { return 2 == connects; }));
+    CHECK(1 == cache->getHits());
+    CHECK(1 == cache->getMisses());
+
+    //  the server agrees the second handshake resumed the first session
+    SSL_CTX* serverCtx = serverOpts.sslContext->native_handle();
+    CHECK(2 == SSL_CTX_sess_accept_good(serverCtx));
+    CHECK(1 == SSL_CTX_sess_hits(serverCtx));
+
+    socket->disconnect();
+    client->shutdown();
+    server->stop();
+}
+
+TEST_CASE("resolver cache", "[dns]") {
+    using scio_beast::ResolverCache;
+
+    const ResolverCache::Endpoints resolved(
+        1, boost::asio::ip::tcp::endpoint(boost::asio::ip::address::from_string("127.0.0.1"), 8000)
+    );
+
+    ResolverCache::Endpoints endpoints;
+    bool shouldRefresh;
+
+    SECTION("fresh entries are served as-is") {
+        ResolverCache cache;
+
+        CHECK(ResolverCache::Freshness::MISS == cache.lookup("localhost:8000", endpoints, shouldRefresh));
+
+        cache.store("localhost:8000", resolved);
+        CHECK(ResolverCache::Freshness::FRESH == cache.lookup("localhost:8000", endpoints, shouldRefresh));
+        CHECK_FALSE(shouldRefresh);
+        CHECK(resolved == endpoints);
+    }
+
+    SECTION("stale entries are served while one caller refreshes") {
+        ResolverCache cache(std::chrono::seconds(0), std::chrono::seconds(3600));
+        cache.store("localhost:8000", resolved);
+
+        CHECK(ResolverCache::Freshness::STALE == cache.lookup("localhost:8000", endpoints, shouldRefresh));
+        CHECK(shouldRefresh);
+        CHECK(resolved == endpoints);
+
+        CHECK(ResolverCache::Freshness::STALE == cache.lookup("localhost:8000", endpoints, shouldRefresh));
+        CHECK_FALSE(shouldRefresh);
+
+        cache.refreshFailed("localhost:8000");
+        CHECK(ResolverCache::Freshness::STALE == cache.lookup("localhost:8000", endpoints, shouldRefresh));
+        CHECK(shouldRefresh);
+    }
+
+    SECTION("entries past max staleness are dropped") {
+        ResolverCache cache(std::chrono::seconds(0), std::chrono::seconds(0));
+        cache.store("localhost:8000", resolved);
+
+        CHECK(ResolverCache::Freshness::MISS == cache.lookup("localhost:8000", endpoints, shouldRefresh));
+    }
+
+    SECTION("concurrent misses share one resolve") {
+        ResolverCache cache;
+
+        int waiters = 0;
+        boost::system::error_code waiterEc = boost::asio::error::would_block;
+        const auto waiter = [ &waiters, &waiterEc, &endpoints ](
+            const boost::system::error_code& ec, const ResolverCache::Endpoints& e)
+        {
+            ++waiters;
+            waiterEc    = ec;
+            endpoints   = e;
+        };
+
+        CHECK(cache.joinResolve("localhost:8000", waiter));
+        CHECK_FALSE(cache.joinResolve("localhost:8000", waiter));
+        CHECK_FALSE(cache.joinResolve("localhost:8000", waiter));
+        CHECK(cache.joinResolve("example.com:8000", waiter));
+
+        cache.completeResolve("localhost:8000", boost::system::error_code(), resolved);
+        CHECK(2 == waiters);
+        CHECK_FALSE(waiterEc);
+        CHECK(resolved == endpoints);
+        CHECK(ResolverCache::Freshness::FRESH == cache.lookup("localhost:8000", endpoints, shouldRefresh));
+
+        //  a failure reaches the waiters, stores nothing and lets the next miss resolve again
+        CHECK_FALSE(cache.joinResolve("example.com:8000", waiter));
+        cache.completeResolve("example.com:8000", boost::asio::error::host_not_found, ResolverCache::Endpoints());
+        CHECK(3 == waiters);
+        CHECK(boost::asio::error::host_not_found == waiterEc);
+        CHECK(ResolverCache::Freshness::MISS == cache.lookup("example.com:8000", endpoints, shouldRefresh));
+        CHECK(cache.joinResolve("example.com:8000", waiter));
+    }
+
+    SECTION("closing a socket gives up its resolves") {
+        auto cache = std::make_shared<ResolverCache>(std::chrono::seconds(0), std::chrono::seconds(3600));
+        cache->store("localhost:1", resolved);
+
+        //  nothing runs until poll(), so the refresh is still outstanding at close()
+        scio_beast::SocketClusterClientOptions clientOpts;
+        clientOpts.connectOptions
+            .setHost("localhost")
+            .setPort("1")
+            .setAutoReconnect(false)
+            .setManualIo()
+            ;
+        clientOpts.connectOptions.resolverCache = cache;
+
+        auto client = scio_beast::SocketClusterClient::create(clientOpts);
+
+        auto refreshing = client->socket();
+        refreshing->connect();
+        CHECK(ResolverCache::Freshness::STALE == cache->lookup("localhost:1", endpoints, shouldRefresh));
+        CHECK_FALSE(shouldRefresh);
+
+        refreshing->close();
+        CHECK(ResolverCache::Freshness::STALE == cache->lookup("localhost:1", endpoints, shouldRefresh));
+        CHECK(shouldRefresh);
+
+        //  a miss: |waiting| joins |resolving|'s lookup, then takes it over once that socket closes
+        clientOpts.connectOptions.setPort("2");
+        auto resolving  = client->socket(clientOpts.connectOptions);
+        auto waiting    = client->socket(clientOpts.connectOptions);
+
+        resolving->connect();
+        waiting->connect();
+        CHECK_FALSE(cache->joinResolve("localhost:2", [](const boost::system::error_code&, const ResolverCache::Endpoints&) {}));
+
+        resolving->close();
+        waiting->poll();
+        CHECK_FALSE(cache->joinResolve("localhost:2", [](const boost::system::error_code&, const ResolverCache::Endpoints&) {}));
+
+        CHECK(waitFor([ waiting, cache, &endpoints, &shouldRefresh ]() {
+            waiting->poll();
+            return ResolverCache::Freshness::MISS != cache->lookup("localhost:2", endpoints, shouldRefresh);
+        }));
+
+        waiting->close();
+        client->shutdown();
+    }
+}
+
+TEST_CASE("connect admission", "[reconnect]") {
+    using scio_beast::ConnectAdmission;
+
+    scio_beast::ConnectAdmissionOptions opts;
+    opts.maxInFlight = 2;
+
+    ConnectAdmission admission(opts);
+    int admitted = 0;
+
+    CHECK(admission.acquire([&admitted]() { ++admitted; }));
+    CHECK(admission.acquire([&admitted]() { ++admitted; }));
+    CHECK_FALSE(admission.acquire([&admitted]() { ++admitted; }));
+    CHECK(2 == admitted);
+    CHECK(1 == admission.getStats().queueDepth);
+
+    admission.release();
+    CHECK(3 == admitted);
+    CHECK(0 == admission.getStats().queueDepth);
+    CHECK(2 == admission.getStats().inFlight);
+
+    //  a cancelled waiter is never admitted; an admitted one can't be cancelled
+    ConnectAdmission::Token token = 0;
+    CHECK_FALSE(admission.acquire([&admitted]() { ++admitted; }, &token));
+    CHECK(1 == admission.getStats().queueDepth);
+    CHECK(admission.cancel(token));
+    CHECK(0 == admission.getStats().queueDepth);
+
+    admission.release();
+    CHECK(3 == admitted);
+    CHECK(1 == admission.getStats().inFlight);
+
+    CHECK(admission.acquire([&admitted]() { ++admitted; }, &token));
+    CHECK_FALSE(admission.cancel(token));
+}
+
+TEST_CASE("closing sockets gives back connect admission", "[reconnect]") {
+    using namespace scio_beast::standin;
+
+    StandinOptions serverOpts;
+    serverOpts.handshakeDelay = 60 * 60 * 1000;   //  |holding| stays between admission and handshake
+
+    auto server = Server::create(serverOpts);
+    server->start();
+
+    scio_beast::SocketClusterClientOptions clientOpts;
+    clientOpts.connectOptions
+        .setTransport([ server ]() { return server->connectInMemory(); })
+        .setManualIo()
+        .setAutoReconnect(false)
+        ;
+    clientOpts.connectAdmission.maxInFlight = 1;
+
+    auto client = scio_beast::SocketClusterClient::create(clientOpts);
+
+    auto holding = client->socket();
+    holding->connect();
+    holding->poll();
+    CHECK(waitFor([ server ]() { return 1 == server->getStats().connections; }));
+
+    auto admission = client->getConnectAdmission();
+    REQUIRE(admission);
+    CHECK(1 == admission->getStats().inFlight);
+
+    //  queued behind |holding|
+    auto queued = client->socket();
+    queued->connect();
+    CHECK(1 == admission->getStats().queueDepth);
+
+    queued->close();
+    CHECK(0 == admission->getStats().queueDepth);
+    CHECK(1 == admission->getStats().inFlight);
+
+    holding->close();
+    CHECK(0 == admission->getStats().inFlight);
+
+    //  admitted, but closed before its io ever ran to take the slot up
+    auto admitted = client->socket();
+    admitted->connect();
+    CHECK(1 == admission->getStats().inFlight);
+
+    admitted->close();
+    CHECK(0 == admission->getStats().inFlight);
+    CHECK(0 == admission->getStats().queueDepth);
+
+    client->shutdown();
+    server->stop();
+}
+
+TEST_CASE("offline spool", "[spool]") {
+    using scio_beast::OfflineSpool;
+
+    const std::string path = "scio_beast_test.spool";
+    std::remove(path.c_str());
+
+    const OfflineSpool::Record a = { 1, 2, 3 };
+    const OfflineSpool::Record b(100, 7);
+    OfflineSpool::Record record;
+
+    {
+        OfflineSpool spool;
+        REQUIRE(spool.open(path, 256));
+
+        CHECK(spool.append(a));
+        CHECK(spool.append(b));
+        CHECK_FALSE(spool.append(OfflineSpool::Record(200, 1)));   //  full
+        CHECK(2 == spool.size());
+    }
+
+    SECTION("records survive reopening, in order") {
+        OfflineSpool spool;
+        REQUIRE(spool.open(path, 256));
+        REQUIRE(2 == spool.size());
+
+        CHECK(spool.front(record));
+        CHECK(a == record);
+        spool.pop();
+
+        CHECK(spool.front(record));
+        CHECK(b == record);
+        spool.pop();
+
+        CHECK(spool.empty());
+        CHECK_FALSE(spool.front(record));
+    }
+
+    SECTION("consumed space is reclaimed") {
+        OfflineSpool spool;
+        REQUIRE(spool.open(path, 256));
+
+        spool.pop();
+        CHECK(spool.append(OfflineSpool::Record(80, 1)));
+        CHECK(2 == spool.size());
+    }
+
+    SECTION("replayed records stay until popped") {
+        OfflineSpool spool;
+        REQUIRE(spool.open(path, 256));
+
+        CHECK(spool.next(record));
+        CHECK(a == record);
+        CHECK(spool.next(record));
+        CHECK(b == record);
+        CHECK_FALSE(spool.replayPending());
+        CHECK(2 == spool.size());
+
+        spool.pop();
+        spool.rewind();
+        CHECK(spool.next(record));
+        CHECK(b == record);
+
+        //  the first fits where |a| was; the second slides the rest up
+        CHECK(spool.prepend(a));
+        CHECK(spool.prepend(a));
+        CHECK(3 == spool.size());
+
+        CHECK(spool.next(record));
+        CHECK(a == record);
+        CHECK(spool.next(record));
+        CHECK(a == record);
+        CHECK(spool.next(record));
+        CHECK(b == record);
+        CHECK_FALSE(spool.replayPending());
+    }
+
+    std::remove(path.c_str());
+}
+
+TEST_CASE("offline spool replay cut short", "[spool]") {
+    using namespace scio_beast::standin;
+    using scio_beast::OfflineSpool;
+
+    //  lets |writes| writes through, then drops the link under the next one
+    class DroppingTransport
+        : public scio_beast::IMessageTransport
+    {
+    public:
+        DroppingTransport(scio_beast::MessageTransportPtr inner, const size_t writes)
+            : m_inner(inner), m_writes(writes) {}
+
+        virtual void asyncOpen(boost::asio::io_service& ios, Handler handler) override { m_inner->asyncOpen(ios, handler); }
+        virtual void asyncRead(scio_beast::ReadBuffer& buffer, Handler handler) override { m_inner->asyncRead(buffer, handler); }
+        virtual bool gotBinary() const override { return m_inner->gotBinary(); }
+        virtual void close() override { m_inner->close(); }
+
+        virtual void asyncWrite(const char* data, size_t size, bool binary, Handler handler) override {
+            if(0 == m_writes) {
+                m_inner->close();
+            } else {
+                --m_writes;
+            }
+            m_inner->asyncWrite(data, size, binary, handler);
+        }
+
+    private:
+        scio_beast::MessageTransportPtr     m_inner;
+        size_t                              m_writes;
+    };
+
+    const std::string path = "scio_beast_test.spool";
+    std::remove(path.c_str());
+
+    {
+        OfflineSpool spool;
+        REQUIRE(spool.open(path, 64 * 1024));
+
+        for(int n = 0; n < 20; ++n) {
+            REQUIRE(spool.append(json::to_cbor({ { "event", "log" }, { "data", n } })));
+        }
+    }
+
+    auto server = Server::create();
+
+    std::mutex receivedLock;
+    std::vector<int> received;
+
+    server->on("log", [ &receivedLock, &received ](Call& call) {
+        std::lock_guard<std::mutex> lock(receivedLock);
+        received.push_back(call.data.get<int>());
+    });
+
+    server->start();
+
+    //  the first connection takes the #handshake and 5 records; the 6th is cut off mid write
+    std::atomic<int> opened(0);
+
+    scio_beast::SocketClusterClientOptions clientOpts;
+    clientOpts.connectOptions
+        .setTransport([ server, &opened ]() -> scio_beast::MessageTransportPtr {
+            if(0 == opened++) {
+                return std::make_shared<DroppingTransport>(server->connectInMemory(), 6);
+            }
+            return server->connectInMemory();
+        })
+        .setOfflineSpool(path, 64 * 1024)
+        ;
+    clientOpts.connectOptions.autoReconnectOptions.initialDelay = 10;
+    clientOpts.connectOptions.autoReconnectOptions.randomness   = 0;
+
+    auto client = scio_beast::SocketClusterClient::create(clientOpts);
+    auto socket = client->socket();
+
+    //  spooled while disconnected, so they must come after everything replayed before
+    std::atomic<int> disconnects(0);
+    socket->on<scio_beast::SCSocket::DisconnectEvent>([ socket, &disconnects ](const boost::system::error_code&) {
+        if(1 == ++disconnects) {
+            for(int n = 100; n < 103; ++n) {
+                socket->emit("log", n);
+            }
+        }
+    });
+
+    socket->connect();
+
+    REQUIRE(waitFor([ &receivedLock, &received ]() {
+        std::lock_guard<std::mutex> lock(receivedLock);
+        return received.size() >= 23;
+    }));
+
+    std::vector<int> expected;
+    for(int n = 0; n < 20; ++n) {
+        expected.push_back(n);
+    }
+    expected.insert(expected.end(), { 100, 101, 102 });
+
+    {
+        std::lock_guard<std::mutex> lock(receivedLock);
+        CHECK(expected == received);
+    }
+
+    CHECK(2 == opened);
+
+    socket->disconnect();
+    client->shutdown();
+    server->stop();
+
+    //  every record was popped once written
+    OfflineSpool spool;
+    REQUIRE(spool.open(path, 64 * 1024));
+    CHECK(spool.empty());
+
+    std::remove(path.c_str());
+}
+
+TEST_CASE("offline spool replay is bounded by the out queue", "[spool]") {
+    using namespace scio_beast::standin;
+    using scio_beast::OfflineSpool;
+
+    //  lets the #handshake through, then holds each write until release()d
+    class GatedTransport
+        : public scio_beast::IMessageTransport
+    {
+    public:
+        explicit GatedTransport(scio_beast::MessageTransportPtr inner)
+            : m_inner(inner), m_allowance(1), m_held(nullptr), m_heldSize(0), m_heldBinary(false) {}
+
+        virtual void asyncOpen(boost::asio::io_service& ios, Handler handler) override { m_inner->asyncOpen(ios, handler); }
+        virtual void asyncRead(scio_beast::ReadBuffer& buffer, Handler handler) override { m_inner->asyncRead(buffer, handler); }
+        virtual bool gotBinary() const override { return m_inner->gotBinary(); }
+        virtual void close() override { m_inner->close(); }
+
+        virtual void asyncWrite(const char* data, size_t size, bool binary, Handler handler) override {
+            m_held          = data;
+            m_heldSize      = size;
+            m_heldBinary    = binary;
+            m_heldHandler   = handler;
+            release(0);
+        }
+
+        void release(const size_t writes) {
+            m_allowance += writes;
+            if(m_allowance && m_heldHandler) {
+                --m_allowance;
+
+                Handler handler;
+                handler.swap(m_heldHandler);
+                m_inner->asyncWrite(m_held, m_heldSize, m_heldBinary, handler);
+            }
+        }
+
+    private:
+        scio_beast::MessageTransportPtr     m_inner;
+        size_t                              m_allowance;
+        const char*                         m_held;
+        size_t                              m_heldSize;
+        bool                                m_heldBinary;
+        Handler                             m_heldHandler;
+    };
+
+    const std::string path = "scio_beast_test.spool";
+    std::remove(path.c_str());
+
+    const int records = 200;
+    {
+        OfflineSpool spool;
+        REQUIRE(spool.open(path, 64 * 1024));
+
+        for(int n = 0; n < records; ++n) {
+            REQUIRE(spool.append(json::to_cbor({ { "event", "log" }, { "data", n } })));
+        }
+    }
+
+    auto server = Server::create();
+
+    std::mutex receivedLock;
+    std::vector<int> received;
+
+    server->on("log", [ &receivedLock, &received ](Call& call) {
+        std::lock_guard<std::mutex> lock(receivedLock);
+        received.push_back(call.data.get<int>());
+    });
+
+    server->start();
+
+    std::shared_ptr<GatedTransport> gate;
+
+    scio_beast::SocketClusterClientOptions clientOpts;
+    clientOpts.connectOptions
+        .setTransport([ server, &gate ]() {
+            gate = std::make_shared<GatedTransport>(server->connectInMemory());
+            return gate;
+        })
+        .setManualIo()
+        .setAutoReconnect(false)
+        .setOfflineSpool(path, 64 * 1024)
+        ;
+    clientOpts.connectOptions.spoolOptions.maxQueuedMessages = 8;
+
+    auto client = scio_beast::SocketClusterClient::create(clientOpts);
+    auto socket = client->socket();
+
+    bool connected = false;
+    socket->on<scio_beast::SCSocket::ConnectEvent>([ &connected ](const json&) { connected = true; });
+
+    socket->connect();
+    REQUIRE(waitFor([ socket, &connected ]() { socket->poll(); return connected; }));
+
+    //  the first record is held on the wire; only as many as the queue takes are decoded
+    socket->poll();
+    CHECK(8 == socket->snapshot().outQueueDepth);
+
+    uint64_t maxDepth = 0;
+    CHECK(waitFor([ socket, gate, &maxDepth, &receivedLock, &received ]() {
+        gate->release(1);
+        socket->poll();
+        maxDepth = std::max(maxDepth, socket->snapshot().outQueueDepth);
+
+        std::lock_guard<std::mutex> lock(receivedLock);
+        return records == static_cast<int>(received.size());
+    }));
+    CHECK(maxDepth <= 8);
+
+    {
+        std::lock_guard<std::mutex> lock(receivedLock);
+        for(int n = 0; n < static_cast<int>(received.size()); ++n) {
+            REQUIRE(n == received[n]);
+        }
+    }
+
+    socket->close();
+    client->shutdown();
+    server->stop();
+
+    std::remove(path.c_str());
+}
+
+TEST_CASE("socket metrics", "[metrics]") {
+    auto client = scio_beast::SocketClusterClient::create(scio_beast::SocketClusterClientOptions());
+
+    auto a = client->socket();
+    auto b = client->socket();
+    UNUSED(b);
+
+    const scio_beast::SocketMetrics fresh = a->snapshot();
+    CHECK(0 == fresh.messagesIn);
+    CHECK(0 == fresh.bytesOut);
+    CHECK(0 == fresh.pendingResponses);
+
+    scio_beast::SocketMetrics total = scio_beast::SocketMetrics();
+    scio_beast::SocketMetrics one = scio_beast::SocketMetrics();
+    one.messagesIn                  = 3;
+    one.read.maxMessagesPerWakeup   = 5;
+
+    total += one;
+    total += one;
+    CHECK(6 == total.messagesIn);
+    CHECK(5 == total.read.maxMessagesPerWakeup);
+
+    CHECK(0 == client->snapshot().messagesOut);
+}
+
+TEST_CASE("socket metrics over a connection", "[metrics]") {
+    using namespace scio_beast::standin;
+
+    StandinOptions serverOpts;
+    serverOpts.pingInterval = 20;
+
+    auto server = Server::create(serverOpts);
+
+    //  held long enough to see it pending
+    server->on("work", [](Call& call) {
+        call.response   = call.data;
+        call.ackDelay   = 200;
+    });
+
+    server->start();
+
+    scio_beast::SocketClusterClientOptions clientOpts;
+    clientOpts.connectOptions
+        .setHost("127.0.0.1")
+        .setPort(server->getPortString())
+        .setAutoReconnect(false)
+        ;
+
+    auto client = scio_beast::SocketClusterClient::create(clientOpts);
+    auto socket = client->socket();
+    auto idle   = client->socket();   //  never connects; adds nothing to the totals
+    UNUSED(idle);
+
+    std::atomic<int> published(0);
+    socket->subscribe("news")->watch([ &published ](const json&) { ++published; });
+
+    socket->connect();
+    REQUIRE(waitFor([ server ]() {
+        return 1 == server->inspect([](const Protocol& p) { return p.subscriberCount("news"); });
+    }));
+
+    server->publish("news", "x");
+    REQUIRE(waitFor([ &published ]() { return 1 == published; }));
+    REQUIRE(waitFor([ socket ]() { return socket->snapshot().pings >= 2; }));
+
+    //  quiet from here on, so the emit is all that moves the counters
+    server->setPingInterval(0);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    const scio_beast::SocketMetrics before = socket->snapshot();
+
+    std::atomic<int> responses(0);
+    socket->emit("work", "x", [ &responses ](boost::system::error_code, const json&) { ++responses; });
+
+    CHECK(waitFor([ socket ]() { return 1 == socket->snapshot().pendingResponses; }));
+    REQUIRE(waitFor([ &responses ]() { return 1 == responses; }));
+    CHECK(waitFor([ socket ]() { return 0 == socket->snapshot().pendingResponses; }));
+
+    const scio_beast::SocketMetrics after = socket->snapshot();
+    CHECK(before.messagesOut + 1 == after.messagesOut);
+    CHECK(before.bytesOut < after.bytesOut);
+    CHECK(before.messagesIn + 1 == after.messagesIn);
+    CHECK(before.bytesIn < after.bytesIn);
+    CHECK(before.acksIn + 1 == after.acksIn);
+
+    socket->disconnect();
+    REQUIRE(waitFor([ socket ]() { return scio_beast::SCSocket::State::CLOSED == socket->getState(); }));
+
+    const scio_beast::SocketMetrics m = socket->snapshot();
+
+    CHECK(1 == m.handshakesIn);
+    CHECK(2 == m.acksIn);           //  #subscribe & work
+    CHECK(1 == m.publishesIn);
+    CHECK(0 == m.ackTimeouts);
+    CHECK(0 == m.decodeErrors);
+    CHECK(m.messagesIn == m.handshakesIn + m.acksIn + m.publishesIn + m.pings);
+    CHECK(m.lastPingIntervalMs > 0);
+
+    //  #handshake, #subscribe & work, then a pong per ping (or for several, if they come quickly)
+    CHECK(m.messagesOut > 3);
+    CHECK(m.messagesOut <= 3 + m.pings);
+
+    const scio_beast::SocketMetrics total = client->snapshot();
+    CHECK(m.messagesIn == total.messagesIn);
+    CHECK(m.bytesIn == total.bytesIn);
+    CHECK(m.messagesOut == total.messagesOut);
+    CHECK(m.bytesOut == total.bytesOut);
+    CHECK(m.acksIn == total.acksIn);
+    CHECK(m.publishesIn == total.publishesIn);
+    CHECK(m.pings == total.pings);
+
+    client->shutdown();
+    server->stop();
+}
+
+TEST_CASE("latency histogram", "[latency]") {
+    scio_beast::LatencyHistogram histogram;
+
+    CHECK(0 == histogram.percentile(50));
+
+    for(uint64_t v = 1; v <= 1000; ++v) {
+        histogram.record(v);
+    }
+
+    CHECK(1000 == histogram.count());
+    CHECK(1 == histogram.min());
+    CHECK(1000 == histogram.max());
+
+    //  within the ~6% bucket precision
+    CHECK(histogram.percentile(50) >= 500);
+    CHECK(histogram.percentile(50) <= 500 * 1.07);
+    CHECK(histogram.percentile(99) >= 990);
+    CHECK(1000 == histogram.percentile(100));
+
+    scio_beast::LatencyHistogram other;
+    other.record(5000);
+    histogram.merge(other);
+
+    CHECK(1001 == histogram.count());
+    CHECK(5000 == histogram.max());
+}
+
+TEST_CASE("rpc latency of emits", "[latency]") {
+    using namespace scio_beast::standin;
+
+    auto server = Server::create();
+
+    for(const std::string name : { "a", "b", "c" }) {
+        server->on(name, [](Call& call) {
+            call.response   = call.data;
+            call.ackDelay   = 100;
+        });
+    }
+
+    server->start();
+
+    scio_beast::SocketClusterClientOptions clientOpts;
+    clientOpts.connectOptions
+        .setHost("127.0.0.1")
+        .setPort(server->getPortString())
+        .setAutoReconnect(false)
+        ;
+    clientOpts.connectOptions.rpcLatencyOptions.perEventName  = true;
+    clientOpts.connectOptions.rpcLatencyOptions.maxEventNames = 1;
+
+    auto client = scio_beast::SocketClusterClient::create(clientOpts);
+    auto socket = client->socket();
+
+    std::atomic<bool> connected(false);
+    socket->on<scio_beast::SCSocket::ConnectEvent>([ &connected ](const json&) { connected = true; });
+
+    socket->connect();
+    REQUIRE(waitFor([ &connected ]() { return connected.load(); }));
+
+    std::atomic<int> responses(0);
+    const auto handler = [ &responses ](boost::system::error_code ec, const json&) {
+        if(!ec) {
+            ++responses;
+        }
+    };
+
+    socket->emit("a", 1, handler);
+    socket->emit("b", 2, handler);
+    socket->emit("c", 3, handler);
+    socket->emit("a", 4);   //  no response handler, nothing to time
+
+    REQUIRE(waitFor([ &responses ]() { return 3 == responses; }));
+
+    const scio_beast::RpcLatency latency = socket->getRpcLatency();
+    CHECK(3 == latency.total.count());
+    CHECK(3 == latency.queueWait.count());
+    CHECK(3 == latency.network.count());
+
+    //  the scripted ack delay is spent on the network, not in the queue
+    CHECK(latency.network.min() >= 100 * 1000);
+    CHECK(latency.total.min() >= latency.network.min());
+    CHECK(latency.queueWait.max() < 100 * 1000);
+
+    //  queue wait and network time make up the total, to within rounding per sample
+    const double total  = latency.total.mean() * latency.total.count();
+    const double parts  = (latency.queueWait.mean() + latency.network.mean()) * latency.total.count();
+    CHECK(std::abs(total - parts) <= 3);
+
+    //  "a" is the one name tracked; the rest are pooled
+    const scio_beast::RpcLatencyByEvent byEvent = socket->getRpcLatencyByEvent();
+    const std::string other = scio_beast::RpcLatencyOptions::OTHER_EVENTS();
+
+    CHECK(2 == byEvent.size());
+    REQUIRE(byEvent.count("a"));
+    REQUIRE(byEvent.count(other));
+    CHECK(1 == byEvent.at("a").total.count());
+    CHECK(2 == byEvent.at(other).total.count());
+    CHECK(0 == byEvent.count("b"));
+
+    socket->disconnect();
+    client->shutdown();
+    server->stop();
+}
+
+#ifdef SCIO_BEAST_ENABLE_TRACING
+TEST_CASE("outbound trace ids", "[trace]") {
+    using namespace scio_beast::standin;
+    using scio_beast::trace::Stage;
+
+    std::vector<scio_beast::trace::CollectedEvent> events;
+    scio_beast::trace::collect(events);     //  drop what earlier tests recorded
+    events.clear();
+
+    StandinOptions serverOpts;
+    serverOpts.pingInterval = 20;
+
+    auto server = Server::create(serverOpts);
+    server->start();
+
+    scio_beast::SocketClusterClientOptions clientOpts;
+    clientOpts.connectOptions
+        .setHost("127.0.0.1")
+        .setPort(server->getPortString())
+        .setAutoReconnect(false)
+        ;
+
+    auto client = scio_beast::SocketClusterClient::create(clientOpts);
+    auto socket = client->socket();
+
+    std::atomic<bool> connected(false);
+    socket->on<scio_beast::SCSocket::ConnectEvent>([ &connected ](const json&) { connected = true; });
+
+    socket->connect();
+    REQUIRE(waitFor([ &connected ]() { return connected.load(); }));
+
+    std::atomic<bool> acked(false);
+    socket->emit("echo", json(1), [ &acked ](boost::system::error_code, const json&) { acked = true; });
+    socket->emit("fire", json(2));
+
+    REQUIRE(waitFor([ &acked, server ]() { return acked && server->getStats().pongs > 0; }));
+
+    //  the stages each outbound message passed through, in order, by id
+    std::map<uint64_t, std::vector<Stage>> stages;
+    const bool complete = waitFor([ &events, &stages, socket ]() {
+        scio_beast::trace::collect(events);
+
+        stages.clear();
+        for(const auto& collected : events) {
+            const scio_beast::trace::Event& e = collected.event;
+            if(reinterpret_cast<uintptr_t>(socket.get()) == e.socket && e.stage >= Stage::ENQUEUE) {
+                stages[e.id].push_back(e.stage);
+            }
+        }
+
+        //  #handshake, both emits & at least one pong, all written
+        size_t written = 0;
+        for(const auto& s : stages) {
+            written += Stage::WRITE_COMPLETE == s.second.back() ? 1 : 0;
+        }
+        return written >= 4;
+    });
+
+    REQUIRE(complete);
+
+    const std::vector<Stage> message = { Stage::ENQUEUE, Stage::ENCODE_DONE, Stage::WRITE_BEGIN, Stage::WRITE_COMPLETE };
+    const std::vector<Stage> pong = { Stage::ENQUEUE, Stage::WRITE_BEGIN, Stage::WRITE_COMPLETE };
+
+    size_t messages = 0;
+    size_t pongs = 0;
+    for(const auto& s : stages) {
+        if(Stage::WRITE_COMPLETE != s.second.back()) {
+            continue;   //  still on its way out
+        }
+
+        CHECK(0 != s.first);
+        if(message == s.second) {
+            ++messages;
+        } else {
+            CHECK(pong == s.second);
+            ++pongs;
+        }
+    }
+
+    CHECK(3 == messages);
+    CHECK(pongs > 0);
+
+    socket->disconnect();
+    client->shutdown();
+    server->stop();
+}
+#endif
+
+TEST_CASE("watchdog", "[watchdog]") {
+    using namespace scio_beast::standin;
+    using scio_beast::SCSocket;
+
+    auto server = Server::create();
+
+    server->on("work", [](Call& call) {
+        call.response = call.data;
+    });
+
+    server->start();
+
+    scio_beast::SocketClusterClientOptions clientOpts;
+    clientOpts.connectOptions
+        .setHost("127.0.0.1")
+        .setPort(server->getPortString())
+        .setAutoReconnect(false)
+        .setWatchdog(10, 50, 20 * 1000)
+        ;
+
+    auto client = scio_beast::SocketClusterClient::create(clientOpts);
+    auto socket = client->socket();
+
+    std::mutex slowLock;
+    std::vector<scio_beast::SlowHandlerInfo> slow;
+    socket->on<SCSocket::SlowHandlerEvent>([ &slowLock, &slow ](const scio_beast::SlowHandlerInfo& info) {
+        std::lock_guard<std::mutex> lock(slowLock);
+        slow.push_back(info);
+    });
+
+    std::atomic<int> lagEvents(0);
+    socket->on<SCSocket::LoopLagEvent>([ &lagEvents ](std::chrono::milliseconds) { ++lagEvents; });
+
+    std::atomic<bool> connected(false);
+    socket->on<SCSocket::ConnectEvent>([ &connected ](const json&) { connected = true; });
+
+    //  each blocks the io thread, so the lag timer runs late too
+    std::atomic<int> published(0);
+    socket->subscribe("news")->watch([ &published ](const json&) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(150));
+        ++published;
+    });
+
+    socket->connect();
+    REQUIRE(waitFor([ &connected ]() { return connected.load(); }));
+    REQUIRE(waitFor([ server ]() {
+        return 1 == server->inspect([](const Protocol& p) { return p.subscriberCount("news"); });
+    }));
+
+    server->publish("news", "slow");
+    REQUIRE(waitFor([ &published ]() { return 1 == published; }));
+
+    std::atomic<int> responses(0);
+    socket->emit("work", "slow", [ &responses ](boost::system::error_code, const json&) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(150));
+        ++responses;
+    });
+    REQUIRE(waitFor([ &responses ]() { return 1 == responses; }));
+
+    CHECK(waitFor([ &lagEvents ]() { return lagEvents > 0; }));
+    CHECK(socket->snapshot().maxLoopLagMs >= 50);
+    CHECK(socket->snapshot().slowHandlers >= 2);
+
+    {
+        std::lock_guard<std::mutex> lock(slowLock);
+
+        const auto isChannel = [](const scio_beast::SlowHandlerInfo& info) {
+            return scio_beast::SCChannel::ChannelEvent == info.handlerId && "news" == info.channel;
+        };
+        const auto isResponse = [](const scio_beast::SlowHandlerInfo& info) {
+            return SCSocket::ResponseHandlerId == info.handlerId && info.channel.empty();
+        };
+
+        CHECK(1 == std::count_if(slow.begin(), slow.end(), isChannel));
+        CHECK(1 == std::count_if(slow.begin(), slow.end(), isResponse));
+
+        for(const auto& info : slow) {
+            if(isChannel(info) || isResponse(info)) {
+                CHECK(info.duration >= std::chrono::milliseconds(150));
+            }
+        }
+    }
+
+    socket->disconnect();
+    client->shutdown();
+    server->stop();
+}
+
+TEST_CASE("codec engines round trip", "[codec]") {
+    std::vector<std::shared_ptr<scio_beast::ICodecEngine>> codecs = {
+        std::make_shared<scio_beast::CodecEngineJson>(),
+        std::make_shared<scio_beast::CodecEngineMinBin>()
+    };
+
+    const json packets = {
+        { { "event", "chat" }, { "data", { { "text", "hi" }, { "n", 3 } } }, { "cid", 7 } },
+        { { "event", "#publish" }, { "data", { { "channel", "news" }, { "data", { 1, 2, 3 } } } } },
+        { { "rid", 7 }, { "error", { { "name", "Error" } } }, { "data", "detail" } },
+        { { { "event", "#publish" }, { "data", { { "channel", "a" }, { "data", "x" } } } },
+          { { "event", "#publish" }, { "data", { { "channel", "b" }, { "data", "y" } } } } }
+    };
+
+    for(const auto& codec : codecs) {
+        for(const auto& packet : packets) {
+            CHECK(packet == codec->decode(codec->encode(packet)));
+        }
+    }
+
+    CHECK(!codecs[0]->isBinary());
+    CHECK(codecs[1]->isBinary());
+}
+
+TEST_CASE("stand-in server", "[standin]") {
+    using namespace scio_beast::standin;
+
+    StandinOptions serverOpts;
+    scio_beast::SocketClusterClientOptions clientOpts;
+
+    SECTION("json") {
+    }
+
+    SECTION("min-bin") {
+        auto codec = std::make_shared<scio_beast::CodecEngineMinBin>();
+        serverOpts.codecEngine = codec;
+        clientOpts.connectOptions.setCodecEngine(codec);
+    }
+
+    SECTION("tls") {
+        serverOpts.sslContext = selfSignedContext();
+        clientOpts.connectOptions.setSecure();
+        clientOpts.connectOptions.secureOptions.context =
+            std::make_shared<boost::asio::ssl::context>(boost::asio::ssl::context::sslv23_client);
+    }
+
+    serverOpts.ackDelay = 10;
+
+    auto server = Server::create(serverOpts);
+
+    server->on("add", [](Call& call) {
+        call.response = { { "sum", call.data.value("a", 0) + call.data.value("b", 0) } };
+    });
+
+    server->on("login", [](Call& call) {
+        call.authToken = { { "user", call.data.value("user", "") } };
+    });
+
+    server->start();
+
+    clientOpts.connectOptions
+        .setHost("127.0.0.1")
+        .setPort(server->getPortString())
+        .setAutoReconnect(false)
+        ;
+
+    auto client = scio_beast::SocketClusterClient::create(clientOpts);
+    auto socket = client->socket();
+
+    std::atomic<int> sum(0);
+    std::atomic<int> published(0);
+    std::atomic<bool> authenticated(false);
+
+    socket->on<scio_beast::SCSocket::AuthenticateEvent>([ &authenticated ](const std::string&) {
+        authenticated = true;
+    });
+
+    socket->on<scio_beast::SCSocket::ConnectEvent>([ socket, &sum ](const json&) {
+        socket->emit("add", json({ { "a", 2 }, { "b", 3 } }), [ &sum ](boost::system::error_code ec, const json& resp) {
+            if(!ec) {
+                sum = resp.value("sum", -1);
+            }
+        });
+
+        socket->emit("login", json({ { "user", "standin" } }));
+    });
+
+    auto channel = socket->subscribe("news");
+    channel->watch([ &published ](const json& data) {
+        published += data.value("n", 0);
+    });
+
+    socket->connect();
+
+    CHECK(waitFor([ &sum ]() { return 5 == sum; }));
+    CHECK(waitFor([ &authenticated ]() { return authenticated.load(); }));
+    REQUIRE(waitFor([ server ]() {
+        return 1 == server->inspect([](const Protocol& p) { return p.subscriberCount("news"); });
+    }));
+
+    server->startPublishStream("news", { { "n", 1 } }, 0, 100);
+    CHECK(waitFor([ &published ]() { return 100 == published; }));
+
+    CHECK("standin" == socket->getAuthToken().value("user", ""));
+    CHECK(1 == server->getStats().connections);
+
+    socket->disconnect();
+    client->shutdown();
+    server->stop();
+}
+
+TEST_CASE("io pump", "[pump]") {
+    using namespace scio_beast::standin;
+
+    StandinOptions serverOpts;
+
+    SECTION("no pings") {
+    }
+
+    SECTION("pings") {
+        serverOpts.pingInterval = 20;
+    }
+
+    auto server = Server::create(serverOpts);
+    server->start();
+
+    scio_beast::SocketClusterClientOptions clientOpts;
+    clientOpts.connectOptions
+        .setHost("127.0.0.1")
+        .setPort(server->getPortString())
+        .setAutoReconnect(false)
+        ;
+
+    auto client = scio_beast::SocketClusterClient::create(clientOpts);
+    auto socket = client->socket();
+
+    std::atomic<bool> connected(false);
+    std::atomic<bool> disconnected(false);
+
+    socket->on<scio_beast::SCSocket::ConnectEvent>([ &connected ](const json&) {
+        connected = true;
+    });
+
+    socket->on<scio_beast::SCSocket::DisconnectEvent>([ &disconnected ](const boost::system::error_code&) {
+        disconnected = true;
+    });
+
+    socket->connect();
+    REQUIRE(waitFor([ &connected ]() { return connected.load(); }));
+
+    if(0 == serverOpts.pingInterval) {
+        //  nothing else arrives to wake the pump; the emit has to go out on its own
+        std::atomic<int> acked(0);
+        socket->emit("echo", json(1), [ &acked ](boost::system::error_code ec, const json&) {
+            if(!ec) {
+                ++acked;
+            }
+        });
+
+        CHECK(waitFor([ &acked ]() { return 1 == acked; }, 1000));
+        CHECK(1 == server->getStats().emits);
+
+        //  a clean close from the server is a disconnect, not an unknown error
+        const ConnectionId conn = *server->inspect([](const Protocol& p) { return p.connections(); }).begin();
+        server->closeConnection(conn);
+
+        CHECK(waitFor([ &disconnected ]() { return disconnected.load(); }));
+        CHECK(scio_beast::SCSocket::State::CLOSED == socket->getState());
+    } else {
+        //  the stand-in only counts a message that is exactly "#2" as a pong
+        CHECK(waitFor([ server ]() { return server->getStats().pongs >= 3; }));
+    }
+
+    socket->disconnect();
+    client->shutdown();
+    server->stop();
+}
+
+TEST_CASE("wire capture and replay", "[capture]") {
+    using namespace scio_beast::standin;
+
+    const std::string path = "scio_beast_test.capture";
+    std::remove(path.c_str());
+
+    auto server = Server::create(StandinOptions());
+    server->start();
+
+    scio_beast::SocketClusterClientOptions clientOpts;
+    clientOpts.connectOptions
+        .setHost("127.0.0.1")
+        .setPort(server->getPortString())
+        .setAutoReconnect(false)
+        .setWireCapture(path, 1024 * 1024)
+        ;
+
+    {
+        auto client = scio_beast::SocketClusterClient::create(clientOpts);
+        auto socket = client->socket();
+
+        std::atomic<int> published(0);
+        socket->subscribe("news")->watch([ &published ](const json& data) {
+            published += data.value("n", 0);
+        });
+
+        socket->connect();
+
+        REQUIRE(waitFor([ server ]() {
+            return 1 == server->inspect([](const Protocol& p) { return p.subscriberCount("news"); });
+        }));
+
+        server->startPublishStream("news", { { "n", 1 } }, 0, 50);
+        REQUIRE(waitFor([ &published ]() { return 50 == published; }));
+
+        socket->disconnect();
+        client->shutdown();
+    }
+
+    server->stop();
+
+    scio_beast::WireCapture capture;
+    REQUIRE(capture.open(path));
+
+    size_t offset = 0;
+    size_t inbound = 0;
+    size_t outbound = 0;
+    scio_beast::WireCapture::Frame frame;
+
+    while(capture.next(offset, frame)) {
+        scio_beast::WireCapture::Direction::INBOUND == frame.direction ? ++inbound : ++outbound;
+        CHECK(scio_beast::WireCapture::Opcode::TEXT == frame.opcode);
+    }
+
+    CHECK(inbound >= 52);   //  handshake & subscribe acks, then the publishes
+    CHECK(outbound >= 2);   //  #handshake, #subscribe
+    CHECK(0 == capture.dropped());
+
+    SECTION("replays at max speed") {
+        clientOpts.connectOptions.setWireCapture("");
+
+        auto client = scio_beast::SocketClusterClient::create(clientOpts);
+        auto socket = client->socket();
+
+        int published = 0;
+        socket->subscribe("news")->watch([ &published ](const json& data) {
+            published += data.value("n", 0);
+        });
+
+        scio_beast::ReplayStats stats;
+        REQUIRE(!socket->replay(path, stats));
+
+        CHECK(50 == published);
+        CHECK(inbound == stats.messages);
+        CHECK(50 == socket->snapshot().publishesIn);
+
+        CHECK(scio_beast::make_error_code(scio_beast::capture_unavailable) == socket->replay("no such capture", stats));
+    }
+
+    std::remove(path.c_str());
+}
+
+TEST_CASE("in-memory transport and virtual time", "[memory]") {
+    using namespace scio_beast::standin;
+
+    auto server = Server::create();
+
+    server->on("add", [](Call& call) {
+        call.response = { { "sum", call.data.value("a", 0) + call.data.value("b", 0) } };
+    });
+
+    //  answers long after any ack timeout
+    server->on("stall", [](Call& call) {
+        call.ackDelay = 60 * 60 * 1000;
+    });
+
+    server->start();
+
+    auto clock = std::make_shared<scio_beast::VirtualClock>();
+
+    scio_beast::SocketClusterClientOptions clientOpts;
+    clientOpts.connectOptions
+        .setTransport([ server ]() { return server->connectInMemory(); })
+        .setVirtualClock(clock)
+        .setManualIo()
+        .setAckTimeout(2)
+        .setAutoReconnect(false)
+        ;
+
+    auto client = scio_beast::SocketClusterClient::create(clientOpts);
+    auto socket = client->socket();
+
+    //  manual io: every handler runs on this thread, inside poll()
+    bool connected = false;
+    int sum = 0;
+    boost::system::error_code stallEc = boost::asio::error::in_progress;
+    boost::system::error_code disconnectEc;
+
+    socket->on<scio_beast::SCSocket::ConnectEvent>([ &connected ](const json&) {
+        connected = true;
+    });
+
+    socket->on<scio_beast::SCSocket::DisconnectEvent>([ &disconnectEc ](const boost::system::error_code& ec) {
+        disconnectEc = ec;
+    });
+
+    socket->connect();
+
+    //  the server answers from its own thread; only the client is stepped
+    REQUIRE(waitFor([ socket, &connected ]() { socket->poll(); return connected; }));
+
+    socket->emit("add", json({ { "a", 2 }, { "b", 3 } }), [ &sum ](boost::system::error_code ec, const json& resp) {
+        if(!ec) {
+            sum = resp.value("sum", -1);
+        }
+    });
+
+    socket->emit("stall", json::object(), [ &stallEc ](boost::system::error_code ec, const json&) {
+        stallEc = ec;
+    });
+
+    CHECK(waitFor([ socket, &sum ]() { socket->poll(); return 5 == sum; }));
+    CHECK(1 == server->getStats().connections);
+
+    //  no sleeping for the ack timeout
+    clock->advance(boost::posix_time::milliseconds(1999));
+    socket->poll();
+    CHECK(boost::asio::error::in_progress == stallEc);
+
+    clock->advance(boost::posix_time::milliseconds(1));
+    socket->poll();
+    CHECK(scio_beast::ack_timeout == stallEc);
+
+    socket->disconnect();
+    socket->poll();
+
+    CHECK(scio_beast::SCSocket::State::CLOSED == socket->getState());
+    CHECK(boost::asio::error::eof == disconnectEc);
+    CHECK(waitFor([ server ]() { return 0 == server->getStats().connections; }));
+
+    client->shutdown();
+    server->stop();
+}
+
+TEST_CASE("streamed messages", "[stream]") {
+    using namespace scio_beast::standin;
+
+    //  reassembles what it is handed; runs on the socket's io thread
+    class Collector
+        : public scio_beast::IMessageStreamHandler
+    {
+    public:
+        Collector() : begins(0), fragments(0), ends(0), aborts(0) {}
+
+        virtual void onMessageBegin() override { ++begins; message.clear(); }
+        virtual void onMessageFragment(const char* data, size_t size) override { ++fragments; message.append(data, size); }
+        virtual void onMessageEnd() override { ++ends; }
+        virtual void onMessageAbort() override { ++aborts; }
+
+        std::atomic<int>    begins;
+        std::atomic<int>    fragments;
+        std::atomic<int>    ends;
+        std::atomic<int>    aborts;
+        std::string         message;
+    };
+
+    auto collector = std::make_shared<Collector>();
+
+    auto server = Server::create();
+    server->start();
+
+    scio_beast::SocketClusterClientOptions clientOpts;
+    clientOpts.connectOptions
+        .setHost("127.0.0.1")
+        .setPort(server->getPortString())
+        .setAutoReconnect(false)
+        .setReadSize(4096, 4096, false)
+        .setMessageStreamHandler(collector, 16 * 1024)
+        ;
+
+    auto client = scio_beast::SocketClusterClient::create(clientOpts);
+    auto socket = client->socket();
+
+    std::atomic<int> watched(0);
+    socket->subscribe("files")->watch([ &watched ](const json&) {
+        ++watched;
+    });
+
+    socket->connect();
+
+    REQUIRE(waitFor([ server ]() {
+        return 1 == server->inspect([](const Protocol& p) { return p.subscriberCount("files"); });
+    }));
+
+    const std::string blob(256 * 1024, 'x');
+    server->publish("files", { { "blob", blob } });
+
+    REQUIRE(waitFor([ collector ]() { return 1 == collector->ends; }));
+    CHECK(1 == collector->begins);
+    CHECK(collector->fragments > 1);
+    CHECK(0 == collector->aborts);
+    CHECK(blob == json::parse(collector->message)["data"]["data"].value("blob", ""));
+
+    //  small messages still take the normal path
+    server->publish("files", { { "blob", "small" } });
+    CHECK(waitFor([ &watched ]() { return 1 == watched; }));
+    CHECK(1 == collector->begins);
+
+    socket->disconnect();
+    client->shutdown();
+    server->stop();
+}
+
+TEST_CASE("maxMessageSize over a message transport", "[stream]") {
+    using namespace scio_beast::standin;
+
+    auto server = Server::create();
+    server->start();
+
+    scio_beast::SocketClusterClientOptions clientOpts;
+    clientOpts.connectOptions
+        .setTransport([ server ]() { return server->connectInMemory(); })
+        .setAutoReconnect(false)
+        .setMaxMessageSize(1024)
+        ;
+
+    auto client = scio_beast::SocketClusterClient::create(clientOpts);
+    auto socket = client->socket();
+
+    std::atomic<bool> tooBig(false);
+    socket->on<scio_beast::SCSocket::ErrorEvent>([ &tooBig ](const boost::system::error_code& ec) {
+        tooBig = scio_beast::make_error_code(scio_beast::message_too_big) == ec;
+    });
+
+    std::atomic<int> watched(0);
+    socket->subscribe("files")->watch([ &watched ](const json&) {
+        ++watched;
+    });
+
+    socket->connect();
+
+    REQUIRE(waitFor([ server ]() {
+        return 1 == server->inspect([](const Protocol& p) { return p.subscriberCount("files"); });
+    }));
+
+    //  no WebSocket layer to enforce the limit
+    server->publish("files", { { "blob", std::string(4096, 'x') } });
+
+    CHECK(waitFor([ &tooBig ]() { return tooBig.load(); }));
+    CHECK(waitFor([ socket ]() { return scio_beast::SCSocket::State::CLOSED == socket->getState(); }));
+    CHECK(0 == watched);
+
+    client->shutdown();
+    server->stop();
+}
+
+TEST_CASE("inbound byte budget", "[backpressure]") {
+    using namespace scio_beast::standin;
+
+    auto server = Server::create();
+    server->start();
+
+    scio_beast::SocketClusterClientOptions clientOpts;
+    clientOpts.connectOptions
+        .setHost("127.0.0.1")
+        .setPort(server->getPortString())
+        .setAutoReconnect(false)
+        .setInboxCapacity(1024)
+        .setInboundByteBudget(4096, 1024)
+        ;
+
+    auto client = scio_beast::SocketClusterClient::create(clientOpts);
+    auto socket = client->socket();
+
+    std::atomic<int> paused(0);
+    std::atomic<int> resumed(0);
+
+    socket->on<scio_beast::SCSocket::ReadPausedEvent>([ &paused ](size_t) { ++paused; });
+    socket->on<scio_beast::SCSocket::ReadResumedEvent>([ &resumed ](size_t) { ++resumed; });
+
+    socket->subscribe("feed");
+    socket->connect();
+
+    REQUIRE(waitFor([ server ]() {
+        return 1 == server->inspect([](const Protocol& p) { return p.subscriberCount("feed"); });
+    }));
+
+    //  ~100 bytes each: the budget is exceeded well before the last one
+    const int count = 200;
+    for(int i = 0; i < count; ++i) {
+        server->publish("feed", { { "n", i }, { "pad", std::string(64, 'x') } });
+    }
+
+    REQUIRE(waitFor([ &paused ]() { return paused > 0; }));
+    CHECK(socket->isReadPaused());
+
+    scio_beast::ChannelMessageBatch batch;
+    CHECK(waitFor([ socket, &batch, count ]() {
+        socket->drain(batch, 16);
+        return count == static_cast<int>(batch.size());
+    }));
+
+    CHECK(resumed > 0);
+    CHECK_FALSE(socket->isReadPaused());
+
+    //  nothing lost or reordered while reads were paused
+    for(int i = 0; i < static_cast<int>(batch.size()); ++i) {
+        if(i != batch[i].data.value("n", -1)) {
+            FAIL("publish " << i << " out of order");
+        }
+    }
+
+    socket->disconnect();
+    client->shutdown();
+    server->stop();
+}
+
+TEST_CASE("batched packet dispatch", "[batch]") {
+    using namespace scio_beast::standin;
+
+    auto server = Server::create();
+    server->start();
+
+    scio_beast::SocketClusterClientOptions clientOpts;
+    clientOpts.connectOptions
+        .setHost("127.0.0.1")
+        .setPort(server->getPortString())
+        .setAutoReconnect(false)
+        ;
+
+    auto client = scio_beast::SocketClusterClient::create(clientOpts);
+    auto socket = client->socket();
+
+    std::mutex          lock;
+    std::vector<int>    received;
+    socket->subscribe("batch")->watch([ &lock, &received ](const json& data) {
+        std::lock_guard<std::mutex> guard(lock);
+        received.push_back(data.value("n", -1));
+    });
+
+    socket->connect();
+
+    REQUIRE(waitFor([ server ]() {
+        return 1 == server->inspect([](const Protocol& p) { return p.subscriberCount("batch"); });
+    }));
+
+    const scio_beast::ReadStats before = socket->getReadStats();
+
+    //  one WebSocket message, three times the default readBatchBudget
+    const int count = 200;
+    json packets = json::array();
+    for(int i = 0; i < count; ++i) {
+        packets.push_back({
+            { "event",  "#publish" },
+            { "data",   { { "channel", "batch" }, { "data", { { "n", i } } } } }
+        });
+    }
+
+    const ConnectionId conn = server->inspect([](const Protocol& p) { return *p.connections().begin(); });
+    server->send(conn, packets);
+
+    REQUIRE(waitFor([ &lock, &received, count ]() {
+        std::lock_guard<std::mutex> guard(lock);
+        return count == static_cast<int>(received.size());
+    }));
+
+    for(int i = 0; i < count; ++i) {
+        if(i != received[i]) {
+            FAIL("packet " << i << " dispatched out of order");
+        }
+    }
+
+    //  the whole array counts as a single wakeup even though it was split across turns
+    const scio_beast::ReadStats after = socket->getReadStats();
+    CHECK(static_cast<uint64_t>(count) == after.messages - before.messages);
+    CHECK(1u == after.wakeups - before.wakeups);
+    CHECK(static_cast<uint64_t>(count) == after.maxMessagesPerWakeup);
+
+    socket->disconnect();
+    client->shutdown();
+    server->stop();
+}
+
+TEST_CASE("connect after disconnect", "[reconnect]") {
+    using namespace scio_beast::standin;
+
+    auto server = Server::create();
+    server->start();
+
+    scio_beast::SocketClusterClientOptions clientOpts;
+    clientOpts.connectOptions
+        .setHost("127.0.0.1")
+        .setPort(server->getPortString())
+        .setAutoReconnect(false)
+        ;
+
+    auto client = scio_beast::SocketClusterClient::create(clientOpts);
+    auto socket = client->socket();
+
+    std::atomic<int> connects(0);
+    std::atomic<int> disconnects(0);
+    socket->on<scio_beast::SCSocket::ConnectEvent>([ &connects ](const json&) { ++connects; });
+    socket->on<scio_beast::SCSocket::DisconnectEvent>([ &disconnects ](const boost::system::error_code&) { ++disconnects; });
+
+    //  the io thread runs out of work between rounds; connect() must start a new one
+    for(int i = 1; i <= 3; ++i) {
+        socket->connect();
+        REQUIRE(waitFor([ &connects, i ]() { return i == connects; }));
+
+        socket->disconnect();
+        REQUIRE(waitFor([ &disconnects, i ]() { return i == disconnects; }));
+    }
+
+    CHECK(waitFor([ server ]() { return 0 == server->getStats().connections; }));
+
+    client->shutdown();
+    server->stop();
+}
+
+TEST_CASE("pending emits across a disconnect", "[reconnect]") {
+    using namespace scio_beast::standin;
+
+    StandinOptions serverOpts;
+    serverOpts.ackDelay = 500;  //  still unanswered when the connection goes
+
+    auto server = Server::create(serverOpts);
+
+    std::mutex cidsLock;
+    std::vector<scio_beast::CallId> retryCids;
+    std::atomic<int> calls(0);
+
+    server->on("work", [ &cidsLock, &retryCids, &calls ](Call& call) {
+        if("retry" == call.data) {
+            std::lock_guard<std::mutex> lock(cidsLock);
+            retryCids.push_back(call.cid);
+        }
+        call.response = call.data;
+        ++calls;
+    });
+
+    server->start();
+
+    scio_beast::SocketClusterClientOptions clientOpts;
+    clientOpts.connectOptions
+        .setHost("127.0.0.1")
+        .setPort(server->getPortString())
+        .setAutoReconnect(true)
+        ;
+    clientOpts.connectOptions.autoReconnectOptions.initialDelay = 10;
+    clientOpts.connectOptions.autoReconnectOptions.randomness   = 0;
+
+    auto client = scio_beast::SocketClusterClient::create(clientOpts);
+    auto socket = client->socket();
+
+    std::atomic<int> connects(0);
+    socket->on<scio_beast::SCSocket::ConnectEvent>([ &connects ](const json&) { ++connects; });
+
+    socket->connect();
+    REQUIRE(waitFor([ &connects ]() { return 1 == connects; }));
+
+    std::atomic<int> failFastResponses(0);
+    boost::system::error_code failFastEc;
+    socket->emit("work", "fail-fast", [ &failFastResponses, &failFastEc ](boost::system::error_code ec, const json&) {
+        failFastEc = ec;
+        ++failFastResponses;
+    });
+
+    std::atomic<int> retryResponses(0);
+    boost::system::error_code retryEc = boost::asio::error::in_progress;
+    socket->emit("work", "retry", [ &retryResponses, &retryEc ](boost::system::error_code ec, const json&) {
+        retryEc = ec;
+        ++retryResponses;
+    }, scio_beast::EmitOptions().setDisconnectPolicy(scio_beast::DisconnectPolicy::RETRY));
+
+    REQUIRE(waitFor([ &calls ]() { return 2 == calls; }));
+
+    const ConnectionId conn = *server->inspect([](const Protocol& p) { return p.connections(); }).begin();
+    server->closeConnection(conn);
+
+    //  well inside the ack delay, let alone the ack timeout
+    CHECK(waitFor([ &failFastResponses ]() { return 1 == failFastResponses; }, 250));
+    CHECK(scio_beast::disconnected == failFastEc);
+
+    REQUIRE(waitFor([ &retryResponses ]() { return 1 == retryResponses; }));
+    CHECK(!retryEc);
+    CHECK(2 == connects);
+
+    {
+        std::lock_guard<std::mutex> lock(cidsLock);
+        REQUIRE(2 == retryCids.size());
+        CHECK(retryCids[0] != retryCids[1]);
+    }
+
+    //  answered once only
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    CHECK(1 == retryResponses);
+    CHECK(1 == failFastResponses);
+
+    socket->disconnect();
+    client->shutdown();
+    server->stop();
+}
+
+TEST_CASE("retained emits time out without a reconnect", "[reconnect]") {
+    using namespace scio_beast::standin;
+
+    auto server = Server::create();
+
+    std::atomic<int> calls(0);
+    server->on("stall", [ &calls ](Call& call) {
+        call.ackDelay = 60 * 60 * 1000;
+        ++calls;
+    });
+
+    server->start();
+
+    auto clock = std::make_shared<scio_beast::VirtualClock>();
+
+    //  the server never comes back
+    std::atomic<int> opened(0);
+
+    scio_beast::SocketClusterClientOptions clientOpts;
+    clientOpts.connectOptions
+        .setTransport([ server, &opened ]() -> scio_beast::MessageTransportPtr {
+            return 0 == opened++ ? server->connectInMemory() : nullptr;
+        })
+        .setVirtualClock(clock)
+        .setManualIo()
+        .setAckTimeout(2)
+        .setAutoReconnect(true)
+        ;
+    clientOpts.connectOptions.autoReconnectOptions.initialDelay = 10;
+    clientOpts.connectOptions.autoReconnectOptions.randomness   = 0;
+
+    auto client = scio_beast::SocketClusterClient::create(clientOpts);
+    auto socket = client->socket();
+
+    bool connected = false;
+    int disconnects = 0;
+    socket->on<scio_beast::SCSocket::ConnectEvent>([ &connected ](const json&) { connected = true; });
+    socket->on<scio_beast::SCSocket::DisconnectEvent>([ &disconnects ](const boost::system::error_code&) { ++disconnects; });
+
+    socket->connect();
+    REQUIRE(waitFor([ socket, &connected ]() { socket->poll(); return connected; }));
+
+    const auto retry = scio_beast::EmitOptions().setDisconnectPolicy(scio_beast::DisconnectPolicy::RETRY);
+
+    int timedResponses = 0;
+    boost::system::error_code timedEc;
+    socket->emit("stall", "timed", [ &timedResponses, &timedEc ](boost::system::error_code ec, const json&) {
+        timedEc = ec;
+        ++timedResponses;
+    }, retry);
+
+    int untimedResponses = 0;
+    boost::system::error_code untimedEc;
+    socket->emit("stall", "untimed", [ &untimedResponses, &untimedEc ](boost::system::error_code ec, const json&) {
+        untimedEc = ec;
+        ++untimedResponses;
+    }, scio_beast::EmitOptions(retry).setNoTimeout());
+
+    REQUIRE(waitFor([ socket, &calls ]() { socket->poll(); return 2 == calls; }));
+
+    //  the deadline runs from the emit, not from the disconnect
+    clock->advance(boost::posix_time::milliseconds(1000));
+    socket->poll();
+
+    const ConnectionId conn = *server->inspect([](const Protocol& p) { return p.connections(); }).begin();
+    server->closeConnection(conn);
+    REQUIRE(waitFor([ socket, &disconnects ]() { socket->poll(); return 1 == disconnects; }));
+
+    clock->advance(boost::posix_time::milliseconds(999));
+    socket->poll();
+    CHECK(0 == timedResponses);
+
+    clock->advance(boost::posix_time::milliseconds(1));
+    socket->poll();
+    CHECK(1 == timedResponses);
+    CHECK(scio_beast::disconnected == timedEc);
+    CHECK(opened > 1);  //  still trying
+
+    clock->advance(boost::posix_time::seconds(60));
+    socket->poll();
+    CHECK(1 == timedResponses);
+    CHECK(0 == untimedResponses);
+
+    socket->close();
+    CHECK(1 == untimedResponses);
+    CHECK(scio_beast::disconnected == untimedEc);
+
+    client->shutdown();
+    server->stop();
+}
+
+TEST_CASE("resubscribe burst", "[reconnect]") {
+    using namespace scio_beast::standin;
+
+    const int channels = 12;
+
+    StandinOptions serverOpts;
+    serverOpts.ackDelay = 100;  //  holds each wave in flight
+
+    auto server = Server::create(serverOpts);
+    server->start();
+
+    scio_beast::SocketClusterClientOptions clientOpts;
+    clientOpts.connectOptions
+        .setHost("127.0.0.1")
+        .setPort(server->getPortString())
+        .setAutoReconnect(true)
+        ;
+    clientOpts.connectOptions.autoReconnectOptions.initialDelay = 100;
+    clientOpts.connectOptions.autoReconnectOptions.randomness   = 0;
+    clientOpts.connectOptions.resubscribeOptions.maxInFlight    = 4;
+
+    auto client = scio_beast::SocketClusterClient::create(clientOpts);
+    auto socket = client->socket();
+
+    std::atomic<int> subscribed(0);
+    socket->on<scio_beast::SCSocket::SubscribeEvent>([ &subscribed ](const std::string&) { ++subscribed; });
+
+    std::atomic<int> completions(0);
+    std::atomic<int> lastTotal(0);
+    std::atomic<int> lastSubscribed(0);
+    socket->on<scio_beast::SCSocket::ResubscribeCompleteEvent>(
+        [ &completions, &lastTotal, &lastSubscribed ](const scio_beast::ResubscribeResult& result) {
+            lastTotal       = static_cast<int>(result.total);
+            lastSubscribed  = static_cast<int>(result.subscribed);
+            ++completions;
+        }
+    );
+
+    //  pending until connected, so the first connect bursts them too
+    for(int n = 0; n < channels; ++n) {
+        socket->subscribe("burst-" + std::to_string(n));
+    }
+
+    socket->connect();
+
+    REQUIRE(waitFor([ &completions ]() { return 1 == completions; }));
+    CHECK(channels == subscribed);
+    CHECK(static_cast<uint64_t>(channels) == server->getStats().subscriptions);
+
+    const ConnectionId conn = *server->inspect([](const Protocol& p) { return p.connections(); }).begin();
+    server->closeConnection(conn);
+
+    REQUIRE(waitFor([ server ]() { return 0 == server->getStats().subscriptions; }));
+
+    //
+    //  Subscriptions the server holds that the client has not seen acked are in
+    //  flight. Sampling the server first can only undercount them.
+    //
+    int maxInFlight = 0;
+    const bool completed = waitFor([ &completions, server, &subscribed, &maxInFlight ]() {
+        const int held = static_cast<int>(server->getStats().subscriptions);
+        maxInFlight = std::max(maxInFlight, held - (subscribed - channels));
+        return 2 == completions;
+    });
+
+    REQUIRE(completed);
+    CHECK(maxInFlight > 0);
+    CHECK(maxInFlight <= 4);
+    CHECK(channels == lastTotal);
+    CHECK(channels == lastSubscribed);
+    CHECK(2 * channels == subscribed);
+
+    //  one per burst
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    CHECK(2 == completions);
+
+    socket->disconnect();
+    client->shutdown();
+    server->stop();
+}
+
+TEST_CASE("resubscribe timeout", "[reconnect]") {
+    using namespace scio_beast::standin;
+
+    StandinOptions serverOpts;
+    serverOpts.ackDelay = 60 * 1000;
+
+    auto server = Server::create(serverOpts);
+    server->start();
+
+    scio_beast::SocketClusterClientOptions clientOpts;
+    clientOpts.connectOptions
+        .setHost("127.0.0.1")
+        .setPort(server->getPortString())
+        .setAutoReconnect(false)
+        ;
+    clientOpts.connectOptions.resubscribeOptions.timeout = 100;
+
+    auto client = scio_beast::SocketClusterClient::create(clientOpts);
+    auto socket = client->socket();
+
+    std::atomic<int> failed(0);
+    socket->on<scio_beast::SCSocket::SubscribeFailEvent>([ &failed ](const std::string&, const boost::system::error_code& ec) {
+        if(scio_beast::ack_timeout == ec) {
+            ++failed;
+        }
+    });
+
+    std::atomic<int> completions(0);
+    std::atomic<size_t> timedOut(0);
+    std::atomic<size_t> subscribed(0);
+    socket->on<scio_beast::SCSocket::ResubscribeCompleteEvent>(
+        [ &completions, &timedOut, &subscribed ](const scio_beast::ResubscribeResult& result) {
+            timedOut    = result.timedOut;
+            subscribed  = result.subscribed;
+            ++completions;
+        }
+    );
+
+    for(int n = 0; n < 3; ++n) {
+        socket->subscribe("slow-" + std::to_string(n));
+    }
+
+    socket->connect();
+
+    REQUIRE(waitFor([ &completions ]() { return 1 == completions; }, 1000));
+    CHECK(3 == timedOut);
+    CHECK(0 == subscribed);
+    CHECK(3 == failed);
+
+    socket->disconnect();
+    client->shutdown();
+    server->stop();
+}
+
+TEST_CASE("resume session with an issued token", "[reconnect]") {
+    using namespace scio_beast::standin;
+
+    auto server = Server::create();
+
+    server->on("login", [](Call& call) {
+        call.authToken = { { "user", call.data.value("user", "") } };
+    });
+
+    server->start();
+
+    scio_beast::SocketClusterClientOptions clientOpts;
+    clientOpts.connectOptions
+        .setHost("127.0.0.1")
+        .setPort(server->getPortString())
+        .setAutoReconnect(true)
+        ;
+    clientOpts.connectOptions.autoReconnectOptions.initialDelay = 10;
+    clientOpts.connectOptions.autoReconnectOptions.randomness   = 0;
+
+    auto client = scio_beast::SocketClusterClient::create(clientOpts);
+    auto socket = client->socket();
+
+    std::atomic<int> connects(0);
+    std::atomic<bool> resumed(false);
+    socket->on<scio_beast::SCSocket::ConnectEvent>([ &connects, &resumed ](const json& payload) {
+        if(2 == ++connects) {
+            resumed = payload["data"].value("isAuthenticated", false);
+        }
+    });
+
+    std::atomic<int> authenticated(0);
+    std::atomic<int> deauthenticated(0);
+    socket->on<scio_beast::SCSocket::AuthenticateEvent>([ &authenticated ](const std::string&) { ++authenticated; });
+    socket->on<scio_beast::SCSocket::DeauthenticateEvent>([ &deauthenticated ]() { ++deauthenticated; });
+
+    socket->connect();
+    REQUIRE(waitFor([ &connects ]() { return 1 == connects; }));
+
+    socket->emit("login", json({ { "user", "resumer" } }));
+    REQUIRE(waitFor([ &authenticated ]() { return 1 == authenticated; }));
+
+    const std::string token = socket->getSignedAuthToken();
+
+    const ConnectionId conn = *server->inspect([](const Protocol& p) { return p.connections(); }).begin();
+    server->closeConnection(conn);
+
+    REQUIRE(waitFor([ &connects ]() { return 2 == connects; }));
+    CHECK(resumed);
+
+    //  the #handshake alone restored the session
+    CHECK(1 == server->getStats().emits);
+    CHECK(0 == deauthenticated);
+    CHECK(token == socket->getSignedAuthToken());
+
+    socket->disconnect();
+    client->shutdown();
+    server->stop();
+}
+
+TEST_CASE("resume session with a rejected token", "[reconnect]") {
+    using namespace scio_beast::standin;
+
+    auto server = Server::create();
+    server->start();
+
+    scio_beast::SocketClusterClientOptions clientOpts;
+    clientOpts.connectOptions
+        .setHost("127.0.0.1")
+        .setPort(server->getPortString())
+        .setAutoReconnect(true)
+        ;
+    clientOpts.connectOptions.autoReconnectOptions.initialDelay = 10;
+    clientOpts.connectOptions.autoReconnectOptions.randomness   = 0;
+
+    auto client = scio_beast::SocketClusterClient::create(clientOpts);
+    auto socket = client->socket();
+
+    std::atomic<int> connects(0);
+    std::atomic<bool> resumed(true);
+    socket->on<scio_beast::SCSocket::ConnectEvent>([ &connects, &resumed ](const json& payload) {
+        if(2 == ++connects) {
+            resumed = payload["data"].value("isAuthenticated", false);
+        }
+    });
+
+    std::atomic<int> authenticated(0);
+    std::atomic<int> deauthenticated(0);
+    socket->on<scio_beast::SCSocket::AuthenticateEvent>([ &authenticated ](const std::string&) { ++authenticated; });
+    socket->on<scio_beast::SCSocket::DeauthenticateEvent>([ &deauthenticated ]() { ++deauthenticated; });
+
+    socket->connect();
+    REQUIRE(waitFor([ &connects ]() { return 1 == connects; }));
+
+    const ConnectionId conn = *server->inspect([](const Protocol& p) { return p.connections(); }).begin();
+
+    //  signed by another server, e.g. one since restarted; this one never issued it
+    Protocol elsewhere((StandinOptions()));
+    const json setAuthToken = {
+        { "event",  "#setAuthToken" },
+        { "data",   { { "token", elsewhere.signToken({ { "user", "stranger" } }) } } }
+    };
+
+    server->send(conn, setAuthToken);
+    REQUIRE(waitFor([ &authenticated ]() { return 1 == authenticated; }));
+    REQUIRE_FALSE(socket->getSignedAuthToken().empty());
+
+    server->closeConnection(conn);
+
+    REQUIRE(waitFor([ &connects ]() { return 2 == connects; }));
+    CHECK_FALSE(resumed);
+    CHECK(1 == deauthenticated);
+    CHECK(socket->getSignedAuthToken().empty());
+
+    //  and only the once
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    CHECK(1 == deauthenticated);
+
+    socket->disconnect();
+    client->shutdown();
+    server->stop();
+}
+
+TEST_CASE("happy eyeballs", "[connect]") {
+    using namespace scio_beast::standin;
+
+    auto server = Server::create();
+    server->start();
+
+    //
+    //  The name "resolves" to an IPv6 address in the discard prefix (RFC 6666) ahead
+    //  of the stand-in's IPv4 loopback. Whether the first attempt fails outright or
+    //  hangs, the IPv4 attempt must win.
+    //
+    const boost::asio::ip::tcp::endpoint unreachable(
+        boost::asio::ip::address::from_string("100::1"), server->getPort());
+    const boost::asio::ip::tcp::endpoint reachable(
+        boost::asio::ip::address_v4::loopback(), server->getPort());
+
+    auto resolverCache = std::make_shared<scio_beast::ResolverCache>();
+    resolverCache->store("standin.test:" + server->getPortString(), { unreachable, reachable });
+
+    scio_beast::SocketClusterClientOptions clientOpts;
+    clientOpts.connectOptions
+        .setHost("standin.test")
+        .setPort(server->getPortString())
+        .setAutoReconnect(false)
+        ;
+    clientOpts.connectOptions.resolverCache = resolverCache;
+    clientOpts.connectOptions.connectAttemptOptions.attemptDelay = 100;
+
+    auto client = scio_beast::SocketClusterClient::create(clientOpts);
+    auto socket = client->socket();
+
+    std::atomic<bool> connected(false);
+    socket->on<scio_beast::SCSocket::ConnectEvent>([ &connected ](const json&) { connected = true; });
+
+    socket->connect();
+
+    REQUIRE(waitFor([ &connected ]() { return connected.load(); }));
+
+    const scio_beast::ConnectStats stats = socket->getLastConnectStats();
+    CHECK(reachable == stats.endpoint);
+    CHECK(1u == stats.attemptIndex);
+    CHECK(2u == stats.attemptsStarted);
+
+    socket->disconnect();
+    client->shutdown();
+    server->stop();
+}
+
+#if defined(__linux__)
+TEST_CASE("transport options", "[connect]") {
+    using namespace scio_beast::standin;
+
+    auto server = Server::create();
+    server->start();
+
+    const auto intOption = [](const int fd, const int level, const int name) {
+        int value = -1;
+        socklen_t size = sizeof(value);
+        REQUIRE(0 == ::getsockopt(fd, level, name, &value, &size));
+        return value;
+    };
+
+    scio_beast::SocketClusterClientOptions clientOpts;
+    clientOpts.connectOptions
+        .setHost("127.0.0.1")
+        .setPort(server->getPortString())
+        .setAutoReconnect(false)
+        ;
+
+    scio_beast::TransportOptions transportOpts;
+    transportOpts.noDelay           = true;
+    transportOpts.keepAlive         = true;
+    transportOpts.keepAliveIdle     = 42;
+    transportOpts.receiveBufferSize = 16 * 1024;
+    transportOpts.sendBufferSize    = 16 * 1024;
+
+    auto client = scio_beast::SocketClusterClient::create(clientOpts);
+
+    auto plain = client->socket();
+    clientOpts.connectOptions.setTransportOptions(transportOpts);
+    auto tuned = client->socket(clientOpts.connectOptions);
+
+    std::atomic<int> connects(0);
+    plain->on<scio_beast::SCSocket::ConnectEvent>([ &connects ](const json&) { ++connects; });
+    tuned->on<scio_beast::SCSocket::ConnectEvent>([ &connects ](const json&) { ++connects; });
+
+    CHECK(-1 == tuned->getNativeHandle());
+
+    plain->connect();
+    tuned->connect();
+    REQUIRE(waitFor([ &connects ]() { return 2 == connects; }));
+
+    const int plainFd = plain->getNativeHandle();
+    const int tunedFd = tuned->getNativeHandle();
+    REQUIRE(plainFd >= 0);
+    REQUIRE(tunedFd >= 0);
+
+    //  set once connected
+    CHECK(0 == intOption(plainFd, IPPROTO_TCP, TCP_NODELAY));
+    CHECK(0 != intOption(tunedFd, IPPROTO_TCP, TCP_NODELAY));
+    CHECK(0 == intOption(plainFd, SOL_SOCKET, SO_KEEPALIVE));
+    CHECK(0 != intOption(tunedFd, SOL_SOCKET, SO_KEEPALIVE));
+    CHECK(42 == intOption(tunedFd, IPPROTO_TCP, TCP_KEEPIDLE));
+
+    //  set before connecting; Linux reports twice what was asked for, for its bookkeeping
+    const int receiveBuffer = intOption(tunedFd, SOL_SOCKET, SO_RCVBUF);
+    const int sendBuffer    = intOption(tunedFd, SOL_SOCKET, SO_SNDBUF);
+    CHECK(receiveBuffer >= transportOpts.receiveBufferSize);
+    CHECK(receiveBuffer <= 2 * transportOpts.receiveBufferSize);
+    CHECK(sendBuffer >= transportOpts.sendBufferSize);
+    CHECK(sendBuffer <= 2 * transportOpts.sendBufferSize);
+    CHECK(receiveBuffer != intOption(plainFd, SOL_SOCKET, SO_RCVBUF));
+
+    plain->disconnect();
+    tuned->disconnect();
+    client->shutdown();
+    server->stop();
+}
+#endif